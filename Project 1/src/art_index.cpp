@@ -0,0 +1,620 @@
+#include "art_index.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+enum ArtNodeType : uint8_t {
+    NODE4, NODE16, NODE48, NODE256
+};
+
+struct ArtNode {
+    ArtNodeType type;
+    uint8_t prefixLen;
+    uint16_t numChildren;
+    uint8_t prefix[4];  // the compressed path below the parent's byte, at most 3 bytes are ever used
+};
+
+struct ArtNode4 : ArtNode {
+    uint8_t keys[4];  // sorted
+    ArtNode *children[4];
+};
+
+struct ArtNode16 : ArtNode {
+    uint8_t keys[16];  // sorted
+    ArtNode *children[16];
+};
+
+struct ArtNode48 : ArtNode {
+    uint8_t childIndex[256];  // slot + 1 of the child for each byte, 0 if there is none
+    ArtNode *children[48];
+};
+
+struct ArtNode256 : ArtNode {
+    ArtNode *children[256];
+};
+
+struct ArtLeaf {
+    uint32_t key;  // in byte order, see encodeKey
+    vector<Record *> records;
+};
+
+static uint32_t encodeKey(int key) {
+    // flipping the sign bit makes the unsigned (big-endian byte) order match the signed order
+    return (uint32_t) key ^ 0x80000000u;
+}
+
+static int decodeKey(uint32_t key) {
+    return (int) (key ^ 0x80000000u);
+}
+
+static uint8_t keyByte(uint32_t key, int depth) {
+    return (uint8_t) (key >> (24 - 8 * depth));
+}
+
+template<typename Visitor>
+static bool forEachChild(ArtNode *node, int lowerByte, int upperByte, Visitor visit) {
+    /*
+     * Calls visit(byte, child) for the children with lowerByte <= byte <= upperByte in byte order, until visit
+     * returns false. Returns false if it was stopped.
+     */
+    switch (node->type) {
+        case NODE4:
+        case NODE16: {
+            uint8_t *keys = node->type == NODE4 ? static_cast<ArtNode4 *>(node)->keys
+                                                : static_cast<ArtNode16 *>(node)->keys;
+            ArtNode **children = node->type == NODE4 ? static_cast<ArtNode4 *>(node)->children
+                                                     : static_cast<ArtNode16 *>(node)->children;
+            for (int i = 0; i < node->numChildren && keys[i] <= upperByte; i++) {
+                if (keys[i] >= lowerByte && !visit(keys[i], children[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case NODE48: {
+            auto *node48 = static_cast<ArtNode48 *>(node);
+            for (int byte = lowerByte; byte <= upperByte; byte++) {
+                if (node48->childIndex[byte] != 0 && !visit(byte, node48->children[node48->childIndex[byte] - 1])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case NODE256: {
+            auto *node256 = static_cast<ArtNode256 *>(node);
+            for (int byte = lowerByte; byte <= upperByte; byte++) {
+                if (node256->children[byte] != nullptr && !visit(byte, node256->children[byte])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+    return true;
+}
+
+static ArtNode *newNode(ArtNodeType type) {
+    ArtNode *node;
+    switch (type) {
+        case NODE4:
+            node = new ArtNode4();
+            break;
+        case NODE16:
+            node = new ArtNode16();
+            break;
+        case NODE48:
+            node = new ArtNode48();
+            break;
+        default:
+            node = new ArtNode256();
+            break;
+    }
+    node->type = type;
+    return node;
+}
+
+static void freeNode(ArtNode *node) {
+    switch (node->type) {
+        case NODE4:
+            delete static_cast<ArtNode4 *>(node);
+            break;
+        case NODE16:
+            delete static_cast<ArtNode16 *>(node);
+            break;
+        case NODE48:
+            delete static_cast<ArtNode48 *>(node);
+            break;
+        case NODE256:
+            delete static_cast<ArtNode256 *>(node);
+            break;
+    }
+}
+
+static size_t getNodeSize(ArtNodeType type) {
+    switch (type) {
+        case NODE4:
+            return sizeof(ArtNode4);
+        case NODE16:
+            return sizeof(ArtNode16);
+        case NODE48:
+            return sizeof(ArtNode48);
+        default:
+            return sizeof(ArtNode256);
+    }
+}
+
+static ArtNode *resizeNode(ArtNode *node, ArtNodeType type) {
+    /*
+     * Copies the prefix and the children of a node into a new node of another type, and frees the old one
+     */
+    ArtNode *resized = newNode(type);
+    resized->prefixLen = node->prefixLen;
+    memcpy(resized->prefix, node->prefix, sizeof(node->prefix));
+
+    forEachChild(node, 0, 255, [&](int byte, ArtNode *child) {
+        int slot = resized->numChildren++;
+        switch (type) {
+            case NODE4:
+                static_cast<ArtNode4 *>(resized)->keys[slot] = byte;
+                static_cast<ArtNode4 *>(resized)->children[slot] = child;
+                break;
+            case NODE16:
+                static_cast<ArtNode16 *>(resized)->keys[slot] = byte;
+                static_cast<ArtNode16 *>(resized)->children[slot] = child;
+                break;
+            case NODE48:
+                static_cast<ArtNode48 *>(resized)->childIndex[byte] = slot + 1;
+                static_cast<ArtNode48 *>(resized)->children[slot] = child;
+                break;
+            case NODE256:
+                static_cast<ArtNode256 *>(resized)->children[byte] = child;
+                break;
+        }
+        return true;
+    });
+    freeNode(node);
+    return resized;
+}
+
+ArtIndex::ArtIndex() {
+    rootNode = nullptr;
+    numKeys = 0;
+}
+
+ArtIndex::~ArtIndex() {
+    freeTree(rootNode);
+}
+
+const char *ArtIndex::getName() {
+    return "ART";
+}
+
+bool ArtIndex::isLeaf(const ArtNode *node) {
+    return (reinterpret_cast<uintptr_t>(node) & 1) != 0;
+}
+
+ArtLeaf *ArtIndex::asLeaf(ArtNode *node) {
+    return reinterpret_cast<ArtLeaf *>(reinterpret_cast<uintptr_t>(node) & ~(uintptr_t) 1);
+}
+
+ArtNode *ArtIndex::tagLeaf(ArtLeaf *leaf) {
+    return reinterpret_cast<ArtNode *>(reinterpret_cast<uintptr_t>(leaf) | 1);
+}
+
+ArtNode **ArtIndex::findChild(ArtNode *node, uint8_t byte) {
+    /*
+     * Returns the child slot for a key byte, or nullptr if there is no child for it
+     */
+    switch (node->type) {
+        case NODE4: {
+            auto *node4 = static_cast<ArtNode4 *>(node);
+            for (int i = 0; i < node4->numChildren; i++) {
+                if (node4->keys[i] == byte) {
+                    return &node4->children[i];
+                }
+            }
+            return nullptr;
+        }
+        case NODE16: {
+            auto *node16 = static_cast<ArtNode16 *>(node);
+#if defined(__SSE2__)
+            // compare all 16 key bytes at once
+            __m128i matches = _mm_cmpeq_epi8(_mm_set1_epi8((char) byte),
+                                             _mm_loadu_si128(reinterpret_cast<__m128i *>(node16->keys)));
+            unsigned mask = (unsigned) _mm_movemask_epi8(matches) & ((1u << node16->numChildren) - 1);
+            return mask != 0 ? &node16->children[__builtin_ctz(mask)] : nullptr;
+#else
+            for (int i = 0; i < node16->numChildren; i++) {
+                if (node16->keys[i] == byte) {
+                    return &node16->children[i];
+                }
+            }
+            return nullptr;
+#endif
+        }
+        case NODE48: {
+            auto *node48 = static_cast<ArtNode48 *>(node);
+            return node48->childIndex[byte] != 0 ? &node48->children[node48->childIndex[byte] - 1] : nullptr;
+        }
+        case NODE256: {
+            auto *node256 = static_cast<ArtNode256 *>(node);
+            return node256->children[byte] != nullptr ? &node256->children[byte] : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+void ArtIndex::addChild(ArtNode *&nodeRef, uint8_t byte, ArtNode *child) {
+    /*
+     * Adds a child for a key byte that has none yet, growing the node into the next type if it is full
+     */
+    ArtNode *node = nodeRef;
+    switch (node->type) {
+        case NODE4:
+        case NODE16: {
+            int capacity = node->type == NODE4 ? 4 : 16;
+            if (node->numChildren == capacity) {
+                nodeRef = resizeNode(node, node->type == NODE4 ? NODE16 : NODE48);
+                addChild(nodeRef, byte, child);
+                return;
+            }
+            uint8_t *keys = node->type == NODE4 ? static_cast<ArtNode4 *>(node)->keys
+                                                : static_cast<ArtNode16 *>(node)->keys;
+            ArtNode **children = node->type == NODE4 ? static_cast<ArtNode4 *>(node)->children
+                                                     : static_cast<ArtNode16 *>(node)->children;
+            // keep the key bytes sorted
+            int pos = 0;
+            while (pos < node->numChildren && keys[pos] < byte) {
+                pos++;
+            }
+            memmove(keys + pos + 1, keys + pos, node->numChildren - pos);
+            memmove(children + pos + 1, children + pos, (node->numChildren - pos) * sizeof(ArtNode *));
+            keys[pos] = byte;
+            children[pos] = child;
+            node->numChildren++;
+            return;
+        }
+        case NODE48: {
+            auto *node48 = static_cast<ArtNode48 *>(node);
+            if (node48->numChildren == 48) {
+                nodeRef = resizeNode(node, NODE256);
+                addChild(nodeRef, byte, child);
+                return;
+            }
+            int slot = 0;
+            while (node48->children[slot] != nullptr) {
+                slot++;
+            }
+            node48->children[slot] = child;
+            node48->childIndex[byte] = slot + 1;
+            node48->numChildren++;
+            return;
+        }
+        case NODE256: {
+            static_cast<ArtNode256 *>(node)->children[byte] = child;
+            node->numChildren++;
+            return;
+        }
+    }
+}
+
+void ArtIndex::removeChild(ArtNode *&nodeRef, uint8_t byte) {
+    /*
+     * Removes the child of a key byte, shrinking the node into the previous type once it is sparse enough.
+     * A Node4 left with a single child is replaced by that child, with the node's prefix and the child's byte
+     * moved into the child's prefix.
+     */
+    ArtNode *node = nodeRef;
+    switch (node->type) {
+        case NODE4:
+        case NODE16: {
+            uint8_t *keys = node->type == NODE4 ? static_cast<ArtNode4 *>(node)->keys
+                                                : static_cast<ArtNode16 *>(node)->keys;
+            ArtNode **children = node->type == NODE4 ? static_cast<ArtNode4 *>(node)->children
+                                                     : static_cast<ArtNode16 *>(node)->children;
+            int pos = 0;
+            while (keys[pos] != byte) {
+                pos++;
+            }
+            memmove(keys + pos, keys + pos + 1, node->numChildren - pos - 1);
+            memmove(children + pos, children + pos + 1, (node->numChildren - pos - 1) * sizeof(ArtNode *));
+            node->numChildren--;
+
+            if (node->type == NODE16 && node->numChildren == 3) {
+                nodeRef = resizeNode(node, NODE4);
+            } else if (node->type == NODE4 && node->numChildren == 1) {
+                ArtNode *child = children[0];
+                if (!isLeaf(child)) {
+                    uint8_t prefix[4];
+                    int prefixLen = node->prefixLen;
+                    memcpy(prefix, node->prefix, prefixLen);
+                    prefix[prefixLen++] = keys[0];
+                    memcpy(prefix + prefixLen, child->prefix, child->prefixLen);
+                    child->prefixLen += prefixLen;
+                    memcpy(child->prefix, prefix, child->prefixLen);
+                }
+                nodeRef = child;
+                freeNode(node);
+            }
+            return;
+        }
+        case NODE48: {
+            auto *node48 = static_cast<ArtNode48 *>(node);
+            node48->children[node48->childIndex[byte] - 1] = nullptr;
+            node48->childIndex[byte] = 0;
+            node48->numChildren--;
+            if (node48->numChildren == 12) {
+                nodeRef = resizeNode(node, NODE16);
+            }
+            return;
+        }
+        case NODE256: {
+            static_cast<ArtNode256 *>(node)->children[byte] = nullptr;
+            node->numChildren--;
+            if (node->numChildren == 37) {
+                nodeRef = resizeNode(node, NODE48);
+            }
+            return;
+        }
+    }
+}
+
+void ArtIndex::insert(int key, Record *pRecord) {
+    insertAt(rootNode, encodeKey(key), pRecord, 0);
+}
+
+void ArtIndex::insertAt(ArtNode *&nodeRef, uint32_t key, Record *pRecord, int depth) {
+    /*
+     * Inserts a record under key into the subtree in nodeRef, whose node starts at key byte depth
+     */
+    if (nodeRef == nullptr) {
+        nodeRef = tagLeaf(new ArtLeaf{key, {pRecord}});
+        numKeys++;
+        return;
+    }
+
+    if (isLeaf(nodeRef)) {
+        ArtLeaf *leaf = asLeaf(nodeRef);
+        if (leaf->key == key) {
+            leaf->records.push_back(pRecord);
+            return;
+        }
+
+        // two keys in one slot: a Node4 over the bytes they share, with both leaves below it
+        ArtNode *node = newNode(NODE4);
+        while (keyByte(key, depth + node->prefixLen) == keyByte(leaf->key, depth + node->prefixLen)) {
+            node->prefix[node->prefixLen] = keyByte(key, depth + node->prefixLen);
+            node->prefixLen++;
+        }
+        addChild(node, keyByte(leaf->key, depth + node->prefixLen), nodeRef);
+        addChild(node, keyByte(key, depth + node->prefixLen), tagLeaf(new ArtLeaf{key, {pRecord}}));
+        numKeys++;
+        nodeRef = node;
+        return;
+    }
+
+    // the key leaves the compressed path: split the prefix with a new Node4 above the node
+    ArtNode *node = nodeRef;
+    int mismatch = 0;
+    while (mismatch < node->prefixLen && node->prefix[mismatch] == keyByte(key, depth + mismatch)) {
+        mismatch++;
+    }
+    if (mismatch < node->prefixLen) {
+        ArtNode *parent = newNode(NODE4);
+        parent->prefixLen = mismatch;
+        memcpy(parent->prefix, node->prefix, mismatch);
+        uint8_t nodeByte = node->prefix[mismatch];
+        node->prefixLen -= mismatch + 1;
+        memmove(node->prefix, node->prefix + mismatch + 1, node->prefixLen);
+
+        addChild(parent, nodeByte, node);
+        addChild(parent, keyByte(key, depth + mismatch), tagLeaf(new ArtLeaf{key, {pRecord}}));
+        numKeys++;
+        nodeRef = parent;
+        return;
+    }
+    depth += node->prefixLen;
+
+    ArtNode **child = findChild(node, keyByte(key, depth));
+    if (child != nullptr) {
+        insertAt(*child, key, pRecord, depth + 1);
+        return;
+    }
+    addChild(nodeRef, keyByte(key, depth), tagLeaf(new ArtLeaf{key, {pRecord}}));
+    numKeys++;
+}
+
+vector<Record *> *ArtIndex::search(int key) {
+    /*
+     * Follows the key bytes down to a leaf, checking the compressed paths on the way
+     */
+    uint32_t encodedKey = encodeKey(key);
+    ArtNode *node = rootNode;
+    int depth = 0;
+    while (node != nullptr) {
+        if (isLeaf(node)) {
+            ArtLeaf *leaf = asLeaf(node);
+            return leaf->key == encodedKey ? &leaf->records : nullptr;
+        }
+        for (int i = 0; i < node->prefixLen; i++) {
+            if (node->prefix[i] != keyByte(encodedKey, depth + i)) {
+                return nullptr;
+            }
+        }
+        depth += node->prefixLen;
+
+        ArtNode **child = findChild(node, keyByte(encodedKey, depth));
+        if (child == nullptr) {
+            return nullptr;
+        }
+        node = *child;
+        depth++;
+    }
+    return nullptr;
+}
+
+size_t ArtIndex::scanRange(int lowerKey, int upperKey, const IndexVisitor &visit) {
+    if (lowerKey > upperKey || rootNode == nullptr) {
+        return 0;
+    }
+    return scanNode(rootNode, 0, encodeKey(lowerKey), encodeKey(upperKey), true, true, visit);
+}
+
+size_t ArtIndex::scanNode(ArtNode *node, int depth, uint32_t lowerKey, uint32_t upperKey, bool checkLower,
+                          bool checkUpper, const IndexVisitor &visit) {
+    /*
+     * Visits the keys of a subtree in [lowerKey, upperKey] in order. checkLower / checkUpper tell whether the
+     * path so far equals the bytes of that bound, in which case children beyond the bound's next byte are skipped.
+     */
+    if (isLeaf(node)) {
+        ArtLeaf *leaf = asLeaf(node);
+        if (leaf->key < lowerKey || leaf->key > upperKey) {
+            return 0;
+        }
+        visit(decodeKey(leaf->key), leaf->records);
+        return 1;
+    }
+
+    for (int i = 0; i < node->prefixLen && (checkLower || checkUpper); i++) {
+        uint8_t byte = node->prefix[i];
+        if (checkLower) {
+            if (byte < keyByte(lowerKey, depth + i)) {
+                return 0;
+            }
+            checkLower = byte == keyByte(lowerKey, depth + i);
+        }
+        if (checkUpper) {
+            if (byte > keyByte(upperKey, depth + i)) {
+                return 0;
+            }
+            checkUpper = byte == keyByte(upperKey, depth + i);
+        }
+    }
+    depth += node->prefixLen;
+
+    int lowerByte = checkLower ? keyByte(lowerKey, depth) : 0;
+    int upperByte = checkUpper ? keyByte(upperKey, depth) : 255;
+    size_t visited = 0;
+    forEachChild(node, lowerByte, upperByte, [&](int byte, ArtNode *child) {
+        visited += scanNode(child, depth + 1, lowerKey, upperKey, checkLower && byte == lowerByte,
+                            checkUpper && byte == upperByte, visit);
+        return true;
+    });
+    return visited;
+}
+
+void ArtIndex::removeKey(int key) {
+    removeAt(rootNode, encodeKey(key), 0);
+}
+
+bool ArtIndex::removeAt(ArtNode *&nodeRef, uint32_t key, int depth) {
+    /*
+     * Removes the leaf of key from the subtree in nodeRef, returns false if the key is not there
+     */
+    ArtNode *node = nodeRef;
+    if (node == nullptr) {
+        return false;
+    }
+    if (isLeaf(node)) {
+        // only reached for a leaf at the root
+        if (asLeaf(node)->key != key) {
+            return false;
+        }
+        delete asLeaf(node);
+        nodeRef = nullptr;
+        numKeys--;
+        return true;
+    }
+
+    for (int i = 0; i < node->prefixLen; i++) {
+        if (node->prefix[i] != keyByte(key, depth + i)) {
+            return false;
+        }
+    }
+    depth += node->prefixLen;
+
+    uint8_t byte = keyByte(key, depth);
+    ArtNode **child = findChild(node, byte);
+    if (child == nullptr) {
+        return false;
+    }
+    if (!isLeaf(*child)) {
+        return removeAt(*child, key, depth + 1);
+    }
+    if (asLeaf(*child)->key != key) {
+        return false;
+    }
+    delete asLeaf(*child);
+    removeChild(nodeRef, byte);
+    numKeys--;
+    return true;
+}
+
+void ArtIndex::freeTree(ArtNode *node) {
+    if (node == nullptr) {
+        return;
+    }
+    if (isLeaf(node)) {
+        delete asLeaf(node);
+        return;
+    }
+    forEachChild(node, 0, 255, [&](int, ArtNode *child) {
+        freeTree(child);
+        return true;
+    });
+    freeNode(node);
+}
+
+size_t ArtIndex::getMemoryUsage() {
+    /*
+     * Sums the inner nodes and the leaves with the capacity of their posting lists
+     */
+    size_t bytes = 0;
+    vector<ArtNode *> nodes;
+    if (rootNode != nullptr) {
+        nodes.push_back(rootNode);
+    }
+    while (!nodes.empty()) {
+        ArtNode *node = nodes.back();
+        nodes.pop_back();
+        if (isLeaf(node)) {
+            bytes += sizeof(ArtLeaf) + asLeaf(node)->records.capacity() * sizeof(Record *);
+            continue;
+        }
+        bytes += getNodeSize(node->type);
+        forEachChild(node, 0, 255, [&](int, ArtNode *child) {
+            nodes.push_back(child);
+            return true;
+        });
+    }
+    return bytes;
+}
+
+size_t ArtIndex::getNumKeys() {
+    return numKeys;
+}
+
+vector<size_t> ArtIndex::countNodes() {
+    vector<size_t> counts(4, 0);
+    vector<ArtNode *> nodes;
+    if (rootNode != nullptr && !isLeaf(rootNode)) {
+        nodes.push_back(rootNode);
+    }
+    while (!nodes.empty()) {
+        ArtNode *node = nodes.back();
+        nodes.pop_back();
+        counts[node->type]++;
+        forEachChild(node, 0, 255, [&](int, ArtNode *child) {
+            if (!isLeaf(child)) {
+                nodes.push_back(child);
+            }
+            return true;
+        });
+    }
+    return counts;
+}
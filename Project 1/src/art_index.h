@@ -0,0 +1,76 @@
+#ifndef ART_INDEX_H
+#define ART_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "index.h"
+
+struct ArtNode;
+
+struct ArtLeaf;
+
+class ArtIndex : public Index {
+    /*
+     * Adaptive Radix Tree (Leis et al., ICDE 2013) over the 4 key bytes, most significant first, with the sign
+     * bit flipped so that byte order matches the order of the signed keys.
+     *
+     * Inner nodes come in four sizes, Node4 / Node16 (sorted key bytes), Node48 (a 256-entry byte-to-slot map)
+     * and Node256 (direct array), and grow and shrink between them as children are added and removed. Path
+     * compression stores the bytes of single-child chains in the node as a prefix; keys are at most 4 bytes, so
+     * the whole prefix always fits and no optimistic check is needed. Leaves are expanded lazily: a leaf hangs
+     * as high as possible and holds its full key and the posting list. Leaf pointers are tagged in the low bit.
+     */
+private:
+    ArtNode *rootNode;
+    size_t numKeys;
+
+    static bool isLeaf(const ArtNode *node);
+
+    static ArtLeaf *asLeaf(ArtNode *node);
+
+    static ArtNode *tagLeaf(ArtLeaf *leaf);
+
+    static ArtNode **findChild(ArtNode *node, uint8_t byte);
+
+    static void addChild(ArtNode *&nodeRef, uint8_t byte, ArtNode *child);
+
+    static void removeChild(ArtNode *&nodeRef, uint8_t byte);
+
+    void insertAt(ArtNode *&nodeRef, uint32_t key, Record *pRecord, int depth);
+
+    bool removeAt(ArtNode *&nodeRef, uint32_t key, int depth);
+
+    size_t scanNode(ArtNode *node, int depth, uint32_t lowerKey, uint32_t upperKey, bool checkLower,
+                    bool checkUpper, const IndexVisitor &visit);
+
+    void freeTree(ArtNode *node);
+
+public:
+    ArtIndex();
+
+    ~ArtIndex() override;
+
+    ArtIndex(const ArtIndex &) = delete;
+
+    ArtIndex &operator=(const ArtIndex &) = delete;
+
+    const char *getName() override;
+
+    void insert(int key, Record *pRecord) override;
+
+    std::vector<Record *> *search(int key) override;
+
+    size_t scanRange(int lowerKey, int upperKey, const IndexVisitor &visit) override;
+
+    void removeKey(int key) override;
+
+    size_t getMemoryUsage() override;
+
+    size_t getNumKeys();
+
+    // number of inner nodes of each type, Node4 / Node16 / Node48 / Node256
+    std::vector<size_t> countNodes();
+};
+
+#endif
@@ -0,0 +1,105 @@
+#include "async_scan.h"
+#include "scan.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+static void accumulate(ScanAggregate &aggregate, const Record &record) {
+    aggregate.count++;
+    aggregate.ratingSum += record.averageRating;
+    aggregate.minVotes = min(aggregate.minVotes, (int) record.numVotes);
+    aggregate.maxVotes = max(aggregate.maxVotes, (int) record.numVotes);
+}
+
+ScanAggregate asyncSequentialScan(BlockIOEngine *engine, Disk *disk, const RecordFilter &filter) {
+    /*
+     * Queues a read for every block in use and submits them in batches of the engine's queue depth. Every
+     * completed block is filtered and aggregated from its callback.
+     */
+    ScanAggregate aggregate;
+    size_t blocksUsed = disk->getBlocksUsed();
+    unsigned queued = 0;
+
+    for (size_t blockIdx = 0; blockIdx < blocksUsed; blockIdx++) {
+        if (disk->getRecordsInBlock(blockIdx) == 0) {
+            continue;
+        }
+
+        engine->read(blockIdx, [&](size_t readBlockIdx, const unsigned char *data, ssize_t bytesRead) {
+            size_t recordsInBlock = min(disk->getRecordsInBlock(readBlockIdx),
+                                        bytesRead > 0 ? (size_t) bytesRead / sizeof(Record) : 0);
+            for (size_t recordIdx = 0; recordIdx < recordsInBlock; recordIdx++) {
+                // the read buffer is not aligned for Record, so copy the record out
+                Record record;
+                memcpy(&record, data + recordIdx * sizeof(Record), sizeof(Record));
+                if (record.averageRating >= filter.minRating && record.averageRating <= filter.maxRating &&
+                    record.numVotes >= filter.minVotes && record.numVotes <= filter.maxVotes &&
+                    !disk->isDeleted(readBlockIdx, recordIdx)) {
+                    accumulate(aggregate, record);
+                }
+            }
+        });
+
+        // hand the reads to the kernel one queue depth at a time
+        if (++queued == engine->getQueueDepth()) {
+            engine->submit();
+            queued = 0;
+        }
+    }
+
+    engine->drain();
+    return aggregate;
+}
+
+ScanAggregate asyncBitmapHeapScan(BlockIOEngine *engine, Tree *tree, Disk *disk, int lowerKey, int upperKey) {
+    /*
+     * Same as bitmapHeapScan, but the marked blocks are read through the engine with many reads in flight
+     */
+    ScanAggregate aggregate;
+    size_t recordsPerBlock = disk->getMaxRecordsPerBlock();
+    int indexNodesAccessed;
+    vector<uint64_t> bitmap = buildRecordBitmap(tree, disk, lowerKey, upperKey, &indexNodesAccessed);
+
+    // the marked blocks, in ascending order
+    vector<size_t> blocks;
+    for (size_t word = 0; word < bitmap.size(); word++) {
+        uint64_t bits = bitmap[word];
+        while (bits != 0) {
+            size_t blockIdx = (word * 64 + __builtin_ctzll(bits)) / recordsPerBlock;
+            bits &= bits - 1;
+            if (blocks.empty() || blocks.back() != blockIdx) {
+                blocks.push_back(blockIdx);
+            }
+        }
+    }
+
+    unsigned queued = 0;
+    for (size_t blockIdx: blocks) {
+        engine->read(blockIdx, [&](size_t readBlockIdx, const unsigned char *data, ssize_t bytesRead) {
+            for (size_t recordIdx = 0; recordIdx < recordsPerBlock; recordIdx++) {
+                size_t slot = readBlockIdx * recordsPerBlock + recordIdx;
+                if ((bitmap[slot / 64] & ((uint64_t) 1 << (slot % 64))) == 0 ||
+                    (recordIdx + 1) * sizeof(Record) > (size_t) max(bytesRead, (ssize_t) 0)) {
+                    continue;
+                }
+
+                // recheck the predicate on the marked records
+                Record record;
+                memcpy(&record, data + recordIdx * sizeof(Record), sizeof(Record));
+                if (record.numVotes >= lowerKey && record.numVotes <= upperKey) {
+                    accumulate(aggregate, record);
+                }
+            }
+        });
+
+        if (++queued == engine->getQueueDepth()) {
+            engine->submit();
+            queued = 0;
+        }
+    }
+
+    engine->drain();
+    return aggregate;
+}
@@ -0,0 +1,21 @@
+#ifndef ASYNC_SCAN_H
+#define ASYNC_SCAN_H
+
+#include "block_io.h"
+#include "disk.h"
+#include "tree.h"
+#include "parallel_scan.h"
+
+/*
+ * Scan operators over a Disk image in a file, read through a BlockIOEngine. The record data comes from the
+ * file, while the block fill levels and deleted flags still come from the Disk. Records are aggregated as the
+ * reads complete; record pointers cannot be collected since the read buffers are reused.
+ */
+
+// reads every block in use, keeping up to the engine's queue depth of reads in flight
+ScanAggregate asyncSequentialScan(BlockIOEngine *engine, Disk *disk, const RecordFilter &filter);
+
+// builds the record bitmap from the index, then reads every marked block once, in ascending order
+ScanAggregate asyncBitmapHeapScan(BlockIOEngine *engine, Tree *tree, Disk *disk, int lowerKey, int upperKey);
+
+#endif
@@ -0,0 +1,297 @@
+#include "block_io.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#define BLOCK_IO_HAS_IO_URING 1
+#else
+#define BLOCK_IO_HAS_IO_URING 0
+#endif
+
+using namespace std;
+
+BlockIOEngine::BlockIOEngine(const string &path, size_t aBlockSize, unsigned aQueueDepth, bool useIoUring) {
+    /*
+     * Constructor for a BlockIOEngine, opens the file and sets up an io_uring with aQueueDepth entries if
+     * requested and possible
+     */
+    blockSize = aBlockSize;
+    queueDepth = max(1u, aQueueDepth);
+    asyncEnabled = false;
+    queuedReads = 0;
+    inFlightReads = 0;
+    failedReads = 0;
+    ringFd = -1;
+    sqRing = cqRing = sqEntries = cqEntries = nullptr;
+    sqRingSize = cqRingSize = sqEntriesSize = 0;
+
+    fileDescriptor = open(path.c_str(), O_RDONLY);
+
+    // one buffer per slot, so a slot can be reused as soon as its callback has run
+    size_t poolSize = (queueDepth * blockSize + 4095) / 4096 * 4096;
+    bufferPool = static_cast<unsigned char *>(aligned_alloc(4096, poolSize));
+    slots.resize(queueDepth);
+    for (unsigned i = queueDepth; i > 0; i--) {
+        freeSlots.push_back(i - 1);
+        slots[i - 1].buffer = bufferPool + (i - 1) * blockSize;
+    }
+
+    if (useIoUring && fileDescriptor >= 0) {
+        asyncEnabled = setupRing();
+    }
+    TRACE_INFO("blockio.init", asyncEnabled ? 1 : 0);
+}
+
+BlockIOEngine::~BlockIOEngine() {
+    drain();
+
+#if BLOCK_IO_HAS_IO_URING
+    if (asyncEnabled) {
+        munmap(sqEntries, sqEntriesSize);
+        if (cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        munmap(sqRing, sqRingSize);
+        close(ringFd);
+    }
+#endif
+
+    if (fileDescriptor >= 0) {
+        close(fileDescriptor);
+    }
+    free(bufferPool);
+}
+
+bool BlockIOEngine::setupRing() {
+    /*
+     * Creates the io_uring and maps its submission queue, completion queue and submission entries.
+     * Returns false (leaving the pread fallback in place) if the kernel refuses.
+     */
+#if BLOCK_IO_HAS_IO_URING
+    io_uring_params params{};
+    ringFd = (int) syscall(__NR_io_uring_setup, queueDepth, &params);
+    if (ringFd < 0) {
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) {
+        sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+    }
+
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                  IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        close(ringFd);
+        return false;
+    }
+    cqRing = singleMmap ? sqRing : mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                        ringFd, IORING_OFF_CQ_RING);
+    sqEntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+    sqEntries = mmap(nullptr, sqEntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                     IORING_OFF_SQES);
+    if (cqRing == MAP_FAILED || sqEntries == MAP_FAILED) {
+        munmap(sqRing, sqRingSize);
+        close(ringFd);
+        return false;
+    }
+
+    auto *sq = static_cast<unsigned char *>(sqRing);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqRingMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+    auto *cq = static_cast<unsigned char *>(cqRing);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqRingMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqEntries = cq + params.cq_off.cqes;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool BlockIOEngine::isOpen() {
+    return fileDescriptor >= 0;
+}
+
+bool BlockIOEngine::isAsync() {
+    return asyncEnabled;
+}
+
+unsigned BlockIOEngine::getQueueDepth() {
+    return queueDepth;
+}
+
+size_t BlockIOEngine::getFailedReads() {
+    return failedReads;
+}
+
+ssize_t BlockIOEngine::readSlot(unsigned slotIdx) {
+    /*
+     * Reads the block of a slot into its buffer with pread(), returns the bytes read or -errno
+     */
+    ReadSlot &slot = slots[slotIdx];
+    ssize_t result = pread(fileDescriptor, slot.buffer, blockSize, (off_t) (slot.blockIdx * blockSize));
+    return result < 0 ? -errno : result;
+}
+
+void BlockIOEngine::read(size_t blockIdx, ReadCallback callback) {
+    /*
+     * Queues a read of one block. If all queueDepth slots are busy, completions are reaped first.
+     */
+    while (freeSlots.empty()) {
+        submit();
+        poll(true);
+    }
+
+    unsigned slotIdx = freeSlots.back();
+    freeSlots.pop_back();
+    ReadSlot &slot = slots[slotIdx];
+    slot.blockIdx = blockIdx;
+    slot.callback = std::move(callback);
+
+#if BLOCK_IO_HAS_IO_URING
+    if (asyncEnabled) {
+        // fill the next submission entry, the kernel sees it once the tail is published in submit()
+        unsigned tail = *sqTail;
+        unsigned idx = tail & *sqRingMask;
+        io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqEntries) + idx;
+        memset(sqe, 0, sizeof(io_uring_sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fileDescriptor;
+        sqe->addr = reinterpret_cast<uint64_t>(slot.buffer);
+        sqe->len = (unsigned) blockSize;
+        sqe->off = (uint64_t) (blockIdx * blockSize);
+        sqe->user_data = slotIdx;
+        sqArray[idx] = idx;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        queuedReads++;
+        return;
+    }
+#endif
+
+    // synchronous fallback, the callback still runs from poll()
+    syncCompletions.emplace_back(slotIdx, readSlot(slotIdx));
+    inFlightReads++;
+}
+
+void BlockIOEngine::submit() {
+    /*
+     * Hands all queued reads to the kernel with a single io_uring_enter call. If the kernel fails the call or
+     * takes none of them, the reads left in the submission queue are done with pread() instead.
+     */
+#if BLOCK_IO_HAS_IO_URING
+    while (asyncEnabled && queuedReads > 0) {
+        int submitted = (int) syscall(__NR_io_uring_enter, ringFd, queuedReads, 0, 0, nullptr, 0);
+        if (submitted < 0 && errno == EINTR) {
+            continue;
+        }
+        if (submitted <= 0) {
+            TRACE_ERROR("blockio.submit.error", submitted < 0 ? errno : 0);
+            submitSync();
+            return;
+        }
+        queuedReads -= submitted;
+        inFlightReads += submitted;
+        TRACE_DEBUG("blockio.submit", submitted);
+    }
+#endif
+}
+
+void BlockIOEngine::submitSync() {
+    /*
+     * Takes back the entries the kernel has not consumed from the submission queue and does their reads with
+     * pread(); the callbacks run from poll() like those of the synchronous fallback
+     */
+#if BLOCK_IO_HAS_IO_URING
+    unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+    for (unsigned idx = head; idx != *sqTail; idx++) {
+        io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqEntries) + sqArray[idx & *sqRingMask];
+        auto slotIdx = (unsigned) sqe->user_data;
+        syncCompletions.emplace_back(slotIdx, readSlot(slotIdx));
+        inFlightReads++;
+    }
+    __atomic_store_n(sqTail, head, __ATOMIC_RELEASE);
+    queuedReads = 0;
+#endif
+}
+
+void BlockIOEngine::completeSlot(unsigned slotIdx, ssize_t result) {
+    ReadSlot &slot = slots[slotIdx];
+    inFlightReads--;
+    if (result < 0) {
+        failedReads++;
+    }
+    slot.callback(slot.blockIdx, slot.buffer, result);
+    slot.callback = nullptr;
+    freeSlots.push_back(slotIdx);
+}
+
+size_t BlockIOEngine::poll(bool wait) {
+    /*
+     * Runs the callbacks of completed reads and returns how many completed. With wait set, blocks until at least
+     * one read completes (if any are in flight).
+     */
+    size_t completed = 0;
+
+    // reads done with pread(), by the fallback or after io_uring refused them
+    vector<pair<unsigned, ssize_t>> ready;
+    ready.swap(syncCompletions);
+    for (auto &completion: ready) {
+        completeSlot(completion.first, completion.second);
+        completed++;
+    }
+
+#if BLOCK_IO_HAS_IO_URING
+    if (asyncEnabled) {
+        unsigned head = *cqHead;
+        if (wait && completed == 0 && inFlightReads > 0 && head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            syscall(__NR_io_uring_enter, ringFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+        }
+
+        while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            io_uring_cqe *cqe = static_cast<io_uring_cqe *>(cqEntries) + (head & *cqRingMask);
+            auto slotIdx = (unsigned) cqe->user_data;
+            ssize_t result = cqe->res;
+
+            // release the entry before the callback, which may queue further reads
+            head++;
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+
+            // the read failed in the ring (or the kernel does not support it there), retry it with pread()
+            if (result < 0) {
+                TRACE_ERROR("blockio.read.error", -result);
+                result = readSlot(slotIdx);
+            }
+            completeSlot(slotIdx, result);
+            completed++;
+        }
+    }
+#endif
+    return completed;
+}
+
+void BlockIOEngine::drain() {
+    /*
+     * Submits everything queued and waits until every read has completed
+     */
+    submit();
+    while (inFlightReads > 0 || queuedReads > 0) {
+        submit();
+        poll(true);
+    }
+}
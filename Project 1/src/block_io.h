@@ -0,0 +1,90 @@
+#ifndef BLOCK_IO_H
+#define BLOCK_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+// called once per completed read, data is only valid for the duration of the call
+typedef std::function<void(size_t blockIdx, const unsigned char *data, ssize_t bytesRead)> ReadCallback;
+
+class BlockIOEngine {
+    /*
+     * Asynchronous block reader for a Disk image stored in a file (block i at offset i x blockSize).
+     *
+     * Reads are queued with read(), handed to the kernel in batches with submit(), and their callbacks run from
+     * poll() as they complete. At most queueDepth reads are in flight; read() reaps completions by itself when
+     * the queue is full. The engine uses io_uring when the kernel allows it, and otherwise falls back to
+     * synchronous pread() calls behind the same interface. A read that io_uring fails or refuses to submit is
+     * retried with pread(); a read that still fails reaches its callback with a negative bytesRead (-errno) and is
+     * counted in getFailedReads().
+     */
+private:
+    struct ReadSlot {
+        size_t blockIdx;
+        ReadCallback callback;
+        unsigned char *buffer;
+    };
+
+    int fileDescriptor;
+    size_t blockSize;
+    unsigned queueDepth;
+    bool asyncEnabled;
+
+    std::vector<ReadSlot> slots;
+    std::vector<unsigned> freeSlots;
+    unsigned char *bufferPool;
+    unsigned queuedReads;    // prepared but not yet submitted
+    unsigned inFlightReads;  // submitted but not yet completed
+    size_t failedReads;
+
+    // completions of the pread() fallback, their callbacks run from poll()
+    std::vector<std::pair<unsigned, ssize_t>> syncCompletions;
+
+    // io_uring state, see io_uring_setup(2)
+    int ringFd;
+    void *sqRing;
+    void *cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    void *sqEntries;
+    size_t sqEntriesSize;
+    unsigned *sqHead, *sqTail, *sqRingMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqRingMask;
+    void *cqEntries;
+
+    bool setupRing();
+
+    ssize_t readSlot(unsigned slotIdx);
+
+    void submitSync();
+
+    void completeSlot(unsigned slotIdx, ssize_t result);
+
+public:
+    BlockIOEngine(const std::string &path, size_t aBlockSize, unsigned aQueueDepth, bool useIoUring);
+
+    ~BlockIOEngine();
+
+    bool isOpen();
+
+    bool isAsync();
+
+    unsigned getQueueDepth();
+
+    size_t getFailedReads();
+
+    void read(size_t blockIdx, ReadCallback callback);
+
+    void submit();
+
+    size_t poll(bool wait);
+
+    void drain();
+};
+
+#endif
@@ -0,0 +1,131 @@
+#include "bloom_filter.h"
+#include "tree.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <queue>
+
+using namespace std;
+
+BloomFilter::BloomFilter(int aBitsPerKey) {
+    /*
+     * Constructor for an empty filter with about aBitsPerKey bits per key, call build() to fill it from a tree
+     */
+    bitsPerKey = max(1, aBitsPerKey);
+    keysAtBuild = 0;
+    insertsSinceBuild = 0;
+    removalsSinceBuild = 0;
+    resize(0);
+}
+
+uint64_t BloomFilter::hash(int key) {
+    // splitmix64 finalizer, spreads consecutive keys over all bits
+    uint64_t h = (uint64_t) (uint32_t) key + 0x9E3779B97F4A7C15ULL;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    return h ^ (h >> 31);
+}
+
+void BloomFilter::resize(size_t expectedKeys) {
+    /*
+     * Clears the filter and sizes it for expectedKeys keys
+     */
+    size_t numBlocks = max((size_t) 1, (expectedKeys * bitsPerKey + 511) / 512);
+    blocks.assign(numBlocks, Block{});
+}
+
+void BloomFilter::build(Tree *tree) {
+    /*
+     * Rebuilds the filter from every key in the leaves, plus the keys of insert messages still pending in the
+     * buffers of internal nodes (buffered mode). The filter is sized for the current number of keys.
+     */
+    vector<int> keys;
+    queue<Node *> nodes;
+    if (tree->getRoot() != nullptr) {
+        nodes.push(tree->getRoot());
+    }
+    while (!nodes.empty()) {
+        Node *node = nodes.front();
+        nodes.pop();
+        if (node->isLeafNode) {
+            keys.insert(keys.end(), node->keys.begin(), node->keys.end());
+            continue;
+        }
+        for (BufferMessage &message: node->buffer) {
+            if (message.pRecord != nullptr) {
+                keys.push_back(message.key);
+            }
+        }
+        for (Node *child: node->pointer.pNode) {
+            nodes.push(child);
+        }
+    }
+
+    resize(keys.size());
+    for (int key: keys) {
+        add(key);
+    }
+    keysAtBuild = keys.size();
+    insertsSinceBuild = 0;
+    removalsSinceBuild = 0;
+    TRACE_INFO("bloom.build", (int64_t) keysAtBuild);
+}
+
+void BloomFilter::add(int key) {
+    /*
+     * Sets the bits of a key: the upper half of the hash picks the block, the lower bits pick 9-bit positions
+     * within it. Keys whose bits are all set already (duplicates, mostly) do not count towards the next rebuild.
+     */
+    if (mayContain(key)) {
+        return;
+    }
+
+    uint64_t h = hash(key);
+    Block &block = blocks[(size_t) (((h >> 32) * blocks.size()) >> 32)];
+    uint64_t positions = hash((int) h);
+    for (int i = 0; i < HASHES; i++) {
+        unsigned bit = positions & 511;
+        block.words[bit >> 6] |= (uint64_t) 1 << (bit & 63);
+        positions >>= 9;
+    }
+    insertsSinceBuild++;
+}
+
+void BloomFilter::remove(int) {
+    /*
+     * Accounts for a removed key. The filter itself is not changed: a standard Bloom filter cannot clear the bits
+     * of one key without clearing them for others, so the key stays a (false) positive until the next rebuild.
+     * The count only feeds needsRebuild().
+     */
+    removalsSinceBuild++;
+}
+
+bool BloomFilter::mayContain(int key) const {
+    /*
+     * Returns false if the key is definitely not in the tree
+     */
+    uint64_t h = hash(key);
+    const Block &block = blocks[(size_t) (((h >> 32) * blocks.size()) >> 32)];
+    uint64_t positions = hash((int) h);
+    bool present = true;
+    for (int i = 0; i < HASHES; i++) {
+        unsigned bit = positions & 511;
+        present &= (block.words[bit >> 6] >> (bit & 63)) & 1;
+        positions >>= 9;
+    }
+    return present;
+}
+
+bool BloomFilter::needsRebuild() {
+    /*
+     * The filter is rebuilt once the removals since the last build reach a quarter of the keys present at that
+     * time, or once as many keys were inserted as it was sized for (at least 1024 in both cases), which keeps
+     * the amortised rebuild cost constant per change.
+     */
+    size_t limit = max(keysAtBuild, (size_t) 1024);
+    return removalsSinceBuild >= limit / 4 || insertsSinceBuild >= limit;
+}
+
+size_t BloomFilter::getMemoryUsage() {
+    return blocks.size() * sizeof(Block);
+}
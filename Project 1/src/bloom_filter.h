@@ -0,0 +1,53 @@
+#ifndef BLOOM_FILTER_H
+#define BLOOM_FILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Tree;
+
+class BloomFilter {
+    /*
+     * Blocked Bloom filter over the keys of a B+ tree. Every key sets HASHES bits within a single 512-bit block
+     * (one cache line), so a lookup of an absent key costs one cache line probe instead of a walk down the tree.
+     *
+     * Keys are added as they are inserted. Bits cannot be cleared, so removed keys are only dropped when the
+     * filter is rebuilt from the tree; until then they can cause false positives but never false negatives.
+     */
+private:
+    struct alignas(64) Block {
+        uint64_t words[8];
+    };
+
+    static const int HASHES = 7;
+
+    int bitsPerKey;
+    std::vector<Block> blocks;
+
+    // bookkeeping used to decide when the filter is too stale or too full
+    size_t keysAtBuild;
+    size_t insertsSinceBuild;
+    size_t removalsSinceBuild;
+
+    static uint64_t hash(int key);
+
+    void resize(size_t expectedKeys);
+
+public:
+    explicit BloomFilter(int aBitsPerKey);
+
+    void build(Tree *tree);
+
+    void add(int key);
+
+    void remove(int key);
+
+    bool mayContain(int key) const;
+
+    bool needsRebuild();
+
+    size_t getMemoryUsage();
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "cluster.h"
+#include "trace.h"
+
+#include <vector>
+
+using namespace std;
+
+static Node *getFirstLeaf(Tree *tree) {
+    Node *currentNode = tree->getRoot();
+    if (currentNode == nullptr) {
+        return nullptr;
+    }
+    while (!currentNode->isLeafNode) {
+        currentNode = currentNode->pointer.pNode[0];
+    }
+    return currentNode;
+}
+
+void clusterByIndex(Tree *tree, Disk *disk) {
+    /*
+     * CLUSTER: physically reorders the records on disk by the index key.
+     *  1. the leaf chain is walked in key order and every indexed record is copied out
+     *  2. live records that are on disk but not in the index are copied out after them
+     *  3. the disk is cleared and the copies are written back sequentially from block 0
+     *  4. the leaf chain is walked again in the same order and every record pointer is repointed
+     *
+     * Deleted records are dropped, so this also reclaims their slots. Record pointers held outside the tree
+     * are invalidated.
+     */
+    TRACE_SCOPE_INFO("disk.cluster", (int64_t) disk->getBlocksUsed());
+    tree->flushAllBuffers();
+
+    size_t recordsPerBlock = disk->getMaxRecordsPerBlock();
+    vector<bool> indexed(disk->getBlocksUsed() * recordsPerBlock, false);
+    vector<Record> sortedRecords;
+
+    // 1. copy the indexed records out in key order
+    for (Node *leaf = getFirstLeaf(tree); leaf != nullptr; leaf = leaf->pNextLeaf) {
+        for (auto &records: leaf->pointer.pData) {
+            for (Record *record: records) {
+                indexed[disk->getBlockId(record) * recordsPerBlock + disk->getRecordIdx(record)] = true;
+                sortedRecords.push_back(*record);
+            }
+        }
+    }
+    [[maybe_unused]] size_t indexedRecords = sortedRecords.size();  // only traced
+
+    // 2. keep the live records that are not indexed
+    for (size_t blockIdx = 0; blockIdx < disk->getBlocksUsed(); blockIdx++) {
+        for (size_t recordIdx = 0; recordIdx < disk->getRecordsInBlock(blockIdx); recordIdx++) {
+            if (!indexed[blockIdx * recordsPerBlock + recordIdx] && !disk->isDeleted(blockIdx, recordIdx)) {
+                sortedRecords.push_back(*disk->getRecord(blockIdx, recordIdx));
+            }
+        }
+    }
+
+    // 3. write the records back in order
+    disk->clear();
+    vector<Record *> newLocations;
+    newLocations.reserve(sortedRecords.size());
+    for (Record &record: sortedRecords) {
+        newLocations.push_back(disk->insertRecord(record));
+    }
+
+    // 4. repoint the index, visiting the entries in the same order as in step 1
+    size_t next = 0;
+    for (Node *leaf = getFirstLeaf(tree); leaf != nullptr; leaf = leaf->pNextLeaf) {
+        for (auto &records: leaf->pointer.pData) {
+            for (Record *&record: records) {
+                record = newLocations[next++];
+            }
+        }
+    }
+
+    TRACE_INFO("disk.cluster.records", (int64_t) indexedRecords);
+}
+
+double getClusteringRatio(Tree *tree, Disk *disk) {
+    /*
+     * Walks the index in key order and counts how often the next record lies in the same block as the previous
+     * one or in the block right after it. 1.0 means a range scan reads a contiguous run of blocks, values near 0
+     * mean the records are scattered and the table is due for clustering.
+     */
+    tree->flushAllBuffers();
+
+    size_t entries = 0;
+    size_t sequentialSteps = 0;
+    size_t previousBlock = 0;
+
+    for (Node *leaf = getFirstLeaf(tree); leaf != nullptr; leaf = leaf->pNextLeaf) {
+        for (auto &records: leaf->pointer.pData) {
+            for (Record *record: records) {
+                size_t blockIdx = disk->getBlockId(record);
+                if (entries > 0 && (blockIdx == previousBlock || blockIdx == previousBlock + 1)) {
+                    sequentialSteps++;
+                }
+                previousBlock = blockIdx;
+                entries++;
+            }
+        }
+    }
+
+    return entries <= 1 ? 1.0 : (double) sequentialSteps / (entries - 1);
+}
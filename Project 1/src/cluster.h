@@ -0,0 +1,13 @@
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include "disk.h"
+#include "tree.h"
+
+// rewrites the records on disk in index key order and repoints the index at the new locations
+void clusterByIndex(Tree *tree, Disk *disk);
+
+// fraction of consecutive index entries (in key order) that stay in the same block or move to the next one
+double getClusteringRatio(Tree *tree, Disk *disk);
+
+#endif
@@ -1,37 +1,140 @@
 #include "disk.h"
+#include "trace.h"
 
+#include <algorithm>
 #include <iostream>
 #include <cmath>
+#include <cstdio>
 #include <cstring>
+#include <new>
+#include <sys/mman.h>
 
 using namespace std;
 
-Disk::Disk(size_t aDiskSize, size_t aBlockSize) {
+// huge page size assumed when rounding up an extent
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+Disk::Disk(size_t aExtentSize, size_t aBlockSize, PageMode aPageMode) {
     /*
-     * Constructor for a Disk instances
+     * Constructor for a Disk instances, maps the first extent
      */
 
-    // set disk size and block size
-    diskSize = aDiskSize;
+    // set extent size and block size
+    extentSize = aExtentSize;
     blockSize = aBlockSize;
-
-    // allocate memory on the heap
-    pMemAddress = new unsigned char[diskSize]();
+    pageMode = aPageMode;
 
     // calculate maxes
     maxRecordsPerBlock = std::floor(blockSize / sizeof(Record));
-    maxBlocksInDisk = std::floor(diskSize / blockSize);
+    blocksPerExtent = std::max((size_t) 1, extentSize / blockSize);
+
+    // with huge pages, extents are rounded up to a whole number of huge pages
+    mappedSize = blocksPerExtent * blockSize;
+    if (pageMode != PageMode::STANDARD) {
+        mappedSize = (mappedSize + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    }
 
     // initialize indexes to 0
     blockIdx = 0;
     recordIdx = 0;
+
+    if (!addExtent()) {
+        throw std::bad_alloc();
+    }
+
+    TRACE_INFO("disk.init", (int64_t) extentSize);
+}
+
+bool Disk::addExtent() {
+    /*
+     * Maps one more extent at the end of the disk.
+     *
+     * The extent is an anonymous mapping, the kernel hands out zeroed pages on first touch, so only the blocks that
+     * are actually written cost memory. Huge pages make random record accesses need fewer TLB entries.
+     * Returns false if the kernel refuses the mapping.
+     */
+    void *address = MAP_FAILED;
+    if (pageMode == PageMode::HUGETLB) {
+        address = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1,
+                       0);
+        if (address == MAP_FAILED) {
+            // no huge pages reserved (see /proc/sys/vm/nr_hugepages), use transparent huge pages instead
+            TRACE_ERROR("disk.hugetlb.unavailable", (int64_t) mappedSize);
+            pageMode = PageMode::TRANSPARENT_HUGE_PAGES;
+        }
+    }
+    if (address == MAP_FAILED) {
+        address = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (address == MAP_FAILED) {
+            TRACE_ERROR("disk.full", (int64_t) extents.size());
+            return false;
+        }
+        if (pageMode == PageMode::TRANSPARENT_HUGE_PAGES) {
+            madvise(address, mappedSize, MADV_HUGEPAGE);
+        }
+    }
+
+    auto *extent = static_cast<unsigned char *>(address);
+    extentsByAddress.insert(upper_bound(extentsByAddress.begin(), extentsByAddress.end(),
+                                        make_pair(extent, extents.size())),
+                            make_pair(extent, extents.size()));
+    extents.push_back(extent);
+    TRACE_INFO("disk.extent", (int64_t) extents.size());
+    return true;
+}
+
+const char *getPageModeName(PageMode mode) {
+    switch (mode) {
+        case PageMode::STANDARD:
+            return "standard pages";
+        case PageMode::TRANSPARENT_HUGE_PAGES:
+            return "transparent huge pages";
+        case PageMode::HUGETLB:
+            return "hugetlb";
+    }
+    return "unknown";
+}
+
+Disk::~Disk() {
+    for (unsigned char *extent: extents) {
+        munmap(extent, mappedSize);
+    }
+}
+
+void Disk::printInfo() {
+    /*
+     * Prints the disk parameters
+     */
     cout << "Instantiating Disk" << endl;
-    cout << " -> Disk Size: " << aDiskSize << " bytes" << endl;
-    cout << " -> Block Size: " << aBlockSize << " bytes" << endl;
+    cout << " -> Extent Size: " << blocksPerExtent * blockSize << " bytes" << endl;
+    cout << " -> Block Size: " << blockSize << " bytes" << endl;
     cout << " -> Max Records Per Block: " << maxRecordsPerBlock << endl;
-    cout << " -> Max Blocks in Disk: " << maxBlocksInDisk << endl;
+    cout << " -> Blocks per Extent: " << blocksPerExtent << endl;
+    cout << " -> Extents Allocated: " << extents.size() << endl;
+    cout << " -> Page Mode: " << getPageModeName(pageMode) << endl;
     cout << "===========================================" << endl;
+}
+
+Record *Disk::nextSlot() {
+    /*
+     * Returns the memory location pointed by blockIdx and recordIdx and moves them to the next slot.
+     * A new extent is mapped when blockIdx reaches the end of the last one. Returns nullptr if that fails.
+     */
+    if (blockIdx / blocksPerExtent >= extents.size() && !addExtent()) {
+        return nullptr;
+    }
+
+    Record *slot = getRecord(blockIdx, recordIdx);
+
+    // increment recordIdx
+    recordIdx++;
 
+    // if the currentNode block is full after this insertion, move to next block and reset recordIdx to 0
+    if (recordIdx == maxRecordsPerBlock) {
+        blockIdx++;
+        recordIdx = 0;
+    }
+    return slot;
 }
 
 Record *Disk::insertRecord(const std::string &tconst, unsigned char avgRating, int numVotes) {
@@ -40,58 +143,171 @@ Record *Disk::insertRecord(const std::string &tconst, unsigned char avgRating, i
     *
     * Returns:
     * -> If successful, the pointer to the inserted record (useful for building b+ tree) is returned
-    * -> If disk is full, return nullptr.
+    * -> If no memory is left for a new extent, return nullptr.
     */
 
-    // if disk is full, return nullptr
-    if (blockIdx >= maxBlocksInDisk) {
+    // get pointer to the new record
+    Record *newRecord = nextSlot();
+    if (newRecord == nullptr) {
         return nullptr;
     }
 
-    // get pointer to the new record
-    Record *newRecord = getRecord(blockIdx, recordIdx);
-
     // set values into the  new record
-    strncpy(newRecord->tconst, tconst.c_str(), sizeof(newRecord->tconst) - 1);
+    newRecord->tconst = encodeTconst(tconst);
     newRecord->numVotes = numVotes;
     newRecord->averageRating = avgRating;
 
-    // increment recordIdx
-    recordIdx++;
+    // return a pointer to the inserted record
+    return newRecord;
+}
 
-    // if the currentNode block is full after this insertion, move to next block and reset recordIdx to 0
-    if (recordIdx == maxRecordsPerBlock) {
-        blockIdx++;
-        recordIdx = 0;
+Record *Disk::insertRecord(const Record &record) {
+    /*
+     * Inserts a copy of a record of this disk at the next available memory location. The encoded tconst is copied
+     * as is, an escaped one still points into the escape table of this disk.
+     * Returns the pointer to the inserted record, or nullptr if no memory is left for a new extent.
+     */
+    Record *newRecord = nextSlot();
+    if (newRecord != nullptr) {
+        *newRecord = record;
     }
-
-    // return a pointer to the inserted record
     return newRecord;
 }
 
+Record *Disk::insertRecord(const Record &record, Disk &source) {
+    /*
+     * Inserts a copy of a record of the source disk. An escaped tconst is an index into the escape table of the
+     * source, so it is decoded there and encoded again into this disk.
+     */
+    if (&source == this || (record.tconst & TCONST_ESCAPE_BIT) == 0) {
+        return insertRecord(record);
+    }
+    return insertRecord(source.decodeTconst(&record), record.averageRating, record.numVotes);
+}
+
+void Disk::clear() {
+    /*
+     * Empties the disk, the next insertion goes to the first slot of block 0 again.
+     * Pointers to records inserted before become invalid. The extents stay mapped and are reused.
+     */
+    blockIdx = 0;
+    recordIdx = 0;
+    deletedRecords.clear();
+}
 
 Record *Disk::getRecord(size_t aBlockIdx, size_t aRecordIdx) {
     /*
      * Returns a pointer to a record!
      *
-     * The offset consists of two parts:
-     * -> blockIdx x BLOCK_SIZE: offset to the start of a specified block
+     * The offset into the block's extent consists of two parts:
+     * -> (blockIdx mod blocksPerExtent) x BLOCK_SIZE: offset to the start of a specified block
      * -> recordIdx x recordSize: offset to the start of a record in a block
      */
-    size_t offset = (aBlockIdx * blockSize) + (aRecordIdx * sizeof(Record));
-    return reinterpret_cast<Record *>(pMemAddress + offset);
+    size_t offset = (aBlockIdx % blocksPerExtent) * blockSize + aRecordIdx * sizeof(Record);
+    return reinterpret_cast<Record *>(extents[aBlockIdx / blocksPerExtent] + offset);
+}
+
+void Disk::deleteRecord(Record *record) {
+    /*
+     * Marks a record as deleted. The slot is not reused, but sequential scans will skip the record.
+     */
+    size_t slot = getBlockId(record) * maxRecordsPerBlock + getRecordIdx(record);
+    if (slot >= deletedRecords.size()) {
+        deletedRecords.resize(slot + 1, false);
+    }
+    deletedRecords[slot] = true;
+}
+
+bool Disk::isDeleted(size_t aBlockIdx, size_t aRecordIdx) {
+    size_t slot = aBlockIdx * maxRecordsPerBlock + aRecordIdx;
+    return slot < deletedRecords.size() && deletedRecords[slot];
+}
+
+uint32_t Disk::encodeTconst(const std::string &tconst) {
+    /*
+     * Encodes a tconst into 32 bits (see dtypes.h). Ids that are not "tt" followed by 1 to 15 digits with a value
+     * below 2^27 are stored in the escape table, and the returned value holds their index instead.
+     */
+    size_t digits = tconst.size() - 2;
+    bool conforming = tconst.size() > 2 && digits < 16 && tconst[0] == 't' && tconst[1] == 't';
+
+    uint64_t value = 0;
+    for (size_t i = 2; conforming && i < tconst.size(); i++) {
+        if (tconst[i] < '0' || tconst[i] > '9') {
+            conforming = false;
+        }
+        value = value * 10 + (tconst[i] - '0');
+        if (value > TCONST_VALUE_MASK) {
+            conforming = false;
+        }
+    }
+
+    if (conforming) {
+        return ((uint32_t) digits << TCONST_DIGITS_SHIFT) | (uint32_t) value;
+    }
+
+    escapedTconsts.push_back(tconst);
+    return TCONST_ESCAPE_BIT | (uint32_t) (escapedTconsts.size() - 1);
+}
+
+std::string Disk::decodeTconst(const Record *record) {
+    /*
+     * Decodes the tconst of a record back into its original string. An all-zero value (an empty slot) decodes
+     * into an empty string.
+     */
+    uint32_t encoded = record->tconst;
+    if (encoded & TCONST_ESCAPE_BIT) {
+        return escapedTconsts[encoded & ~TCONST_ESCAPE_BIT];
+    }
+
+    int digits = (int) (encoded >> TCONST_DIGITS_SHIFT);
+    if (digits == 0) {
+        return "";
+    }
+
+    char buffer[20];
+    snprintf(buffer, sizeof(buffer), "tt%0*u", digits, encoded & TCONST_VALUE_MASK);
+    return buffer;
 }
 
 void Disk::printRecord(Record *record) {
-    printf("%s / %.1f / %d\n", record->tconst, (float) record->averageRating / 10, record->numVotes);
+    printf("%s / %.1f / %d\n", decodeTconst(record).c_str(), (float) record->averageRating / 10, record->numVotes);
+}
+
+size_t Disk::getBlockOffset(Record *record, size_t *offsetInBlock) {
+    /*
+     * Returns the blockIdx of the block that a record resides in, and stores the record's byte offset within
+     * that block. The extent is found by binary search on the extent start addresses.
+     */
+    auto *address = reinterpret_cast<unsigned char *>(record);
+    auto itr = upper_bound(extentsByAddress.begin(), extentsByAddress.end(), address,
+                           [](unsigned char *value, const pair<unsigned char *, size_t> &extent) {
+                               return value < extent.first;
+                           });
+    --itr;
+
+    size_t offset = address - itr->first;
+    if (offsetInBlock != nullptr) {
+        *offsetInBlock = offset % blockSize;
+    }
+    return itr->second * blocksPerExtent + offset / blockSize;
 }
 
 size_t Disk::getBlockId(Record *record) {
     /*
      * Returns the blockIdx of the block that a record resides in.
-     * Easily calculated with: (offset of the record pointer from the start of disk / blockSize)
+     * Calculated from the record's extent and its offset from the start of that extent / blockSize.
      */
-    return (reinterpret_cast<unsigned char *>(record) - pMemAddress) / blockSize;
+    return getBlockOffset(record, nullptr);
+}
+
+size_t Disk::getRecordIdx(Record *record) {
+    /*
+     * Returns the recordIdx of a record within its block.
+     */
+    size_t offsetInBlock;
+    getBlockOffset(record, &offsetInBlock);
+    return offsetInBlock / sizeof(Record);
 }
 
 void Disk::printBlock(size_t aBlockIdx) {
@@ -102,12 +318,56 @@ void Disk::printBlock(size_t aBlockIdx) {
 
     // print record one by one in the block
     for (int i = 0; i < maxRecordsPerBlock; i++) {
-        cout << getRecord(aBlockIdx, i)->tconst << " ";
+        cout << decodeTconst(getRecord(aBlockIdx, i)) << " ";
     }
     cout << endl;
 }
 
 // misc
 size_t Disk::getBlocksUsed() {
-    return blockIdx + 1;
+    // blockIdx can point just past the last extent if mapping the next one failed
+    return min(blockIdx + 1, extents.size() * blocksPerExtent);
+}
+
+size_t Disk::getRecordsInBlock(size_t aBlockIdx) {
+    /*
+     * Returns the number of records stored in a block. Only the last block in use can be partially filled.
+     */
+    if (aBlockIdx < blockIdx) {
+        return maxRecordsPerBlock;
+    }
+    return aBlockIdx == blockIdx ? recordIdx : 0;
+}
+
+size_t Disk::getMaxRecordsPerBlock() {
+    return maxRecordsPerBlock;
+}
+
+size_t Disk::getBlockSize() {
+    return blockSize;
+}
+
+size_t Disk::getExtentsAllocated() {
+    return extents.size();
+}
+
+PageMode Disk::getPageMode() {
+    return pageMode;
+}
+
+bool Disk::writeToFile(const std::string &path) {
+    /*
+     * Writes the blocks in use to a file, block i at offset i x blockSize, so that they can be read back
+     * block by block (see BlockIOEngine).
+     */
+    FILE *file = fopen(path.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+
+    bool success = true;
+    for (size_t i = 0; i < getBlocksUsed() && success; i++) {
+        success = fwrite(getRecord(i, 0), 1, blockSize, file) == blockSize;
+    }
+    return fclose(file) == 0 && success;
 }
\ No newline at end of file
@@ -3,35 +3,105 @@
 
 #include <cstddef>
 #include <string>
+#include <utility>
+#include <vector>
 #include "dtypes.h"
 
+// how the pages backing the disk area are requested from the kernel
+enum class PageMode {
+    STANDARD,                // regular 4KiB pages
+    TRANSPARENT_HUGE_PAGES,  // regular mapping, advised for transparent huge pages with madvise
+    HUGETLB                  // explicit huge pages (MAP_HUGETLB), falls back to TRANSPARENT_HUGE_PAGES
+};
+
+const char *getPageModeName(PageMode mode);
+
 class Disk {
+    /*
+     * The disk is a list of extents, each holding blocksPerExtent consecutive blocks. An extent is mapped when the
+     * first block in it is needed and existing extents are never moved, so record pointers stay valid as the disk
+     * grows. Block i lives in extent i / blocksPerExtent.
+     */
 private:
     size_t blockSize;
-    size_t diskSize;
+    size_t extentSize;
     size_t blockIdx;
     size_t recordIdx;
-    unsigned char *pMemAddress;
+    size_t mappedSize;  // bytes mapped per extent
+    PageMode pageMode;
 
     size_t maxRecordsPerBlock;
-    size_t maxBlocksInDisk;
+    size_t blocksPerExtent;
+
+    std::vector<unsigned char *> extents;
+
+    // start address of every extent with its index, sorted by address, to find the extent of a record
+    std::vector<std::pair<unsigned char *, size_t>> extentsByAddress;
+
+    // one flag per record slot, set when a record has been deleted
+    std::vector<bool> deletedRecords;
+
+    // tconst values that do not fit the compact encoding, see dtypes.h
+    std::vector<std::string> escapedTconsts;
+
+    bool addExtent();
+
+    Record *nextSlot();
+
+    size_t getBlockOffset(Record *record, size_t *offsetInBlock);
 
 public:
     // constructor
-    Disk(size_t aDiskSize, size_t aBlockSize);
+    Disk(size_t aExtentSize, size_t aBlockSize, PageMode aPageMode = PageMode::STANDARD);
+
+    ~Disk();
+
+    Disk(const Disk &) = delete;
+
+    Disk &operator=(const Disk &) = delete;
 
     // functions
     Record *insertRecord(const std::string &tconst, unsigned char avgRating, int numVotes);
 
+    Record *insertRecord(const Record &record);
+
+    Record *insertRecord(const Record &record, Disk &source);
+
+    void clear();
+
     Record *getRecord(size_t aBlockIdx, size_t aRecordIdx);
 
+    void deleteRecord(Record *record);
+
+    bool isDeleted(size_t aBlockIdx, size_t aRecordIdx);
+
+    void printInfo();
+
+    uint32_t encodeTconst(const std::string &tconst);
+
+    std::string decodeTconst(const Record *record);
+
     void printRecord(Record *record);
 
     size_t getBlockId(Record *record);
 
+    size_t getRecordIdx(Record *record);
+
     void printBlock(size_t aBlockIdx);
 
     size_t getBlocksUsed();
+
+    size_t getRecordsInBlock(size_t aBlockIdx);
+
+    size_t getMaxRecordsPerBlock();
+
+    size_t getBlockSize();
+
+    size_t getExtentsAllocated();
+
+    PageMode getPageMode();
+
+    bool writeToFile(const std::string &path);
 };
 
 #endif
@@ -1,11 +1,25 @@
 #ifndef DTYPES_H
 #define DTYPES_H
 
+#include <cstdint>
 
+/*
+ * Records are packed (9 bytes instead of 16) so that more of them fit in a block.
+ *
+ * tconst is stored encoded: ids of the form "tt" + digits keep the "tt" prefix implicit and store the number of
+ * digits (bits 27-30) next to their value (bits 0-26), so leading zeros survive. Any other id sets the escape bit
+ * (bit 31) and stores an index into the owning Disk's table of raw ids instead. Use Disk::decodeTconst to read it.
+ */
+#pragma pack(push, 1)
 struct Record {
-    char tconst[11];
+    uint32_t tconst;
     unsigned char averageRating;
     int numVotes;
 };
+#pragma pack(pop)
+
+const uint32_t TCONST_ESCAPE_BIT = 1u << 31;
+const int TCONST_DIGITS_SHIFT = 27;
+const uint32_t TCONST_VALUE_MASK = (1u << TCONST_DIGITS_SHIFT) - 1;
 
 #endif
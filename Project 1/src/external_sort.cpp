@@ -0,0 +1,382 @@
+#include "external_sort.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+bool recordLess(const Record &a, const Record &b) {
+    return a.numVotes < b.numVotes || (a.numVotes == b.numVotes && a.tconst < b.tconst);
+}
+
+bool RunMerger::RunReader::refill() {
+    /*
+     * Reads the next chunk of the run into the buffer, returns false at the end of the run
+     */
+    size_t bytes = 0, wanted = buffer.size() * sizeof(Record);
+    auto *data = reinterpret_cast<unsigned char *>(buffer.data());
+    while (bytes < wanted) {
+        ssize_t bytesRead = read(fd, data + bytes, wanted - bytes);
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead < 0) {
+            TRACE_ERROR("sort.run.read", errno);
+            failed = true;
+        }
+        if (bytesRead <= 0) {
+            break;
+        }
+        bytes += bytesRead;
+    }
+    pos = 0;
+    count = bytes / sizeof(Record);
+    return count > 0;
+}
+
+RunMerger::RunMerger(const vector<string> &paths, size_t bufferRecords) {
+    /*
+     * Opens the runs with a read buffer of bufferRecords records each and plays the initial tournament
+     */
+    numRuns = (int) paths.size();
+    failed = false;
+    for (const string &path: paths) {
+        auto reader = make_unique<RunReader>();
+        reader->fd = open(path.c_str(), O_RDONLY);
+        reader->buffer.resize(max((size_t) 1, bufferRecords));
+        if (reader->fd >= 0) {
+            posix_fadvise(reader->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            reader->refill();
+        } else {
+            TRACE_ERROR("sort.run.open", errno);
+            reader->failed = true;
+        }
+        failed = failed || reader->failed;
+        readers.push_back(std::move(reader));
+    }
+
+    tree.assign(max(1, numRuns), -1);
+    if (numRuns > 0) {
+        tree[0] = numRuns == 1 ? 0 : build(1);
+    }
+}
+
+RunMerger::~RunMerger() {
+    for (auto &reader: readers) {
+        if (reader->fd >= 0) {
+            close(reader->fd);
+        }
+    }
+}
+
+bool RunMerger::beats(int a, int b) {
+    // an exhausted run loses against everything, equal records go to the lower run
+    bool aValid = a >= 0 && readers[a]->pos < readers[a]->count;
+    bool bValid = b >= 0 && readers[b]->pos < readers[b]->count;
+    if (!aValid || !bValid) {
+        return aValid;
+    }
+    const Record &recordA = readers[a]->buffer[readers[a]->pos];
+    const Record &recordB = readers[b]->buffer[readers[b]->pos];
+    return recordLess(recordA, recordB) || (!recordLess(recordB, recordA) && a < b);
+}
+
+int RunMerger::build(int node) {
+    /*
+     * Plays the matches below node (leaves are numRuns .. 2 numRuns - 1), stores the losers and returns the winner
+     */
+    if (node >= numRuns) {
+        return node - numRuns;
+    }
+    int left = build(2 * node);
+    int right = build(2 * node + 1);
+    if (beats(left, right)) {
+        tree[node] = right;
+        return left;
+    }
+    tree[node] = left;
+    return right;
+}
+
+bool RunMerger::next(Record &record) {
+    /*
+     * Takes the smallest record of all runs, returns false when every run is exhausted or one of them failed
+     */
+    if (numRuns == 0 || failed) {
+        return false;
+    }
+    int winner = tree[0];
+    RunReader &reader = *readers[winner];
+    if (reader.pos >= reader.count) {
+        return false;
+    }
+    record = reader.buffer[reader.pos++];
+    if (reader.pos == reader.count && !reader.refill() && reader.failed) {
+        // the record taken above is still valid, the merge stops at the next call
+        failed = true;
+    }
+
+    // replay the matches from the winner's leaf up to the root
+    for (int node = (winner + numRuns) / 2; node > 0; node /= 2) {
+        if (beats(tree[node], winner)) {
+            swap(tree[node], winner);
+        }
+    }
+    tree[0] = winner;
+    return true;
+}
+
+bool RunMerger::isFailed() {
+    return failed;
+}
+
+ExternalSorter::ExternalSorter(const string &aRunPrefix, size_t aMemoryBudget, int aNumThreads, size_t aChunkSize) {
+    /*
+     * Constructor for an empty sorter. Run files are named aRunPrefix followed by a number.
+     */
+    runPrefix = aRunPrefix;
+    memoryBudget = max(aMemoryBudget, 2 * MIN_RUN_BUFFER);
+    numThreads = max(1, aNumThreads);
+    chunkSize = max(sizeof(Record), aChunkSize);
+
+    bufferCapacity = max((size_t) 1, memoryBudget / numThreads / sizeof(Record));
+    buffers.resize(numThreads);
+    buffers[0].reserve(bufferCapacity);
+    pendingRuns.resize(numThreads);
+    currentBuffer = 0;
+
+    runsWritten = 0;
+    mergePasses = 0;
+    bytesSpilled = 0;
+    failed = false;
+    inMemory = false;
+    inMemoryPos = 0;
+}
+
+ExternalSorter::~ExternalSorter() {
+    for (future<bool> &pending: pendingRuns) {
+        if (pending.valid()) {
+            pending.wait();
+        }
+    }
+    merger.reset();
+    for (const string &path: runPaths) {
+        remove(path.c_str());
+    }
+}
+
+string ExternalSorter::newRunPath() {
+    string path = runPrefix + to_string(runsWritten++) + ".run";
+    runPaths.push_back(path);
+    return path;
+}
+
+static bool writeChunks(int fd, const vector<Record> &records, size_t chunkSize) {
+    /*
+     * Appends the records to the file, chunkSize bytes per write
+     */
+    auto *data = reinterpret_cast<const unsigned char *>(records.data());
+    size_t total = records.size() * sizeof(Record);
+    for (size_t offset = 0; offset < total;) {
+        ssize_t written = write(fd, data + offset, min(chunkSize, total - offset));
+        if (written <= 0) {
+            TRACE_ERROR("sort.run.write", (int64_t) offset);
+            return false;
+        }
+        offset += written;
+    }
+    return true;
+}
+
+bool ExternalSorter::writeRun(vector<Record> &records, const string &path, size_t chunkSize) {
+    /*
+     * Sorts the records and writes them out as a run file, returns false if the file could not be written
+     */
+    sort(records.begin(), records.end(), recordLess);
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    bool written = fd >= 0 && writeChunks(fd, records, chunkSize);
+    if (fd < 0) {
+        TRACE_ERROR("sort.run.open", errno);
+    } else if (close(fd) != 0) {
+        TRACE_ERROR("sort.run.close", errno);
+        written = false;
+    }
+    records.clear();
+    return written;
+}
+
+void ExternalSorter::spill(int bufferIdx) {
+    /*
+     * Turns a full buffer into a run, in the background if there are several buffers
+     */
+    string path = newRunPath();
+    bytesSpilled += buffers[bufferIdx].size() * sizeof(Record);
+    TRACE_DEBUG("sort.spill", (int64_t) buffers[bufferIdx].size());
+
+    if (numThreads == 1) {
+        failed = !writeRun(buffers[bufferIdx], path, chunkSize) || failed;
+        return;
+    }
+    pendingRuns[bufferIdx] = async(launch::async, [this, bufferIdx, path]() {
+        return writeRun(buffers[bufferIdx], path, chunkSize);
+    });
+}
+
+void ExternalSorter::waitRun(int bufferIdx) {
+    /*
+     * Waits for the background spill of a buffer, if there is one
+     */
+    if (pendingRuns[bufferIdx].valid()) {
+        failed = !pendingRuns[bufferIdx].get() || failed;
+    }
+}
+
+void ExternalSorter::add(const Record &record) {
+    if (failed) {
+        return;
+    }
+    vector<Record> &buffer = buffers[currentBuffer];
+    buffer.push_back(record);
+    if (buffer.size() < bufferCapacity) {
+        return;
+    }
+
+    // hand the full buffer off and continue in the next one, once its previous run is written
+    spill(currentBuffer);
+    currentBuffer = (currentBuffer + 1) % numThreads;
+    waitRun(currentBuffer);
+    buffers[currentBuffer].reserve(bufferCapacity);
+}
+
+bool ExternalSorter::mergeRuns(const vector<string> &inputs, size_t maxFanIn) {
+    /*
+     * Merges the runs into a new run and removes them. The budget is split into maxFanIn + 1 shares, one read
+     * buffer per run plus the output buffer. Returns false if a run could not be read or the new one written.
+     */
+    size_t shareRecords = max((size_t) 1, min(chunkSize, memoryBudget / (maxFanIn + 1)) / sizeof(Record));
+    string path = newRunPath();
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        TRACE_ERROR("sort.run.open", errno);
+        return false;
+    }
+
+    RunMerger passMerger(inputs, shareRecords);
+    vector<Record> output;
+    output.reserve(shareRecords);
+    Record record{};
+    bool written = true;
+    while (written && passMerger.next(record)) {
+        output.push_back(record);
+        if (output.size() == shareRecords) {
+            written = writeChunks(fd, output, chunkSize);
+            output.clear();
+        }
+    }
+    written = written && writeChunks(fd, output, chunkSize) && !passMerger.isFailed();
+    if (close(fd) != 0) {
+        TRACE_ERROR("sort.run.close", errno);
+        written = false;
+    }
+    for (const string &input: inputs) {
+        remove(input.c_str());
+    }
+    return written;
+}
+
+bool ExternalSorter::finish() {
+    /*
+     * Ends the input and prepares the sorted output. Returns false if a run file failed, there is no output then.
+     */
+    if (runPaths.empty() && !failed) {
+        // everything fit in memory
+        sort(buffers[currentBuffer].begin(), buffers[currentBuffer].end(), recordLess);
+        inMemory = true;
+        inMemoryPos = 0;
+        return true;
+    }
+
+    if (!buffers[currentBuffer].empty() && !failed) {
+        string path = newRunPath();
+        bytesSpilled += buffers[currentBuffer].size() * sizeof(Record);
+        failed = !writeRun(buffers[currentBuffer], path, chunkSize);
+    }
+    for (int bufferIdx = 0; bufferIdx < numThreads; bufferIdx++) {
+        waitRun(bufferIdx);
+    }
+    for (vector<Record> &buffer: buffers) {
+        vector<Record>().swap(buffer);
+    }
+
+    // merge passes over groups of runs until they all fit in one merge
+    size_t maxFanIn = max((size_t) 2, memoryBudget / MIN_RUN_BUFFER - 1);
+    while (runPaths.size() > maxFanIn && !failed) {
+        mergePasses++;
+        vector<string> passInputs;
+        passInputs.swap(runPaths);
+        for (size_t first = 0; first < passInputs.size(); first += maxFanIn) {
+            vector<string> inputs(passInputs.begin() + first,
+                                  passInputs.begin() + min(first + maxFanIn, passInputs.size()));
+            if (inputs.size() == 1 || failed) {
+                // kept as they are, or left for the destructor to remove once the sort has failed
+                runPaths.insert(runPaths.end(), inputs.begin(), inputs.end());
+            } else {
+                failed = !mergeRuns(inputs, maxFanIn);
+            }
+        }
+    }
+    if (failed) {
+        TRACE_ERROR("sort.failed", (int64_t) runPaths.size());
+        return false;
+    }
+
+    mergePasses++;
+    size_t shareRecords = min(chunkSize, memoryBudget / runPaths.size()) / sizeof(Record);
+    merger = make_unique<RunMerger>(runPaths, shareRecords);
+    failed = merger->isFailed();
+    TRACE_INFO("sort.merge", (int64_t) runPaths.size());
+    return !failed;
+}
+
+bool ExternalSorter::next(Record &record) {
+    /*
+     * Returns the next record in sorted order, or false when all have been returned or a run failed to read
+     */
+    if (inMemory) {
+        vector<Record> &buffer = buffers[currentBuffer];
+        if (inMemoryPos == buffer.size()) {
+            return false;
+        }
+        record = buffer[inMemoryPos++];
+        return true;
+    }
+    if (failed || merger == nullptr) {
+        return false;
+    }
+    if (merger->next(record)) {
+        return true;
+    }
+    failed = merger->isFailed();
+    return false;
+}
+
+bool ExternalSorter::isFailed() {
+    return failed;
+}
+
+size_t ExternalSorter::getRunsWritten() {
+    return runsWritten;
+}
+
+size_t ExternalSorter::getMergePasses() {
+    return mergePasses;
+}
+
+size_t ExternalSorter::getBytesSpilled() {
+    return bytesSpilled;
+}
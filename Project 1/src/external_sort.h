@@ -0,0 +1,129 @@
+#ifndef EXTERNAL_SORT_H
+#define EXTERNAL_SORT_H
+
+#include <cstddef>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include "dtypes.h"
+
+// numVotes order, ties broken on the encoded tconst so the output is deterministic
+bool recordLess(const Record &a, const Record &b);
+
+class RunMerger {
+    /*
+     * k-way merge of sorted run files with a loser tree. tree[0] holds the run with the smallest current record,
+     * tree[1 .. k - 1] the loser of the match played at that node. Each step replays the matches on the path of
+     * the winner's run only, which takes log2(k) comparisons.
+     */
+private:
+    struct RunReader {
+        int fd;
+        std::vector<Record> buffer;
+        size_t pos = 0;
+        size_t count = 0;
+        bool failed = false;  // the run could not be opened or read
+
+        bool refill();
+    };
+
+    std::vector<std::unique_ptr<RunReader>> readers;
+    std::vector<int> tree;
+    int numRuns;
+    bool failed;
+
+    bool beats(int a, int b);
+
+    int build(int node);
+
+public:
+    RunMerger(const std::vector<std::string> &paths, size_t bufferRecords);
+
+    ~RunMerger();
+
+    RunMerger(const RunMerger &) = delete;
+
+    RunMerger &operator=(const RunMerger &) = delete;
+
+    bool next(Record &record);
+
+    bool isFailed();
+};
+
+class ExternalSorter {
+    /*
+     * Sorts a stream of Records by numVotes within a fixed memory budget.
+     *
+     * add() collects records in memory; whenever the budget is used up the records are sorted and written out as
+     * a run file. With several threads the budget is split into one buffer per thread, and a full buffer is
+     * sorted and written in the background while the next one fills. finish() merges the runs (in several
+     * passes if there are too many to give each one a reasonable read buffer), and next() streams the final
+     * merge in sorted order. If everything fits in the budget, nothing is written at all.
+     *
+     * Runs are read and written in chunks of up to chunkSize bytes. The run files are removed by the destructor.
+     *
+     * If a run file cannot be opened, written or read back, the sort is failed: later records are dropped,
+     * finish() returns false and next() returns no records, so a truncated run never looks like a complete sort.
+     */
+private:
+    std::string runPrefix;
+    size_t memoryBudget;
+    size_t chunkSize;
+    int numThreads;
+
+    std::vector<std::vector<Record>> buffers;
+    std::vector<std::future<bool>> pendingRuns;  // background spills, one per buffer
+    size_t bufferCapacity;                       // records per buffer
+    int currentBuffer;
+
+    std::vector<std::string> runPaths;
+    size_t runsWritten;
+    size_t mergePasses;  // including the final merge
+    size_t bytesSpilled;
+    bool failed;
+
+    // output: either the single in-memory buffer, or the final merge
+    bool inMemory;
+    size_t inMemoryPos;
+    std::unique_ptr<RunMerger> merger;
+
+    std::string newRunPath();
+
+    void spill(int bufferIdx);
+
+    void waitRun(int bufferIdx);
+
+    bool mergeRuns(const std::vector<std::string> &inputs, size_t maxFanIn);
+
+    static bool writeRun(std::vector<Record> &records, const std::string &path, size_t chunkSize);
+
+public:
+    // runs of at least this many bytes are read at a time during merges
+    static const size_t MIN_RUN_BUFFER = 16 * 1024;
+
+    ExternalSorter(const std::string &aRunPrefix, size_t aMemoryBudget, int aNumThreads = 1,
+                   size_t aChunkSize = 1024 * 1024);
+
+    ~ExternalSorter();
+
+    ExternalSorter(const ExternalSorter &) = delete;
+
+    ExternalSorter &operator=(const ExternalSorter &) = delete;
+
+    void add(const Record &record);
+
+    bool finish();
+
+    bool next(Record &record);
+
+    bool isFailed();
+
+    size_t getRunsWritten();
+
+    size_t getMergePasses();
+
+    size_t getBytesSpilled();
+};
+
+#endif
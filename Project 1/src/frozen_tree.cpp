@@ -0,0 +1,167 @@
+#include "frozen_tree.h"
+#include "tree.h"
+#include "trace.h"
+
+#include <algorithm>
+
+using namespace std;
+
+FrozenTree::FrozenTree() {
+    numKeys = 0;
+    numLeaves = 0;
+    separators.resize(1);
+    ranks.resize(1);
+    offsets.push_back(0);
+}
+
+FrozenTree::FrozenTree(const vector<int> &keys, const vector<vector<Record *>> &postings) : FrozenTree() {
+    /*
+     * Packs the sorted distinct keys and their records into leaves, and lays out the separators of the leaves
+     * in Eytzinger order
+     */
+    numKeys = keys.size();
+    numLeaves = (keys.size() + LEAF_KEYS - 1) / LEAF_KEYS;
+    leafKeys.assign(numLeaves * LEAF_KEYS, INT32_MAX);
+    offsets.assign(numLeaves * LEAF_KEYS + 1, 0);
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        leafKeys[i] = keys[i];
+        records.insert(records.end(), postings[i].begin(), postings[i].end());
+        offsets[i + 1] = (uint32_t) records.size();
+    }
+    // padding slots hold no records
+    for (size_t i = keys.size(); i < leafKeys.size(); i++) {
+        offsets[i + 1] = (uint32_t) records.size();
+    }
+
+    // separator j is the first key of leaf j + 1
+    vector<int> sorted;
+    for (size_t leaf = 1; leaf < numLeaves; leaf++) {
+        sorted.push_back(leafKeys[leaf * LEAF_KEYS]);
+    }
+    separators.resize(sorted.size() + 1);
+    ranks.resize(sorted.size() + 1);
+    size_t next = 0;
+    fillSeparators(sorted, next, 1);
+}
+
+void FrozenTree::fillSeparators(const vector<int> &sorted, size_t &next, size_t k) {
+    /*
+     * In-order walk of the implicit tree, which visits the Eytzinger positions in sorted order
+     */
+    if (k < separators.size()) {
+        fillSeparators(sorted, next, 2 * k);
+        ranks[k] = (uint32_t) next;
+        separators[k] = sorted[next++];
+        fillSeparators(sorted, next, 2 * k + 1);
+    }
+}
+
+size_t FrozenTree::findLeaf(int key) const {
+    /*
+     * Returns the number of separators <= key, which is the index of the leaf that can hold key
+     */
+    size_t n = separators.size() - 1;
+    const int *base = separators.data();
+    size_t k = 1;
+    while (k <= n) {
+        // the 16 descendants 4 levels down share a cache line, fetch it while the comparisons run
+        __builtin_prefetch(base + 16 * k);
+        k = 2 * k + (base[k] <= key);
+    }
+
+    // undo the right turns taken after the last left turn, k is then the first separator > key (0 if none)
+    k >>= __builtin_ffsll((long long) ~k);
+    return k == 0 ? n : ranks[k];
+}
+
+size_t FrozenTree::findSlot(int key) const {
+    /*
+     * Returns the position of the first key >= key within the packed leaves, counted without branches
+     */
+    size_t leaf = findLeaf(key);
+    const int *leafBase = leafKeys.data() + leaf * LEAF_KEYS;
+    size_t position = 0;
+    for (int i = 0; i < LEAF_KEYS; i++) {
+        position += leafBase[i] < key;
+    }
+    return leaf * LEAF_KEYS + position;
+}
+
+RecordRange FrozenTree::search(int key) const {
+    /*
+     * Returns the records of a key, or an empty range if the key is not in the snapshot
+     */
+    RecordRange result = {records.data(), records.data()};
+    if (numLeaves == 0) {
+        return result;
+    }
+
+    size_t slot = findSlot(key);
+    if (slot < leafKeys.size() && leafKeys[slot] == key) {
+        result.first = records.data() + offsets[slot];
+        result.last = records.data() + offsets[slot + 1];
+    }
+    return result;
+}
+
+vector<Record *> FrozenTree::searchRange(int lowerKey, int upperKey) const {
+    /*
+     * Returns the records with lowerKey <= key <= upperKey, in key order. The packed leaves are contiguous, so
+     * the range is a single slice of the records array.
+     */
+    if (numLeaves == 0 || upperKey < lowerKey) {
+        return {};
+    }
+
+    size_t first = findSlot(lowerKey);
+    size_t last = first;
+    while (last < leafKeys.size() && leafKeys[last] <= upperKey) {
+        last++;
+    }
+    return {records.begin() + offsets[first], records.begin() + offsets[last]};
+}
+
+size_t FrozenTree::getNumKeys() const {
+    return numKeys;
+}
+
+size_t FrozenTree::getNumLeaves() const {
+    return numLeaves;
+}
+
+size_t FrozenTree::getMemoryUsage() const {
+    /*
+     * Returns the bytes used by the separators, leaves and record arrays of the snapshot
+     */
+    return separators.size() * sizeof(int) + ranks.size() * sizeof(uint32_t) + leafKeys.size() * sizeof(int) +
+           offsets.size() * sizeof(uint32_t) + records.size() * sizeof(Record *);
+}
+
+FrozenTree Tree::freeze() {
+    /*
+     * Returns an immutable snapshot of the tree for read-only lookups, after applying any buffered messages.
+     * The snapshot does not follow later changes to the tree.
+     */
+    flushAllBuffers();
+
+    // find the leftmost leaf node
+    Node *leaf = rootNode;
+    while (leaf != nullptr && !leaf->isLeafNode) {
+        leaf = leaf->pointer.pNode[0];
+    }
+
+    vector<int> keys;
+    vector<vector<Record *>> postings;
+    for (; leaf != nullptr; leaf = leaf->pNextLeaf) {
+        for (size_t i = 0; i < leaf->keys.size(); i++) {
+            // tombstones (keys without records) are left out
+            if (!leaf->pointer.pData[i].empty()) {
+                keys.push_back(leaf->keys[i]);
+                postings.push_back(leaf->pointer.pData[i]);
+            }
+        }
+    }
+    TRACE_INFO("tree.freeze", (int64_t) keys.size());
+    return FrozenTree(keys, postings);
+}
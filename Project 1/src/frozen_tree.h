@@ -0,0 +1,67 @@
+#ifndef FROZEN_TREE_H
+#define FROZEN_TREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "dtypes.h"
+
+// the records of one key in a FrozenTree, valid as long as the snapshot
+struct RecordRange {
+    Record *const *first;
+    Record *const *last;
+
+    size_t size() const {
+        return last - first;
+    }
+
+    bool empty() const {
+        return first == last;
+    }
+};
+
+class FrozenTree {
+    /*
+     * Immutable snapshot of a B+ tree, created with Tree::freeze().
+     *
+     * The keys are packed into leaves of LEAF_KEYS keys (one cache line each) in a single array, padded with
+     * INT32_MAX, and the records of all keys are stored back to back in a single array. The first key of every leaf
+     * but the first is a separator. The separators are stored in one array in Eytzinger (breadth-first) order, so
+     * the children of entry k are at 2k and 2k + 1 and a lookup is a branch-free descent that prefetches the
+     * entries a few levels ahead.
+     */
+public:
+    static const int LEAF_KEYS = 16;
+
+private:
+    std::vector<int> separators;       // Eytzinger order, 1-based (entry 0 is unused)
+    std::vector<uint32_t> ranks;       // ranks[k]: position of separators[k] in sorted order
+    std::vector<int> leafKeys;         // numLeaves x LEAF_KEYS keys
+    std::vector<uint32_t> offsets;     // records of leafKeys[i] are records[offsets[i]] to records[offsets[i + 1]]
+    std::vector<Record *> records;
+    size_t numKeys;                    // distinct keys, without the padding of the last leaf
+    size_t numLeaves;
+
+    void fillSeparators(const std::vector<int> &sorted, size_t &next, size_t k);
+
+    size_t findLeaf(int key) const;
+
+    size_t findSlot(int key) const;
+
+public:
+    FrozenTree();
+
+    FrozenTree(const std::vector<int> &keys, const std::vector<std::vector<Record *>> &postings);
+
+    RecordRange search(int key) const;
+
+    std::vector<Record *> searchRange(int lowerKey, int upperKey) const;
+
+    size_t getNumKeys() const;
+
+    size_t getNumLeaves() const;
+
+    size_t getMemoryUsage() const;
+};
+
+#endif
@@ -0,0 +1,179 @@
+#include "histogram.h"
+#include "tree.h"
+
+#include <algorithm>
+
+using namespace std;
+
+Histogram::Histogram(int aNumBuckets) {
+    /*
+     * Constructor for an empty histogram, call build() to fill it from a tree
+     */
+    numBuckets = aNumBuckets;
+    minKey = 0;
+    totalRecords = 0;
+    distinctKeys = 0;
+    recordsAtBuild = 0;
+    modificationsSinceBuild = 0;
+}
+
+void Histogram::build(Tree *tree) {
+    /*
+     * Rebuilds the buckets from the leaf chain of the tree: one pass to count the records, and a second pass
+     * that closes a bucket once it holds at least totalRecords / numBuckets records.
+     */
+    upperKeys.clear();
+    counts.clear();
+    totalRecords = 0;
+    distinctKeys = 0;
+    modificationsSinceBuild = 0;
+
+    // find the leftmost leaf node
+    Node *firstLeaf = tree->getRoot();
+    if (firstLeaf == nullptr) {
+        recordsAtBuild = 0;
+        return;
+    }
+    while (!firstLeaf->isLeafNode) {
+        firstLeaf = firstLeaf->pointer.pNode[0];
+    }
+
+    // first pass: count records and distinct keys, skipping tombstones (keys without records)
+    minKey = 0;
+    int maxKey = 0;
+    for (Node *leaf = firstLeaf; leaf != nullptr; leaf = leaf->pNextLeaf) {
+        for (int i = 0; i < leaf->keys.size(); i++) {
+            if (leaf->pointer.pData[i].empty()) {
+                continue;
+            }
+            if (distinctKeys == 0) {
+                minKey = leaf->keys[i];
+            }
+            maxKey = leaf->keys[i];
+            totalRecords += leaf->pointer.pData[i].size();
+            distinctKeys++;
+        }
+    }
+    recordsAtBuild = totalRecords;
+
+    // second pass: cut the buckets at key boundaries
+    size_t depth = max((size_t) 1, (totalRecords + numBuckets - 1) / numBuckets);
+    size_t bucketCount = 0;
+    for (Node *leaf = firstLeaf; leaf != nullptr; leaf = leaf->pNextLeaf) {
+        for (int i = 0; i < leaf->keys.size(); i++) {
+            bucketCount += leaf->pointer.pData[i].size();
+            if (bucketCount >= depth) {
+                upperKeys.push_back(leaf->keys[i]);
+                counts.push_back(bucketCount);
+                bucketCount = 0;
+            }
+        }
+    }
+
+    // close the last, partially filled bucket
+    if (bucketCount > 0) {
+        upperKeys.push_back(maxKey);
+        counts.push_back(bucketCount);
+    }
+}
+
+void Histogram::add(int key, size_t count, bool newKey) {
+    /*
+     * Accounts for count records inserted with the given key, newKey if the key had no records before. Keys
+     * outside the current bounds widen the first or last bucket.
+     */
+    totalRecords += count;
+    modificationsSinceBuild += count;
+    if (newKey) {
+        distinctKeys++;
+    }
+
+    if (upperKeys.empty()) {
+        minKey = key;
+        upperKeys.push_back(key);
+        counts.push_back(count);
+        return;
+    }
+
+    if (key < minKey) {
+        minKey = key;
+    }
+
+    auto bucket = lower_bound(upperKeys.begin(), upperKeys.end(), key) - upperKeys.begin();
+    if (bucket == upperKeys.size()) {
+        bucket--;
+        upperKeys[bucket] = key;
+    }
+    counts[bucket] += count;
+}
+
+void Histogram::remove(int key, size_t count, bool keyRemoved) {
+    /*
+     * Accounts for count records removed with the given key, keyRemoved if they were the last ones under it.
+     */
+    if (upperKeys.empty()) {
+        return;
+    }
+    if (keyRemoved && distinctKeys > 0) {
+        distinctKeys--;
+    }
+
+    auto bucket = lower_bound(upperKeys.begin(), upperKeys.end(), key) - upperKeys.begin();
+    if (bucket == upperKeys.size()) {
+        return;
+    }
+
+    count = min(count, counts[bucket]);
+    counts[bucket] -= count;
+    totalRecords -= count;
+    modificationsSinceBuild += count;
+}
+
+bool Histogram::needsRebuild() {
+    /*
+     * The buckets are rebuilt once the number of records changed since the last build reaches a quarter of the
+     * records present at that time (at least 1024), which keeps the amortised rebuild cost constant per change.
+     */
+    return modificationsSinceBuild >= max(recordsAtBuild / 4, (size_t) 1024);
+}
+
+double Histogram::estimateRange(int lowerKey, int upperKey) {
+    /*
+     * Estimates the number of records with lowerKey <= key <= upperKey, assuming the keys are spread
+     * uniformly within each bucket.
+     */
+    if (upperKeys.empty() || lowerKey > upperKey) {
+        return 0;
+    }
+
+    double estimate = 0;
+    long long bucketLow = (long long) minKey - 1;  // exclusive lower bound of the current bucket
+    for (int i = 0; i < upperKeys.size(); i++) {
+        long long bucketHigh = upperKeys[i];
+
+        // overlap of (bucketLow, bucketHigh] with [lowerKey, upperKey]
+        long long overlapLow = max(bucketLow, (long long) lowerKey - 1);
+        long long overlapHigh = min(bucketHigh, (long long) upperKey);
+        if (overlapHigh > overlapLow) {
+            estimate += (double) counts[i] * (overlapHigh - overlapLow) / (bucketHigh - bucketLow);
+        }
+
+        if (bucketHigh >= upperKey) {
+            break;
+        }
+        bucketLow = bucketHigh;
+    }
+    return estimate;
+}
+
+size_t Histogram::getTotalRecords() {
+    return totalRecords;
+}
+
+size_t Histogram::getDistinctKeys() {
+    return distinctKeys;
+}
+
+int Histogram::getNumBuckets() {
+    return numBuckets;
+}
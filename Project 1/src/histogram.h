@@ -0,0 +1,47 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstddef>
+#include <vector>
+
+class Tree;
+
+class Histogram {
+    /*
+     * Equi-depth histogram over the keys of a B+ tree. Bucket i covers the keys (upperKeys[i-1], upperKeys[i]]
+     * and holds counts[i] records. Buckets are cut at key boundaries, so a single very frequent key can end up
+     * in a bucket of its own.
+     */
+private:
+    int numBuckets;
+    int minKey;
+    std::vector<int> upperKeys;
+    std::vector<size_t> counts;
+    size_t totalRecords;
+    size_t distinctKeys;
+
+    // bookkeeping used to decide when the buckets have drifted too far from equal depth
+    size_t recordsAtBuild;
+    size_t modificationsSinceBuild;
+
+public:
+    explicit Histogram(int aNumBuckets);
+
+    void build(Tree *tree);
+
+    void add(int key, size_t count, bool newKey);
+
+    void remove(int key, size_t count, bool keyRemoved);
+
+    bool needsRebuild();
+
+    double estimateRange(int lowerKey, int upperKey);
+
+    size_t getTotalRecords();
+
+    size_t getDistinctKeys();
+
+    int getNumBuckets();
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "index.h"
+#include "tree.h"
+
+#include <algorithm>
+
+using namespace std;
+
+TreeIndex::TreeIndex(Tree *aTree) {
+    tree = aTree;
+}
+
+const char *TreeIndex::getName() {
+    return "B+ tree";
+}
+
+void TreeIndex::insert(int key, Record *pRecord) {
+    tree->insert(key, pRecord);
+}
+
+vector<Record *> *TreeIndex::search(int key) {
+    return tree->search(key, false);
+}
+
+size_t TreeIndex::scanRange(int lowerKey, int upperKey, const IndexVisitor &visit) {
+    /*
+     * Walks the leaf chain from the leaf of lowerKey up to upperKey
+     */
+    tree->flushAllBuffers();
+    Node *currentNode = tree->searchNode(lowerKey, false);
+    if (currentNode == nullptr) {
+        return 0;
+    }
+    auto idx = lower_bound(currentNode->keys.begin(), currentNode->keys.end(), lowerKey) - currentNode->keys.begin();
+
+    size_t visited = 0;
+    for (; currentNode != nullptr; currentNode = currentNode->pNextLeaf, idx = 0) {
+        for (auto i = idx; i < currentNode->keys.size(); i++) {
+            if (currentNode->keys[i] > upperKey) {
+                return visited;
+            }
+            if (currentNode->pointer.pData[i].empty()) {
+                continue;
+            }
+            visit(currentNode->keys[i], currentNode->pointer.pData[i]);
+            visited++;
+        }
+    }
+    return visited;
+}
+
+void TreeIndex::removeKey(int key) {
+    tree->removeKey(key);
+}
+
+size_t TreeIndex::getMemoryUsage() {
+    /*
+     * Sums the nodes with the capacity of their vectors
+     */
+    size_t bytes = 0;
+    vector<Node *> nodes;
+    if (tree->getRoot() != nullptr) {
+        nodes.push_back(tree->getRoot());
+    }
+    while (!nodes.empty()) {
+        Node *node = nodes.back();
+        nodes.pop_back();
+        bytes += sizeof(Node) + node->keys.capacity() * sizeof(int);
+        if (node->isLeafNode) {
+            bytes += node->pointer.pData.capacity() * sizeof(vector<Record *>);
+            for (vector<Record *> &records: node->pointer.pData) {
+                bytes += records.capacity() * sizeof(Record *);
+            }
+        } else {
+            bytes += node->pointer.pNode.capacity() * sizeof(Node *) +
+                     node->childAggregates.capacity() * sizeof(Aggregate);
+            nodes.insert(nodes.end(), node->pointer.pNode.begin(), node->pointer.pNode.end());
+        }
+    }
+    return bytes;
+}
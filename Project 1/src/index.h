@@ -0,0 +1,63 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+#include "dtypes.h"
+
+class Tree;
+
+// called once per key of a range scan, in ascending key order
+typedef std::function<void(int key, std::vector<Record *> &records)> IndexVisitor;
+
+class Index {
+    /*
+     * Common interface of the index engines over the numVotes key. Every key maps to the posting list of the
+     * records with that key. Callers that go through this interface do not depend on the node layout of an
+     * engine, so engines can be swapped per workload.
+     */
+public:
+    virtual ~Index() = default;
+
+    virtual const char *getName() = 0;
+
+    virtual void insert(int key, Record *pRecord) = 0;
+
+    // the posting list of key, or nullptr if the key is not indexed
+    virtual std::vector<Record *> *search(int key) = 0;
+
+    // visits every key in [lowerKey, upperKey], returns the number of keys visited
+    virtual size_t scanRange(int lowerKey, int upperKey, const IndexVisitor &visit) = 0;
+
+    // removes a key with all of its records
+    virtual void removeKey(int key) = 0;
+
+    // bytes taken by the index structure, including the posting lists
+    virtual size_t getMemoryUsage() = 0;
+};
+
+class TreeIndex : public Index {
+    /*
+     * The B+ tree behind the Index interface. The tree is not owned.
+     */
+private:
+    Tree *tree;
+
+public:
+    explicit TreeIndex(Tree *aTree);
+
+    const char *getName() override;
+
+    void insert(int key, Record *pRecord) override;
+
+    std::vector<Record *> *search(int key) override;
+
+    size_t scanRange(int lowerKey, int upperKey, const IndexVisitor &visit) override;
+
+    void removeKey(int key) override;
+
+    size_t getMemoryUsage() override;
+};
+
+#endif
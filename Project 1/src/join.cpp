@@ -0,0 +1,158 @@
+#include "join.h"
+#include "trace.h"
+
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+JoinResult indexNestedLoopJoin(const vector<Record *> &outer, Table *outerTable, Table *innerTable) {
+    /*
+     * Emits (outer, inner) pairs. The cost grows with the outer side only, which makes it the better choice when
+     * the outer side is small compared with the inner table.
+     */
+    JoinResult result;
+    for (Record *outerRecord: outer) {
+        vector<Record *> *matches = innerTable->lookupTconst(outerTable, outerRecord);
+        result.indexProbes++;
+        if (matches != nullptr) {
+            for (Record *innerRecord: *matches) {
+                result.rows.emplace_back(outerRecord, innerRecord);
+            }
+        }
+    }
+    return result;
+}
+
+static inline uint32_t hashTconst(uint32_t tconst) {
+    // multiplicative hashing, the high bits pick the partition and the low bits the slot
+    return tconst * 0x9E3779B1u;
+}
+
+static void partitionRecords(const vector<Record *> &records, int partitionBits, vector<Record *> &partitioned,
+                             vector<size_t> &offsets, vector<Record *> &escaped) {
+    /*
+     * Scatters the records into 2^partitionBits contiguous partitions (partition p is
+     * partitioned[offsets[p], offsets[p + 1])), and sets aside the ones with escaped tconsts
+     */
+    size_t numPartitions = (size_t) 1 << partitionBits;
+    offsets.assign(numPartitions + 1, 0);
+    for (Record *record: records) {
+        if (Table::isEscaped(record)) {
+            escaped.push_back(record);
+        } else {
+            offsets[(partitionBits == 0 ? 0 : hashTconst(record->tconst) >> (32 - partitionBits)) + 1]++;
+        }
+    }
+    for (size_t p = 0; p < numPartitions; p++) {
+        offsets[p + 1] += offsets[p];
+    }
+
+    partitioned.resize(offsets[numPartitions]);
+    vector<size_t> next(offsets.begin(), offsets.end() - 1);
+    for (Record *record: records) {
+        if (!Table::isEscaped(record)) {
+            partitioned[next[partitionBits == 0 ? 0 : hashTconst(record->tconst) >> (32 - partitionBits)]++] = record;
+        }
+    }
+}
+
+JoinResult hashJoin(const vector<Record *> &left, Table *leftTable, const vector<Record *> &right,
+                    Table *rightTable, size_t batchSize) {
+    /*
+     * Emits (left, right) pairs. Both sides are split into partitions whose hash tables fit in the cache, then
+     * every partition builds an open-addressing table on the smaller side. Probe keys are hashed a batch at a
+     * time and their slots prefetched before any of them is compared, so the cache misses of a batch overlap.
+     *
+     * Records with escaped tconsts cannot be compared by their encoding, they are joined on their strings.
+     */
+    JoinResult result;
+    bool buildLeft = left.size() <= right.size();
+    const vector<Record *> &build = buildLeft ? left : right;
+    const vector<Record *> &probe = buildLeft ? right : left;
+    Table *buildTable = buildLeft ? leftTable : rightTable;
+    Table *probeTable = buildLeft ? rightTable : leftTable;
+
+    // aim for about 4096 build records (a 64KiB table) per partition
+    int partitionBits = 0;
+    while ((build.size() >> partitionBits) > 4096 && partitionBits < 12) {
+        partitionBits++;
+    }
+    result.partitions = (size_t) 1 << partitionBits;
+    TRACE_SCOPE_INFO("join.hash", (int64_t) result.partitions);
+
+    vector<Record *> buildPartitioned, probePartitioned, buildEscaped, probeEscaped;
+    vector<size_t> buildOffsets, probeOffsets;
+    partitionRecords(build, partitionBits, buildPartitioned, buildOffsets, buildEscaped);
+    partitionRecords(probe, partitionBits, probePartitioned, probeOffsets, probeEscaped);
+
+    auto emit = [&](Record *buildRecord, Record *probeRecord) {
+        if (buildLeft) {
+            result.rows.emplace_back(buildRecord, probeRecord);
+        } else {
+            result.rows.emplace_back(probeRecord, buildRecord);
+        }
+    };
+
+    vector<uint32_t> slotKeys;
+    vector<Record *> slotRecords;
+    vector<size_t> batchSlots(max((size_t) 1, batchSize));
+    for (size_t p = 0; p < result.partitions; p++) {
+        size_t buildCount = buildOffsets[p + 1] - buildOffsets[p];
+        if (buildCount == 0 || probeOffsets[p + 1] == probeOffsets[p]) {
+            continue;
+        }
+
+        // build: linear probing at a load factor of at most one half, duplicate keys take separate slots
+        size_t capacity = 2;
+        while (capacity < 2 * buildCount) {
+            capacity *= 2;
+        }
+        size_t mask = capacity - 1;
+        slotKeys.assign(capacity, 0);
+        slotRecords.assign(capacity, nullptr);
+        for (size_t i = buildOffsets[p]; i < buildOffsets[p + 1]; i++) {
+            Record *record = buildPartitioned[i];
+            size_t slot = hashTconst(record->tconst) & mask;
+            while (slotRecords[slot] != nullptr) {
+                slot = (slot + 1) & mask;
+            }
+            slotKeys[slot] = record->tconst;
+            slotRecords[slot] = record;
+        }
+
+        // probe a batch at a time: hash and prefetch first, then compare
+        for (size_t first = probeOffsets[p]; first < probeOffsets[p + 1]; first += batchSlots.size()) {
+            size_t last = min(first + batchSlots.size(), probeOffsets[p + 1]);
+            for (size_t i = first; i < last; i++) {
+                size_t slot = hashTconst(probePartitioned[i]->tconst) & mask;
+                batchSlots[i - first] = slot;
+                __builtin_prefetch(&slotKeys[slot]);
+                __builtin_prefetch(&slotRecords[slot]);
+            }
+            for (size_t i = first; i < last; i++) {
+                Record *probeRecord = probePartitioned[i];
+                for (size_t slot = batchSlots[i - first]; slotRecords[slot] != nullptr; slot = (slot + 1) & mask) {
+                    if (slotKeys[slot] == probeRecord->tconst) {
+                        emit(slotRecords[slot], probeRecord);
+                    }
+                }
+            }
+        }
+    }
+
+    // the escaped ids, on their strings
+    if (!buildEscaped.empty() && !probeEscaped.empty()) {
+        unordered_multimap<string, Record *> escapedTable;
+        for (Record *record: buildEscaped) {
+            escapedTable.emplace(buildTable->getDisk()->decodeTconst(record), record);
+        }
+        for (Record *record: probeEscaped) {
+            auto range = escapedTable.equal_range(probeTable->getDisk()->decodeTconst(record));
+            for (auto itr = range.first; itr != range.second; itr++) {
+                emit(itr->second, record);
+            }
+        }
+    }
+    return result;
+}
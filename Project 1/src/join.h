@@ -0,0 +1,25 @@
+#ifndef JOIN_H
+#define JOIN_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "dtypes.h"
+#include "table.h"
+
+struct JoinResult {
+    // matching (left, right) record pairs
+    std::vector<std::pair<Record *, Record *>> rows;
+    size_t indexProbes = 0;
+    size_t partitions = 0;
+};
+
+// probes the tconst index of the inner table once per outer record
+JoinResult indexNestedLoopJoin(const std::vector<Record *> &outer, Table *outerTable, Table *innerTable);
+
+// radix-partitions both sides on the tconst hash, builds a hash table per partition on the smaller side and
+// probes it in batches of batchSize keys
+JoinResult hashJoin(const std::vector<Record *> &left, Table *leftTable, const std::vector<Record *> &right,
+                    Table *rightTable, size_t batchSize = 16);
+
+#endif
@@ -0,0 +1,215 @@
+#include "learned_index.h"
+#include "tree.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+LearnedIndex::LearnedIndex(int aEpsilon) {
+    /*
+     * Constructor for an empty learned index with the given error bound, call build() to fill it from a tree
+     */
+    epsilon = max(1, aEpsilon);
+    nodesAccessedNum = 0;
+}
+
+void LearnedIndex::buildSegments(Level &level, int epsilon) {
+    /*
+     * Covers the keys of a level with as few segments as a single greedy pass allows (shrinking cone).
+     *
+     * A segment starts at a key and keeps the range of slopes for which every key added so far is predicted
+     * within epsilon of its position. The segment is closed when the next key would make that range empty, and
+     * its slope is taken from the middle of the range.
+     */
+    level.segments.clear();
+    const vector<int> &keys = level.keys;
+
+    size_t start = 0;
+    while (start < keys.size()) {
+        double minSlope = 0;
+        double maxSlope = 1e300;
+        size_t end = start + 1;
+
+        for (; end < keys.size(); end++) {
+            double dx = (double) keys[end] - keys[start];
+            double dy = (double) (end - start);
+            double lower = (dy - epsilon) / dx;
+            double upper = (dy + epsilon) / dx;
+            if (lower > maxSlope || upper < minSlope) {
+                break;
+            }
+            minSlope = max(minSlope, lower);
+            maxSlope = min(maxSlope, upper);
+        }
+
+        Segment segment;
+        segment.firstKey = keys[start];
+        segment.start = start;
+        segment.slope = end - start == 1 ? 0 : (minSlope + maxSlope) / 2;
+        segment.intercept = (double) start;
+        level.segments.push_back(segment);
+        start = end;
+    }
+}
+
+void LearnedIndex::build(Tree *tree) {
+    /*
+     * Rebuilds the index from the leaf chain of the tree, after applying any buffered messages
+     */
+    levels.clear();
+    postings.clear();
+    tree->flushAllBuffers();
+
+    // find the leftmost leaf node
+    Node *leaf = tree->getRoot();
+    while (leaf != nullptr && !leaf->isLeafNode) {
+        leaf = leaf->pointer.pNode[0];
+    }
+
+    // level 0 over the keys in the leaves
+    levels.emplace_back();
+    for (; leaf != nullptr; leaf = leaf->pNextLeaf) {
+        for (size_t i = 0; i < leaf->keys.size(); i++) {
+            // tombstones (keys without records) are left out
+            if (!leaf->pointer.pData[i].empty()) {
+                levels[0].keys.push_back(leaf->keys[i]);
+                postings.push_back(leaf->pointer.pData[i]);
+            }
+        }
+    }
+    if (levels[0].keys.empty()) {
+        levels.clear();
+        return;
+    }
+    buildSegments(levels[0], epsilon);
+
+    // index the first keys of each level until a single segment covers them
+    while (levels.back().segments.size() > 1) {
+        Level upperLevel;
+        for (Segment &segment: levels.back().segments) {
+            upperLevel.keys.push_back(segment.firstKey);
+        }
+        buildSegments(upperLevel, epsilon);
+        levels.push_back(std::move(upperLevel));
+    }
+
+    TRACE_INFO("learned.build", (int64_t) getSegmentsNum());
+}
+
+size_t LearnedIndex::findSegment(const Level &level, size_t segmentIdx, int key, bool upper) {
+    /*
+     * Predicts the position of key in the keys of a level with the given segment, then searches only the
+     * positions around the prediction. Returns the lower bound of key, or its upper bound if upper is set.
+     */
+    const Segment &segment = level.segments[segmentIdx];
+    size_t segmentEnd = segmentIdx + 1 < level.segments.size() ? level.segments[segmentIdx + 1].start
+                                                                : level.keys.size();
+
+    // the answer lies within epsilon (plus one for rounding) of the prediction, and within the segment
+    double predicted = segment.intercept + segment.slope * ((double) key - segment.firstKey);
+    auto position = (long long) predicted;
+    size_t lo = (size_t) max((long long) segment.start, position - epsilon - 1);
+    size_t hi = (size_t) min((long long) segmentEnd, position + epsilon + 2);
+    lo = min(lo, hi);
+
+    auto begin = level.keys.begin();
+    if (upper) {
+        return upper_bound(begin + lo, begin + hi, key) - begin;
+    }
+    return lower_bound(begin + lo, begin + hi, key) - begin;
+}
+
+vector<Record *> *LearnedIndex::search(int key, bool printNode) {
+    /*
+     * Searches the index for a key and returns the corresponding pointer to a vector of Record pointers.
+     * If the key is not found, a nullptr is returned.
+     */
+    TRACE_SCOPE_DEBUG("learned.search", key);
+    if (levels.empty() || key < levels[0].keys[0]) {
+        return nullptr;
+    }
+
+    // descend from the single top segment, picking the last segment with firstKey <= key on each level
+    size_t segmentIdx = 0;
+    for (size_t level = levels.size() - 1; level > 0; level--) {
+        nodesAccessedNum++;
+        segmentIdx = findSegment(levels[level], segmentIdx, key, true) - 1;
+    }
+
+    nodesAccessedNum++;
+    if (printNode) {
+        const Segment &segment = levels[0].segments[segmentIdx];
+        cout << "Segment " << segmentIdx << ": firstKey=" << segment.firstKey << ", start=" << segment.start
+             << ", slope=" << segment.slope << endl;
+    }
+
+    size_t position = findSegment(levels[0], segmentIdx, key, false);
+    if (position < levels[0].keys.size() && levels[0].keys[position] == key) {
+        return &postings[position];
+    }
+    return nullptr;
+}
+
+vector<Record *> LearnedIndex::searchRange(int lowerKey, int upperKey) {
+    /*
+     * Returns the records with lowerKey <= key <= upperKey, in key order
+     */
+    vector<Record *> result;
+    if (levels.empty() || upperKey < lowerKey) {
+        return result;
+    }
+
+    // locate the first key >= lowerKey, then read the postings sequentially
+    size_t position = 0;
+    if (lowerKey > levels[0].keys[0]) {
+        size_t segmentIdx = 0;
+        for (size_t level = levels.size() - 1; level > 0; level--) {
+            nodesAccessedNum++;
+            segmentIdx = findSegment(levels[level], segmentIdx, lowerKey, true) - 1;
+        }
+        nodesAccessedNum++;
+        position = findSegment(levels[0], segmentIdx, lowerKey, false);
+    }
+
+    for (; position < levels[0].keys.size() && levels[0].keys[position] <= upperKey; position++) {
+        result.insert(result.end(), postings[position].begin(), postings[position].end());
+    }
+    return result;
+}
+
+int LearnedIndex::getNodesAccessedNum() {
+    return nodesAccessedNum;
+}
+
+void LearnedIndex::setNodesAccessedNum(int setNumber) {
+    nodesAccessedNum = setNumber;
+}
+
+int LearnedIndex::getEpsilon() {
+    return epsilon;
+}
+
+size_t LearnedIndex::getSegmentsNum() {
+    size_t segments = 0;
+    for (Level &level: levels) {
+        segments += level.segments.size();
+    }
+    return segments;
+}
+
+int LearnedIndex::countHeight() {
+    return (int) levels.size();
+}
+
+size_t LearnedIndex::getModelSize() {
+    /*
+     * Returns the bytes used by the keys and segments of every level, without the record postings
+     */
+    size_t bytes = 0;
+    for (Level &level: levels) {
+        bytes += level.keys.size() * sizeof(int) + level.segments.size() * sizeof(Segment);
+    }
+    return bytes;
+}
@@ -0,0 +1,63 @@
+#ifndef LEARNED_INDEX_H
+#define LEARNED_INDEX_H
+
+#include <cstddef>
+#include <vector>
+#include "dtypes.h"
+
+class Tree;
+
+class LearnedIndex {
+    /*
+     * Read-only learned index over the keys of a B+ tree, in the style of a PGM index.
+     *
+     * The sorted distinct keys are covered by piecewise-linear segments that predict the position of a key within
+     * epsilon. The first keys of the segments are indexed the same way, level by level, until a single segment is
+     * left. A lookup follows one segment per level and only searches the 2 x epsilon positions around each
+     * prediction. The index is built once from the tree and does not follow later changes to it.
+     */
+private:
+    struct Segment {
+        int firstKey;
+        size_t start;      // position of firstKey in the keys of its level
+        double slope;      // positions per key
+        double intercept;  // predicted position of firstKey
+    };
+
+    struct Level {
+        std::vector<int> keys;  // level 0: the indexed keys, level i: first keys of the segments of level i - 1
+        std::vector<Segment> segments;
+    };
+
+    int epsilon;
+    std::vector<Level> levels;
+    std::vector<std::vector<Record *>> postings;  // records of levels[0].keys[i]
+    int nodesAccessedNum;
+
+    static void buildSegments(Level &level, int epsilon);
+
+    size_t findSegment(const Level &level, size_t segmentIdx, int key, bool upper);
+
+public:
+    explicit LearnedIndex(int aEpsilon);
+
+    void build(Tree *tree);
+
+    std::vector<Record *> *search(int key, bool printNode);
+
+    std::vector<Record *> searchRange(int lowerKey, int upperKey);
+
+    int getNodesAccessedNum();
+
+    void setNodesAccessedNum(int setNumber);
+
+    int getEpsilon();
+
+    size_t getSegmentsNum();
+
+    int countHeight();
+
+    size_t getModelSize();
+};
+
+#endif
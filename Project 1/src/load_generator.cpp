@@ -0,0 +1,236 @@
+#include "load_generator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <thread>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+template<typename T>
+static void appendValue(vector<unsigned char> &buffer, T value) {
+    size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(T));
+    memcpy(buffer.data() + offset, &value, sizeof(T));
+}
+
+int connectToServer(const string &path) {
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool writeAll(int fd, const vector<unsigned char> &buffer) {
+    size_t offset = 0;
+    while (offset < buffer.size()) {
+        ssize_t written = send(fd, buffer.data() + offset, buffer.size() - offset, MSG_NOSIGNAL);
+        if (written <= 0) {
+            return false;
+        }
+        offset += written;
+    }
+    return true;
+}
+
+static void appendRequest(vector<unsigned char> &buffer, uint32_t requestId, QueryOp op,
+                          const vector<unsigned char> &payload) {
+    appendValue<uint32_t>(buffer, (uint32_t) (sizeof(uint32_t) + sizeof(uint8_t) + payload.size()));
+    appendValue<uint32_t>(buffer, requestId);
+    appendValue<uint8_t>(buffer, (uint8_t) op);
+    buffer.insert(buffer.end(), payload.begin(), payload.end());
+}
+
+bool sendQuery(int fd, uint32_t requestId, QueryOp op, const vector<unsigned char> &payload, QueryStatus *status,
+               vector<unsigned char> *responsePayload) {
+    /*
+     * Blocking round trip of a single request
+     */
+    vector<unsigned char> request;
+    appendRequest(request, requestId, op, payload);
+    if (!writeAll(fd, request)) {
+        return false;
+    }
+
+    vector<unsigned char> response;
+    unsigned char buffer[64 * 1024];
+    uint32_t length = 0;
+    while (response.size() < sizeof(uint32_t) || response.size() < sizeof(uint32_t) + length) {
+        ssize_t bytesRead = read(fd, buffer, sizeof(buffer));
+        if (bytesRead <= 0) {
+            return false;
+        }
+        response.insert(response.end(), buffer, buffer + bytesRead);
+        if (response.size() >= sizeof(uint32_t)) {
+            memcpy(&length, response.data(), sizeof(length));
+        }
+    }
+
+    uint32_t respondedId;
+    memcpy(&respondedId, response.data() + 4, sizeof(respondedId));
+    *status = (QueryStatus) response[8];
+    responsePayload->assign(response.begin() + 9, response.end());
+    return respondedId == requestId;
+}
+
+static void appendRandomRequest(vector<unsigned char> &buffer, uint32_t requestId, const LoadMix &mix,
+                                mt19937 &generator) {
+    /*
+     * Appends a request drawn from the mix
+     */
+    vector<unsigned char> payload;
+    int key = mix.minKey + (int) (generator() % (mix.maxKey - mix.minKey + 1));
+    int dice = (int) (generator() % 100);
+    QueryOp op;
+
+    if (dice < mix.pointPercent) {
+        op = QueryOp::POINT;
+        appendValue<int32_t>(payload, key);
+        appendValue<uint32_t>(payload, mix.limit);
+    } else if ((dice -= mix.pointPercent) < mix.rangePercent) {
+        op = QueryOp::RANGE;
+        appendValue<int32_t>(payload, key);
+        appendValue<int32_t>(payload, key + mix.rangeWidth);
+        appendValue<uint32_t>(payload, mix.limit);
+    } else if ((dice -= mix.rangePercent) < mix.aggregatePercent) {
+        op = QueryOp::AGGREGATE;
+        appendValue<int32_t>(payload, key);
+        appendValue<int32_t>(payload, key + mix.rangeWidth);
+    } else if ((dice -= mix.aggregatePercent) < mix.insertPercent) {
+        op = QueryOp::INSERT;
+        string tconst = "tt9" + to_string(1000000 + generator() % 9000000);
+        appendValue<uint8_t>(payload, (uint8_t) (10 + generator() % 91));
+        appendValue<int32_t>(payload, key);
+        appendValue<uint8_t>(payload, (uint8_t) tconst.size());
+        payload.insert(payload.end(), tconst.begin(), tconst.end());
+    } else {
+        op = QueryOp::DELETE;
+        appendValue<int32_t>(payload, key);
+    }
+    appendRequest(buffer, requestId, op, payload);
+}
+
+struct ConnectionLoad {
+    vector<double> latencies;  // microseconds
+    size_t errors = 0;
+};
+
+static void driveConnection(const string &path, int pipelineDepth, chrono::steady_clock::time_point deadline,
+                            const LoadMix &mix, uint32_t seed, ConnectionLoad &load) {
+    /*
+     * Keeps pipelineDepth requests in flight on one connection until the deadline, then waits for the rest
+     */
+    int fd = connectToServer(path);
+    if (fd < 0) {
+        load.errors++;
+        return;
+    }
+    mt19937 generator(seed);
+    deque<chrono::steady_clock::time_point> sendTimes;
+    uint32_t nextId = 0, expectedId = 0;
+
+    vector<unsigned char> output;
+    for (int i = 0; i < pipelineDepth; i++) {
+        appendRandomRequest(output, nextId++, mix, generator);
+        sendTimes.push_back(chrono::steady_clock::now());
+    }
+
+    vector<unsigned char> input;
+    unsigned char buffer[64 * 1024];
+    while (!sendTimes.empty()) {
+        if (!output.empty()) {
+            if (!writeAll(fd, output)) {
+                load.errors++;
+                break;
+            }
+            output.clear();
+        }
+
+        ssize_t bytesRead = read(fd, buffer, sizeof(buffer));
+        if (bytesRead <= 0) {
+            load.errors++;
+            break;
+        }
+        input.insert(input.end(), buffer, buffer + bytesRead);
+
+        // every complete response completes the oldest request and, before the deadline, sends a new one
+        size_t offset = 0;
+        auto now = chrono::steady_clock::now();
+        while (input.size() - offset >= sizeof(uint32_t)) {
+            uint32_t length;
+            memcpy(&length, input.data() + offset, sizeof(length));
+            if (input.size() - offset < sizeof(uint32_t) + length) {
+                break;
+            }
+            uint32_t requestId;
+            memcpy(&requestId, input.data() + offset + 4, sizeof(requestId));
+            auto status = (QueryStatus) input[offset + 8];
+            if (requestId != expectedId++ || status == QueryStatus::BAD_REQUEST || status == QueryStatus::DISK_FULL) {
+                load.errors++;
+            }
+            load.latencies.push_back(chrono::duration<double, micro>(now - sendTimes.front()).count());
+            sendTimes.pop_front();
+            offset += sizeof(uint32_t) + length;
+
+            if (now < deadline) {
+                appendRandomRequest(output, nextId++, mix, generator);
+                sendTimes.push_back(chrono::steady_clock::now());
+            }
+        }
+        input.erase(input.begin(), input.begin() + offset);
+    }
+    close(fd);
+}
+
+LoadReport runLoadGenerator(const string &path, int numConnections, int pipelineDepth, double seconds,
+                            const LoadMix &mix) {
+    /*
+     * Runs one thread per connection and merges their latencies
+     */
+    vector<ConnectionLoad> loads(numConnections);
+    vector<thread> threads;
+    auto start = chrono::steady_clock::now();
+    auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(seconds));
+    for (int i = 0; i < numConnections; i++) {
+        threads.emplace_back(driveConnection, cref(path), max(1, pipelineDepth), deadline, cref(mix),
+                             (uint32_t) (4045 + i), ref(loads[i]));
+    }
+    for (thread &worker: threads) {
+        worker.join();
+    }
+
+    LoadReport report;
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    vector<double> latencies;
+    for (ConnectionLoad &load: loads) {
+        latencies.insert(latencies.end(), load.latencies.begin(), load.latencies.end());
+        report.errors += load.errors;
+    }
+    report.requests = latencies.size();
+    report.qps = report.requests / report.seconds;
+    if (!latencies.empty()) {
+        sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) {
+            return latencies[min(latencies.size() - 1, (size_t) (p * latencies.size()))];
+        };
+        report.p50Us = percentile(0.5);
+        report.p99Us = percentile(0.99);
+        report.p999Us = percentile(0.999);
+        report.maxUs = latencies.back();
+    }
+    return report;
+}
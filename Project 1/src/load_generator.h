@@ -0,0 +1,47 @@
+#ifndef LOAD_GENERATOR_H
+#define LOAD_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "query_server.h"
+
+struct LoadMix {
+    // percentages of the requests, deletes make up the rest
+    int pointPercent = 80;
+    int rangePercent = 10;
+    int aggregatePercent = 5;
+    int insertPercent = 4;
+
+    // keys are drawn uniformly from [minKey, maxKey], ranges span rangeWidth keys
+    int minKey = 5;
+    int maxKey = 5000;
+    int rangeWidth = 100;
+    uint32_t limit = 100;  // records returned per point or range request
+};
+
+struct LoadReport {
+    size_t requests = 0;
+    size_t errors = 0;  // BAD_REQUEST or out-of-order responses
+    double seconds = 0;
+    double qps = 0;
+    double p50Us = 0;
+    double p99Us = 0;
+    double p999Us = 0;
+    double maxUs = 0;
+};
+
+// drives the server at path from numConnections threads, each keeping pipelineDepth requests in flight for the
+// given time, and reports the throughput and latency percentiles
+LoadReport runLoadGenerator(const std::string &path, int numConnections, int pipelineDepth, double seconds,
+                            const LoadMix &mix);
+
+// connects to the server at path, returns the socket or -1
+int connectToServer(const std::string &path);
+
+// sends one request and waits for its response, returns false if the connection failed
+bool sendQuery(int fd, uint32_t requestId, QueryOp op, const std::vector<unsigned char> &payload,
+               QueryStatus *status, std::vector<unsigned char> *responsePayload);
+
+#endif
@@ -1,9 +1,40 @@
 #include "disk.h"
 #include "tree.h"
+#include "scan.h"
+#include "histogram.h"
+#include "planner.h"
+#include "parallel_scan.h"
+#include "cluster.h"
+#include "async_scan.h"
+#include "learned_index.h"
+#include "frozen_tree.h"
+#include "bloom_filter.h"
+#include "versioned_tree.h"
+#include "sharded_table.h"
+#include "table.h"
+#include "join.h"
+#include "query_server.h"
+#include "load_generator.h"
+#include "external_sort.h"
+#include "index.h"
+#include "art_index.h"
+#include "stream_ingest.h"
+#include "tombstone_compactor.h"
+#include "trace.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <set>
+#include <map>
+#include <deque>
+#include <random>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <unistd.h>
 #include <assert.h>
 
 using namespace std;
@@ -43,6 +74,11 @@ void experiment12(Tree *tree, Disk *disk) {
         newRecord = (*disk).insertRecord(tconst,
                                          (unsigned char) (stof(averageRating) * 10),
                                          stoi(numVotes));
+        if (newRecord == nullptr) {
+            cout << " -> Out of memory for the disk, stopped after " << count << " records" << endl;
+            break;
+        }
+
         // insert into tree
         (*tree).insert(newRecord->numVotes, newRecord);
         count++;
@@ -52,6 +88,7 @@ void experiment12(Tree *tree, Disk *disk) {
 
     // print experiment 1 outputs
     cout << " -> No of blocks used: " << (*disk).getBlocksUsed() << " blocks" << endl;
+    cout << " -> No of extents allocated: " << (*disk).getExtentsAllocated() << " extents" << endl;
     cout << " -> Size of the database (blocks used x blockSize): " << (*disk).getBlocksUsed() * blockSize << " bytes"
          << endl;
 
@@ -205,6 +242,30 @@ void experiment4(Tree *tree, Disk *disk) {
     cout << "===========================================" << endl;
 }
 
+void experiment4Bitmap(Tree *tree, Disk *disk) {
+    /*
+     * Repeats the range query of experiment 4 (numVotes from 30,000 to 40,000) as a bitmap heap scan, which
+     * reads each qualifying data block once and in ascending block order
+     */
+    cout << "EXPERIMENT 4 (BITMAP HEAP SCAN)" << endl;
+
+    ScanResult result = bitmapHeapScan(tree, disk, 30000, 40000);
+
+    cout << " -> No of Index Nodes Accessed: " << result.indexNodesAccessed << endl;
+    cout << " -> No of records retrieved: " << result.records.size() << endl;
+    cout << " -> No of Data blocks accessed: " << result.dataBlocksAccessed << endl;
+    cout << " -> No of unique Data blocks accessed: " << result.uniqueDataBlocksAccessed << endl;
+
+    // compute and print average of "averageRating"
+    unsigned int total = 0;
+    for (Record *record: result.records) {
+        total += record->averageRating;
+    }
+    cout << " -> Average of averageRating: " << ((float) total / 10) / result.records.size() << endl;
+
+    cout << "===========================================" << endl;
+}
+
 void experiment5(Tree *tree, Disk *disk) {
     /*
      * Remove the records with numVotes = 1,000, update the tree and print statistics
@@ -214,7 +275,20 @@ void experiment5(Tree *tree, Disk *disk) {
     // original number of nodes in the tree
     int numNodes = tree->countNodes();
 
+    // mark the records as deleted on disk, then remove the key from the index
+    vector<Record *> *records = tree->search(1000, false);
+    bool keyExists = records != nullptr;
+    if (keyExists) {
+        for (Record *record: *records) {
+            disk->deleteRecord(record);
+        }
+    }
     tree->removeKey(1000);
+    if (keyExists) {
+        cout << " -> Removed '1000' from the B+ Tree successfully!" << endl;
+    } else {
+        cout << " -> Unable to remove: The key '1000' was not found in the B+ Tree." << endl;
+    }
 
     // currentNode number of nodes after removal of key=100
     int numUpdatedNodes = tree->countNodes();
@@ -237,24 +311,1695 @@ void experiment5(Tree *tree, Disk *disk) {
     cout << "===========================================" << endl;
 }
 
-int main() {
-    // instantiate a disk of 100MB
-    Disk disk = Disk((100 * 1000 * 1000), blockSize);
+void experimentPlanner(Tree *tree, Disk *disk) {
+    /*
+     * Lets the planner choose the access path for range queries of increasing width on numVotes, and compares
+     * the estimated number of records against the number actually retrieved
+     */
+    cout << "EXPERIMENT PLANNER" << endl;
 
-    // instantiate an empty b+ tree
-    Tree tree = Tree(blockSize);
+    vector<pair<int, int>> ranges = {{500,   500},
+                                     {30000, 40000},
+                                     {1000,  5000},
+                                     {0,     1000},
+                                     {0,     10000000}};
 
-    // run experiment 1 and 2
-    experiment12(&tree, &disk);
+    for (auto &range: ranges) {
+        Plan plan = planRangeQuery(tree, disk, range.first, range.second);
+        ScanResult result = executeRangeQuery(tree, disk, plan, range.first, range.second);
 
-    // run experiment 3
-    experiment3(&tree, &disk);
+        cout << " -> numVotes in [" << range.first << ", " << range.second << "]: "
+             << getAccessPathName(plan.accessPath) << endl;
+        cout << "    estimated records: " << (long long) plan.estimatedRecords
+             << ", actual records: " << result.records.size() << endl;
+        cout << "    cost (index / bitmap / sequential): " << plan.indexScanCost << " / "
+             << plan.bitmapHeapScanCost << " / " << plan.sequentialScanCost << endl;
+        cout << "    data blocks accessed: " << result.dataBlocksAccessed << endl;
+    }
 
-    // run experiment 4
-    experiment4(&tree, &disk);
+    cout << "===========================================" << endl;
+}
 
-    // run experiment 5
-    experiment5(&tree, &disk);
+void experimentParallelScan(Disk *disk) {
+    /*
+     * Scans all blocks for records with averageRating > 8.0 (not indexed) with 1 to N worker threads and reports
+     * the scan throughput
+     */
+    cout << "EXPERIMENT PARALLEL SCAN" << endl;
+
+    RecordFilter filter;
+    filter.minRating = 81;
+
+    int maxThreads = max(1, (int) thread::hardware_concurrency());
+    double singleThreadTime = 0;
+
+    for (int numThreads = 1;; numThreads = min(numThreads * 2, maxThreads)) {
+        ThreadPool pool(numThreads);
+        ScanAggregate result;
+
+        // keep the best of a few runs
+        double bestTime = 0;
+        for (int run = 0; run < 5; run++) {
+            auto start = chrono::steady_clock::now();
+            result = parallelSequentialScan(disk, &pool, filter, false);
+            double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            if (run == 0 || elapsed < bestTime) {
+                bestTime = elapsed;
+            }
+        }
+        if (numThreads == 1) {
+            singleThreadTime = bestTime;
+        }
+
+        cout << " -> " << numThreads << " thread(s): " << bestTime * 1000 << " ms, "
+             << (long long) (disk->getBlocksUsed() / bestTime) << " blocks/s, speedup "
+             << singleThreadTime / bestTime << "x (" << result.count << " records, average rating "
+             << result.getAverageRating() << ")" << endl;
+
+        if (numThreads == maxThreads) {
+            break;
+        }
+    }
+
+    cout << "===========================================" << endl;
+}
+
+void printRangeBlocks(Tree *tree, Disk *disk, int key1, int key2) {
+    /*
+     * Prints the data blocks touched by an index scan of [key1, key2] and the span of block ids they cover
+     */
+    ScanResult result = indexScan(tree, disk, key1, key2);
+
+    size_t firstBlock = SIZE_MAX, lastBlock = 0;
+    for (Record *record: result.records) {
+        firstBlock = min(firstBlock, disk->getBlockId(record));
+        lastBlock = max(lastBlock, disk->getBlockId(record));
+    }
+
+    cout << "    numVotes in [" << key1 << ", " << key2 << "]: " << result.records.size() << " records, "
+         << result.uniqueDataBlocksAccessed << " unique data blocks";
+    if (!result.records.empty()) {
+        cout << " within blocks " << firstBlock << " to " << lastBlock;
+    }
+    cout << endl;
+}
+
+void experimentCluster(Tree *tree, Disk *disk) {
+    /*
+     * Physically reorders the records on disk by numVotes and compares range scans before and after
+     */
+    cout << "EXPERIMENT CLUSTER" << endl;
+
+    cout << " -> Before clustering: clustering ratio " << getClusteringRatio(tree, disk) << ", "
+         << disk->getBlocksUsed() << " blocks used" << endl;
+    printRangeBlocks(tree, disk, 500, 500);
+    printRangeBlocks(tree, disk, 30000, 40000);
+
+    auto start = chrono::steady_clock::now();
+    clusterByIndex(tree, disk);
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << " -> After clustering (" << elapsed * 1000 << " ms): clustering ratio "
+         << getClusteringRatio(tree, disk) << ", " << disk->getBlocksUsed() << " blocks used" << endl;
+    printRangeBlocks(tree, disk, 500, 500);
+    printRangeBlocks(tree, disk, 30000, 40000);
+
+    cout << "===========================================" << endl;
+}
+
+void experimentBufferedIngest(Disk *disk) {
+    /*
+     * Rebuilds the numVotes index from the records on disk with plain inserts, and in buffered (B-epsilon) mode
+     * with different buffer capacities, comparing the insert throughput. Lookups are checked against the actual
+     * record counts while messages are still pending in the buffers.
+     */
+    cout << "EXPERIMENT BUFFERED INGEST" << endl;
+
+    // collect the live records and the expected number of records per key
+    vector<Record *> records;
+    map<int, size_t> expectedCounts;
+    for (size_t blockIdx = 0; blockIdx < disk->getBlocksUsed(); blockIdx++) {
+        for (size_t recordIdx = 0; recordIdx < disk->getRecordsInBlock(blockIdx); recordIdx++) {
+            if (!disk->isDeleted(blockIdx, recordIdx)) {
+                Record *record = disk->getRecord(blockIdx, recordIdx);
+                records.push_back(record);
+                expectedCounts[(int) record->numVotes]++;
+            }
+        }
+    }
+
+    // insert in a random order, as updates arrive in no particular key order
+    shuffle(records.begin(), records.end(), mt19937(4031));
+
+    double plainTime = 0;
+    for (int capacity: {0, 64, 256, 1024}) {
+        Tree ingestTree = Tree(blockSize);
+        ingestTree.setBufferCapacity(capacity);
+
+        auto start = chrono::steady_clock::now();
+        for (Record *record: records) {
+            ingestTree.insert(record->numVotes, record);
+        }
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (capacity == 0) {
+            plainTime = elapsed;
+        }
+        size_t pending = ingestTree.getPendingMessages();
+
+        // check lookups on a sample of keys, plus one key that does not exist
+        bool correct = ingestTree.search(-1, false) == nullptr;
+        int sample = 0;
+        for (auto &entry: expectedCounts) {
+            if (sample++ % 7 != 0) {
+                continue;
+            }
+            vector<Record *> *result = ingestTree.search(entry.first, false);
+            correct = correct && result != nullptr && result->size() == entry.second;
+        }
+
+        if (capacity == 0) {
+            cout << " -> Plain inserts: ";
+        } else {
+            cout << " -> Buffered inserts (capacity " << capacity << "): ";
+        }
+        cout << (long long) (records.size() / elapsed) << " inserts/s, speedup " << plainTime / elapsed << "x, "
+             << pending << " messages pending, lookups " << (correct ? "correct" : "INCORRECT") << endl;
+    }
+
+    cout << "===========================================" << endl;
+}
+
+void experimentAsyncIO(Tree *tree, Disk *disk) {
+    /*
+     * Writes the disk to a local file and scans it back through the block I/O engine, with the synchronous
+     * pread fallback and with io_uring at different queue depths
+     */
+    cout << "EXPERIMENT ASYNC BLOCK I/O" << endl;
+
+    string path = "disk.bin";
+    if (!disk->writeToFile(path)) {
+        cout << " -> Unable to write " << path << endl;
+        cout << "===========================================" << endl;
+        return;
+    }
+
+    RecordFilter filter;
+    filter.minRating = 81;
+    ScanResult expectedRange = bitmapHeapScan(tree, disk, 30000, 40000);
+
+    vector<pair<bool, unsigned>> configurations = {{false, 1},
+                                                   {true,  1},
+                                                   {true,  4},
+                                                   {true,  16},
+                                                   {true,  64}};
+    for (auto &configuration: configurations) {
+        BlockIOEngine engine(path, disk->getBlockSize(), configuration.second, configuration.first);
+        if (configuration.first && !engine.isAsync()) {
+            cout << " -> io_uring is not available, only the pread fallback was measured" << endl;
+            break;
+        }
+
+        auto start = chrono::steady_clock::now();
+        ScanAggregate result = asyncSequentialScan(&engine, disk, filter);
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        ScanAggregate rangeResult = asyncBitmapHeapScan(&engine, tree, disk, 30000, 40000);
+
+        cout << " -> " << (engine.isAsync() ? "io_uring" : "pread") << ", queue depth " << engine.getQueueDepth()
+             << ": " << (long long) (disk->getBlocksUsed() / elapsed) << " blocks/s, "
+             << (disk->getBlocksUsed() * disk->getBlockSize() / elapsed) / 1e6 << " MB/s (" << result.count
+             << " records with averageRating > 8.0, bitmap scan of [30000, 40000] found " << rangeResult.count
+             << "/" << expectedRange.records.size() << ")";
+        if (engine.getFailedReads() > 0) {
+            cout << ", " << engine.getFailedReads() << " READS FAILED";
+        }
+        cout << endl;
+    }
+
+    remove(path.c_str());
+    cout << "===========================================" << endl;
+}
+
+void experimentDiskAllocation(Disk *disk) {
+    /*
+     * Compares the time to set up a 100MB disk area with a value-initialized heap array and with a single 100MB
+     * extent in each page mode, then copies the loaded records into each disk and measures the latency of random
+     * record lookups
+     */
+    cout << "EXPERIMENT DISK ALLOCATION" << endl;
+
+    size_t diskSize = 100 * 1000 * 1000;
+    auto start = chrono::steady_clock::now();
+    auto *heapArea = new unsigned char[diskSize]();
+    double heapTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    delete[] heapArea;
+    cout << " -> Value-initialized heap array: setup " << heapTime * 1e3 << " ms" << endl;
+
+    // the same random lookups for every page mode
+    vector<pair<size_t, size_t>> lookups;
+    mt19937 generator(4034);
+    size_t recordsUsed = (disk->getBlocksUsed() - 1) * disk->getMaxRecordsPerBlock() +
+                         disk->getRecordsInBlock(disk->getBlocksUsed() - 1);
+    for (int i = 0; i < 2000000; i++) {
+        size_t slot = generator() % recordsUsed;
+        lookups.emplace_back(slot / disk->getMaxRecordsPerBlock(), slot % disk->getMaxRecordsPerBlock());
+    }
+
+    for (PageMode mode: {PageMode::STANDARD, PageMode::TRANSPARENT_HUGE_PAGES, PageMode::HUGETLB}) {
+        start = chrono::steady_clock::now();
+        Disk copy = Disk(diskSize, disk->getBlockSize(), mode);
+        double setupTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        // the first touch of every page happens while loading
+        start = chrono::steady_clock::now();
+        for (size_t blockIdx = 0; blockIdx < disk->getBlocksUsed(); blockIdx++) {
+            for (size_t recordIdx = 0; recordIdx < disk->getRecordsInBlock(blockIdx); recordIdx++) {
+                copy.insertRecord(*disk->getRecord(blockIdx, recordIdx), *disk);
+            }
+        }
+        double loadTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        long long votes = 0;
+        start = chrono::steady_clock::now();
+        for (auto &lookup: lookups) {
+            votes += copy.getRecord(lookup.first, lookup.second)->numVotes;
+        }
+        double lookupTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << " -> " << getPageModeName(mode) << " (" << getPageModeName(copy.getPageMode()) << " used): setup "
+             << setupTime * 1e3 << " ms, load " << loadTime * 1e3 << " ms, random lookup "
+             << lookupTime * 1e9 / lookups.size() << " ns (checksum " << votes << ")" << endl;
+    }
+
+    cout << "===========================================" << endl;
+}
+
+vector<int> getIndexedKeys(Tree *tree, Disk *disk) {
+    /*
+     * Returns the distinct keys in the tree, in ascending order
+     */
+    vector<int> keys;
+    for (ScanResult all = indexScan(tree, disk, INT32_MIN, INT32_MAX); Record *record: all.records) {
+        if (keys.empty() || keys.back() != record->numVotes) {
+            keys.push_back((int) record->numVotes);
+        }
+    }
+    return keys;
+}
+
+vector<int> getLookupKeys(const vector<int> &keys) {
+    /*
+     * Returns every 4th key, plus a miss next to each, in a random order
+     */
+    vector<int> lookups;
+    for (size_t i = 0; i < keys.size(); i += 4) {
+        lookups.push_back(keys[i]);
+        lookups.push_back(keys[i] + 1);
+    }
+    shuffle(lookups.begin(), lookups.end(), mt19937(4036));
+    return lookups;
+}
+
+double timeTreeLookups(Tree *tree, const vector<int> &lookups, int rounds) {
+    /*
+     * Runs the lookups against the tree rounds times, prints the average latency and returns the total time
+     */
+    auto start = chrono::steady_clock::now();
+    size_t found = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (int key: lookups) {
+            found += tree->search(key, false) != nullptr;
+        }
+    }
+    double treeTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    tree->setNodesAccessedNum(0);
+    cout << " -> B+ tree: height " << tree->countHeight() << ", " << tree->countNodes() * blockSize
+         << " bytes (nodes x blockSize), lookup " << treeTime * 1e9 / (rounds * lookups.size()) << " ns ("
+         << found / rounds << " found)" << endl;
+    return treeTime;
+}
+
+void experimentLearnedIndex(Tree *tree, Disk *disk) {
+    /*
+     * Builds learned indexes with different error bounds from the tree, checks every key against the tree, and
+     * compares lookup latency, range scans and index size with the B+ tree
+     */
+    cout << "EXPERIMENT LEARNED INDEX" << endl;
+
+    vector<int> keys = getIndexedKeys(tree, disk);
+    vector<int> lookups = getLookupKeys(keys);
+    int rounds = max(1, (int) (2000000 / lookups.size()));
+    double treeTime = timeTreeLookups(tree, lookups, rounds);
+
+    for (int epsilon: {8, 32, 128}) {
+        LearnedIndex learnedIndex = LearnedIndex(epsilon);
+        learnedIndex.build(tree);
+
+        // every key must return the same records as the tree
+        bool correct = true;
+        for (int key: keys) {
+            for (int probe: {key, key + 1}) {
+                vector<Record *> *expected = tree->search(probe, false);
+                vector<Record *> *actual = learnedIndex.search(probe, false);
+                correct = correct && (actual == nullptr ? expected == nullptr : expected != nullptr &&
+                                                                                *actual == *expected);
+            }
+        }
+        correct = correct && learnedIndex.searchRange(30000, 40000).size() ==
+                             indexScan(tree, disk, 30000, 40000).records.size();
+        tree->setNodesAccessedNum(0);
+
+        auto start = chrono::steady_clock::now();
+        size_t found = 0;
+        for (int round = 0; round < rounds; round++) {
+            for (int key: lookups) {
+                found += learnedIndex.search(key, false) != nullptr;
+            }
+        }
+        double learnedTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        cout << " -> Learned index (epsilon " << epsilon << "): " << learnedIndex.getSegmentsNum() << " segments in "
+             << learnedIndex.countHeight() << " levels, " << learnedIndex.getModelSize() << " bytes, lookup "
+             << learnedTime * 1e9 / (rounds * lookups.size()) << " ns (" << found / rounds << " found, speedup "
+             << treeTime / learnedTime << "x), results " << (correct ? "match" : "DO NOT MATCH") << " the tree"
+             << endl;
+    }
+
+    cout << "===========================================" << endl;
+}
+
+void experimentFrozenTree(Tree *tree, Disk *disk) {
+    /*
+     * Freezes the tree into an Eytzinger snapshot, checks every key against the tree, and compares lookup
+     * latency and range scans with the B+ tree
+     */
+    cout << "EXPERIMENT FROZEN TREE" << endl;
+
+    vector<int> keys = getIndexedKeys(tree, disk);
+    vector<int> lookups = getLookupKeys(keys);
+    int rounds = max(1, (int) (2000000 / lookups.size()));
+    double treeTime = timeTreeLookups(tree, lookups, rounds);
+
+    auto start = chrono::steady_clock::now();
+    FrozenTree frozenTree = tree->freeze();
+    double freezeTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    // every key and its successor must return the same records as the tree
+    bool correct = frozenTree.getNumKeys() == keys.size();
+    for (int key: keys) {
+        for (int probe: {key, key + 1}) {
+            vector<Record *> *expected = tree->search(probe, false);
+            RecordRange actual = frozenTree.search(probe);
+            correct = correct && (actual.empty() ? expected == nullptr : expected != nullptr &&
+                                  equal(actual.first, actual.last, expected->begin(), expected->end()));
+        }
+    }
+    correct = correct && frozenTree.searchRange(30000, 40000) == indexScan(tree, disk, 30000, 40000).records;
+    tree->setNodesAccessedNum(0);
+
+    start = chrono::steady_clock::now();
+    size_t found = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (int key: lookups) {
+            found += !frozenTree.search(key).empty();
+        }
+    }
+    double frozenTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << " -> Frozen tree: " << frozenTree.getNumLeaves() << " packed leaves, " << frozenTree.getMemoryUsage()
+         << " bytes, frozen in " << freezeTime * 1e3 << " ms, lookup " << frozenTime * 1e9 / (rounds * lookups.size())
+         << " ns (" << found / rounds << " found, speedup " << treeTime / frozenTime << "x), results "
+         << (correct ? "match" : "DO NOT MATCH") << " the tree" << endl;
+
+    cout << "===========================================" << endl;
+}
+
+void experimentBloomFilter(Disk *disk) {
+    /*
+     * Builds a numVotes index with a Bloom filter attached (plain and buffered inserts), removes a third of the
+     * keys, checks lookups against the actual record counts, and compares lookups of absent keys with and without
+     * the filter
+     */
+    cout << "EXPERIMENT BLOOM FILTER" << endl;
+
+    vector<Record *> records;
+    for (size_t blockIdx = 0; blockIdx < disk->getBlocksUsed(); blockIdx++) {
+        for (size_t recordIdx = 0; recordIdx < disk->getRecordsInBlock(blockIdx); recordIdx++) {
+            if (!disk->isDeleted(blockIdx, recordIdx)) {
+                records.push_back(disk->getRecord(blockIdx, recordIdx));
+            }
+        }
+    }
+    shuffle(records.begin(), records.end(), mt19937(4038));
+
+    for (int capacity: {0, 256}) {
+        Tree filteredTree = Tree(blockSize);
+        BloomFilter bloomFilter = BloomFilter(10);
+        filteredTree.setBufferCapacity(capacity);
+        filteredTree.setBloomFilter(&bloomFilter);
+
+        map<int, size_t> expectedCounts;
+        for (Record *record: records) {
+            filteredTree.insert(record->numVotes, record);
+            expectedCounts[(int) record->numVotes]++;
+        }
+
+        // remove every third key
+        int keyIdx = 0;
+        for (auto itr = expectedCounts.begin(); itr != expectedCounts.end();) {
+            if (keyIdx++ % 3 == 0) {
+                filteredTree.removeKey(itr->first);
+                itr = expectedCounts.erase(itr);
+            } else {
+                itr++;
+            }
+        }
+
+        // check every key up to the largest one, present or not
+        int maxKey = expectedCounts.rbegin()->first;
+        bool correct = true;
+        vector<int> absentKeys;
+        for (int key = 0; key <= maxKey && correct; key++) {
+            vector<Record *> *result = filteredTree.search(key, false);
+            auto expected = expectedCounts.find(key);
+            if (expected == expectedCounts.end()) {
+                correct = result == nullptr;
+                absentKeys.push_back(key);
+            } else {
+                correct = result != nullptr && result->size() == expected->second;
+            }
+        }
+        shuffle(absentKeys.begin(), absentKeys.end(), mt19937(4038));
+
+        // absent keys that get past the filter
+        size_t falsePositives = 0;
+        for (int key: absentKeys) {
+            falsePositives += bloomFilter.mayContain(key);
+        }
+
+        // the same absent keys with and without the filter
+        double times[2];
+        int nodesAccessed[2];
+        for (int withFilter = 1; withFilter >= 0; withFilter--) {
+            filteredTree.setBloomFilter(withFilter ? &bloomFilter : nullptr);
+            filteredTree.setNodesAccessedNum(0);
+            auto start = chrono::steady_clock::now();
+            size_t found = 0;
+            for (int key: absentKeys) {
+                found += filteredTree.search(key, false) != nullptr;
+            }
+            times[withFilter] = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            nodesAccessed[withFilter] = filteredTree.getNodesAccessedNum();
+        }
+
+        cout << " -> " << (capacity == 0 ? "Plain inserts" : "Buffered inserts (capacity 256)") << ": "
+             << bloomFilter.getMemoryUsage() << " bytes of filter, lookups " << (correct ? "correct" : "INCORRECT")
+             << endl;
+        cout << "    " << absentKeys.size() << " absent keys: false positive rate "
+             << (double) falsePositives / absentKeys.size() << ", lookup " << times[1] * 1e9 / absentKeys.size()
+             << " ns with the filter (" << (double) nodesAccessed[1] / absentKeys.size() << " index nodes), "
+             << times[0] * 1e9 / absentKeys.size() << " ns without (" << (double) nodesAccessed[0] / absentKeys.size()
+             << " index nodes)" << endl;
+    }
+
+    cout << "===========================================" << endl;
+}
+
+bool checkLeafLinks(Tree *tree) {
+    /*
+     * Returns true if every leaf's backward link points to the leaf whose forward link points to it
+     */
+    Node *leaf = tree->getRoot();
+    while (leaf != nullptr && !leaf->isLeafNode) {
+        leaf = leaf->pointer.pNode[0];
+    }
+    if (leaf != nullptr && leaf->pPrevLeaf != nullptr) {
+        return false;
+    }
+    for (; leaf != nullptr; leaf = leaf->pNextLeaf) {
+        if (leaf->pNextLeaf != nullptr && leaf->pNextLeaf->pPrevLeaf != leaf) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void experimentTopK(Tree *tree, Disk *disk) {
+    /*
+     * Retrieves the top 100 titles by numVotes with Tree::topK, and with a full scan followed by a sort
+     */
+    cout << "EXPERIMENT TOP-K" << endl;
+    size_t k = 100;
+
+    tree->setNodesAccessedNum(0);
+    auto start = chrono::steady_clock::now();
+    vector<Record *> topRecords = tree->topK(k);
+    double topKTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    int nodesAccessed = tree->getNodesAccessedNum();
+
+    start = chrono::steady_clock::now();
+    vector<Record *> allRecords = indexScan(tree, disk, INT32_MIN, INT32_MAX).records;
+    size_t count = min(k, allRecords.size());
+    partial_sort(allRecords.begin(), allRecords.begin() + count, allRecords.end(), [](Record *a, Record *b) {
+        return a->numVotes > b->numVotes;
+    });
+    allRecords.resize(count);
+    double sortTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    tree->setNodesAccessedNum(0);
+
+    bool correct = topRecords.size() == allRecords.size();
+    for (size_t i = 0; correct && i < topRecords.size(); i++) {
+        correct = topRecords[i]->numVotes == allRecords[i]->numVotes;
+    }
+
+    cout << " -> Top " << k << " titles by numVotes: " << topKTime * 1e6 << " us with topK (" << nodesAccessed
+         << " index nodes), " << sortTime * 1e6 << " us with a full scan and sort, results "
+         << (correct ? "match" : "DO NOT MATCH") << endl;
+    for (size_t i = 0; i < min((size_t) 5, topRecords.size()); i++) {
+        cout << "    " << i + 1 << ". ";
+        disk->printRecord(topRecords[i]);
+    }
+
+    // the backward links must survive splits, borrows and merges
+    Tree linkTree = Tree(blockSize);
+    vector<Record *> records = indexScan(tree, disk, INT32_MIN, INT32_MAX).records;
+    shuffle(records.begin(), records.end(), mt19937(4039));
+    for (Record *record: records) {
+        linkTree.insert(record->numVotes, record);
+    }
+    bool linked = checkLeafLinks(tree) && checkLeafLinks(&linkTree);
+    for (size_t i = 0; i < records.size(); i += 2) {
+        linkTree.removeKey(records[i]->numVotes);
+    }
+    linked = linked && checkLeafLinks(&linkTree);
+    cout << " -> Backward leaf links after inserts and removals: " << (linked ? "consistent" : "BROKEN") << endl;
+
+    cout << "===========================================" << endl;
+}
+
+bool checkAggregates(Tree *tree, const map<int, Aggregate> &expected, int maxKey, int numRanges) {
+    /*
+     * Compares aggregateRange on random ranges with the aggregates computed from expected (per key)
+     */
+    mt19937 generator(4040);
+    bool correct = true;
+    for (int i = 0; i < numRanges && correct; i++) {
+        int lowerKey = (int) (generator() % (maxKey + 1));
+        int upperKey = lowerKey + (int) (generator() % (maxKey / (1 + generator() % 1000) + 1));
+        Aggregate expectedResult;
+        for (auto itr = expected.lower_bound(lowerKey); itr != expected.end() && itr->first <= upperKey; itr++) {
+            expectedResult.merge(itr->second);
+        }
+        Aggregate result = tree->aggregateRange(lowerKey, upperKey);
+        correct = result.count == expectedResult.count && result.ratingSum == expectedResult.ratingSum;
+    }
+    tree->setNodesAccessedNum(0);
+    return correct;
+}
+
+void experimentAggregates(Tree *tree, Disk *disk) {
+    /*
+     * Answers the range average of experiment 4 from the per-child aggregates, and checks that the aggregates
+     * stay correct through inserts (plain and buffered) and removals on a separate index
+     */
+    cout << "EXPERIMENT RANGE AGGREGATES" << endl;
+
+    vector<Record *> records = indexScan(tree, disk, INT32_MIN, INT32_MAX).records;
+    map<int, Aggregate> expected;
+    for (Record *record: records) {
+        expected[(int) record->numVotes].count++;
+        expected[(int) record->numVotes].ratingSum += record->averageRating;
+    }
+    int maxKey = expected.rbegin()->first;
+
+    // experiment 4's query and a wide one, with the leaf chain and with the aggregates
+    for (pair<int, int> range: {make_pair(30000, 40000), make_pair(100, 1000000)}) {
+        for (bool enabled: {false, true}) {
+            tree->setAggregatesEnabled(enabled);
+            tree->setNodesAccessedNum(0);
+            auto start = chrono::steady_clock::now();
+            Aggregate result;
+            int repetitions = 1000;
+            for (int i = 0; i < repetitions; i++) {
+                result = tree->aggregateRange(range.first, range.second);
+            }
+            double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            cout << " -> numVotes in [" << range.first << ", " << range.second << "] "
+                 << (enabled ? "with aggregates" : "over the leaf chain") << ": COUNT " << result.count
+                 << ", AVG(averageRating) " << result.getAverageRating() << ", "
+                 << tree->getNodesAccessedNum() / repetitions << " index nodes, " << elapsed * 1e6 / repetitions
+                 << " us" << endl;
+        }
+    }
+    bool correct = checkAggregates(tree, expected, maxKey, 2000);
+    tree->setAggregatesEnabled(false);
+    cout << " -> Random ranges on the main index: " << (correct ? "correct" : "INCORRECT") << endl;
+
+    // a fresh index that keeps its aggregates through inserts and removals
+    shuffle(records.begin(), records.end(), mt19937(4040));
+    for (int capacity: {0, 256}) {
+        Tree aggregateTree = Tree(blockSize);
+        aggregateTree.setAggregatesEnabled(true);
+        aggregateTree.setBufferCapacity(capacity);
+        for (Record *record: records) {
+            aggregateTree.insert(record->numVotes, record);
+        }
+        map<int, Aggregate> remaining = expected;
+        correct = checkAggregates(&aggregateTree, remaining, maxKey, 500);
+
+        // remove two thirds of the keys, checking as the tree shrinks
+        int keyIdx = 0;
+        for (auto itr = remaining.begin(); itr != remaining.end();) {
+            if (keyIdx++ % 3 != 0) {
+                aggregateTree.removeKey(itr->first);
+                itr = remaining.erase(itr);
+            } else {
+                itr++;
+            }
+            if (keyIdx % 1000 == 0) {
+                correct = correct && checkAggregates(&aggregateTree, remaining, maxKey, 50);
+            }
+        }
+        correct = correct && checkAggregates(&aggregateTree, remaining, maxKey, 500);
+
+        cout << " -> " << (capacity == 0 ? "Plain inserts" : "Buffered inserts (capacity 256)")
+             << ", then removals: aggregates " << (correct ? "correct" : "INCORRECT") << endl;
+    }
+
+    cout << "===========================================" << endl;
+}
+
+void experimentVersionedTree(Tree *tree, Disk *disk) {
+    /*
+     * Runs range scans over pinned snapshots of a copy-on-write index while a writer inserts and removes keys,
+     * checking that every snapshot stays consistent, and compares reader and writer throughput with each of
+     * them running alone
+     */
+    cout << "EXPERIMENT MVCC SNAPSHOTS" << endl;
+
+    vector<Record *> records = indexScan(tree, disk, INT32_MIN, INT32_MAX).records;
+    shuffle(records.begin(), records.end(), mt19937(4041));
+    size_t half = records.size() / 2;
+    int numReaders = 2;
+
+    // the readers scan the middle fifth of the distinct keys, where the writer inserts and removes keys as well
+    vector<int> sortedKeys;
+    for (Record *record: records) {
+        sortedKeys.push_back((int) record->numVotes);
+    }
+    sort(sortedKeys.begin(), sortedKeys.end());
+    sortedKeys.erase(unique(sortedKeys.begin(), sortedKeys.end()), sortedKeys.end());
+    int lowerKey = sortedKeys.empty() ? 0 : sortedKeys[sortedKeys.size() * 2 / 5];
+    int upperKey = sortedKeys.empty() ? 0 : sortedKeys[sortedKeys.size() * 3 / 5];
+    cout << " -> " << numReaders << " reader threads and 1 writer on " << thread::hardware_concurrency()
+         << " hardware threads, scanning keys " << lowerKey << " to " << upperKey << endl;
+
+    for (bool withWriter: {false, true}) {
+        for (bool withReaders: {false, true}) {
+            if (!withWriter && !withReaders) {
+                continue;
+            }
+            VersionedTree versionedTree = VersionedTree(blockSize);
+            for (size_t i = 0; i < half; i++) {
+                versionedTree.insert(records[i]->numVotes, records[i]);
+            }
+
+            // a snapshot held through the whole run must keep returning the version it pinned
+            Snapshot initial = versionedTree.pin();
+            vector<Record *> initialResult = initial.searchRange(lowerKey, upperKey);
+
+            // readers scan the same range twice per snapshot, the two scans must agree
+            atomic<bool> stop = false;
+            atomic<size_t> scans = 0;
+            atomic<bool> consistent = true;
+            vector<thread> readers;
+            auto start = chrono::steady_clock::now();
+            for (int i = 0; i < (withReaders ? numReaders : 0); i++) {
+                readers.emplace_back([&]() {
+                    while (!stop.load()) {
+                        Snapshot snapshot = versionedTree.pin();
+                        if (snapshot.searchRange(lowerKey, upperKey) != snapshot.searchRange(lowerKey, upperKey)) {
+                            consistent = false;
+                        }
+                        scans += 2;
+                    }
+                });
+            }
+
+            // the writer inserts the other half of the records and removes every 4th key of the first half
+            size_t writes = 0;
+            if (withWriter) {
+                for (size_t i = half; i < records.size(); i++) {
+                    versionedTree.insert(records[i]->numVotes, records[i]);
+                    writes++;
+                    if (i % 4 == 0) {
+                        versionedTree.removeKey(records[i - half]->numVotes);
+                        writes++;
+                    }
+                }
+            } else {
+                this_thread::sleep_for(chrono::milliseconds(500));
+            }
+            stop = true;
+            for (thread &reader: readers) {
+                reader.join();
+            }
+            double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            consistent = consistent && initial.searchRange(lowerKey, upperKey) == initialResult;
+            cout << " -> " << (withWriter ? (withReaders ? "Writer and readers" : "Writer alone") : "Readers alone")
+                 << ": ";
+            if (withWriter) {
+                cout << (long long) (writes / elapsed) << " writes/s";
+            }
+            if (withWriter && withReaders) {
+                cout << ", ";
+            }
+            if (withReaders) {
+                cout << (long long) (scans / elapsed) << " range scans/s (" << initialResult.size()
+                     << " records each at the start)";
+            }
+            cout << ", snapshots " << (consistent ? "consistent" : "INCONSISTENT") << ", "
+                 << versionedTree.getFreedNodes() << " nodes freed, " << versionedTree.getRetiredNodes()
+                 << " waiting" << endl;
+        }
+    }
+
+    // remove every key of a tree with small nodes in random order, pinning a snapshot every 16 removals and
+    // checking it 16 snapshots later. Empty nodes are dropped without rebalancing, so the root collapses through
+    // single-child nodes that the pinned snapshots still reach.
+    {
+        VersionedTree versionedTree = VersionedTree(44);
+        vector<int> keys;
+        for (size_t i = 0; i < half; i++) {
+            versionedTree.insert(records[i]->numVotes, records[i]);
+            keys.push_back((int) records[i]->numVotes);
+        }
+        sort(keys.begin(), keys.end());
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+        shuffle(keys.begin(), keys.end(), mt19937(4043));
+
+        deque<pair<Snapshot, size_t>> snapshots;
+        size_t checked = 0;
+        bool consistent = true;
+        for (size_t i = 0; i <= keys.size(); i++) {
+            if (i % 16 == 0 || i == keys.size()) {
+                snapshots.emplace_back(versionedTree.pin(), keys.size() - i);
+            }
+            while (snapshots.size() > (i < keys.size() ? 16 : 0)) {
+                consistent = consistent && snapshots.front().first.countKeys() == snapshots.front().second;
+                snapshots.pop_front();
+                checked++;
+            }
+            if (i < keys.size()) {
+                versionedTree.removeKey(keys[i]);
+            }
+        }
+        cout << " -> Removing all " << keys.size() << " keys, " << checked << " snapshots pinned: snapshots "
+             << (consistent ? "consistent" : "INCONSISTENT") << ", " << versionedTree.getFreedNodes()
+             << " nodes freed" << endl;
+    }
+
+    cout << "===========================================" << endl;
+}
+
+void experimentShardedIngest(Tree *tree, Disk *disk) {
+    /*
+     * Ingests the records into range-partitioned tables with 1 to 8 shards, with as many producer threads as
+     * shards, and checks range scans across the shards against the main index
+     */
+    cout << "EXPERIMENT SHARDED INGEST" << endl;
+
+    vector<Record> records;
+    for (Record *record: indexScan(tree, disk, INT32_MIN, INT32_MAX).records) {
+        records.push_back(*record);
+    }
+    shuffle(records.begin(), records.end(), mt19937(4042));
+    size_t expectedRange = indexScan(tree, disk, 30000, 40000).records.size();
+
+    // the partition boundaries come from a 1% sample of the keys
+    vector<int> sampleKeys;
+    for (size_t i = 0; i < records.size(); i += 100) {
+        sampleKeys.push_back((int) records[i].numVotes);
+    }
+    cout << " -> " << thread::hardware_concurrency() << " hardware threads, boundaries from " << sampleKeys.size()
+         << " sampled keys" << endl;
+
+    double singleShardTime = 0;
+    for (int numShards: {1, 2, 4, 8}) {
+        ShardedTable table = ShardedTable(sampleKeys, numShards, 1000 * 1000, blockSize);
+
+        // every producer routes a contiguous slice of the records
+        auto start = chrono::steady_clock::now();
+        vector<thread> producers;
+        for (int producerIdx = 0; producerIdx < numShards; producerIdx++) {
+            producers.emplace_back([&, producerIdx]() {
+                size_t first = records.size() * producerIdx / numShards;
+                size_t last = records.size() * (producerIdx + 1) / numShards;
+                for (size_t i = first; i < last; i++) {
+                    table.insert(records[i], *disk);
+                }
+            });
+        }
+        for (thread &producer: producers) {
+            producer.join();
+        }
+        table.waitIdle();
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        if (numShards == 1) {
+            singleShardTime = elapsed;
+        }
+
+        // the shards must hold every record, and a range scan across them must come out complete and sorted
+        size_t largestShard = 0, totalRecords = 0;
+        for (int shardIdx = 0; shardIdx < table.getNumShards(); shardIdx++) {
+            largestShard = max(largestShard, table.getShardRecords(shardIdx));
+            totalRecords += table.getShardRecords(shardIdx);
+        }
+        vector<Record *> range = table.searchRange(30000, 40000);
+        bool correct = totalRecords == records.size() && range.size() == expectedRange &&
+                       is_sorted(range.begin(), range.end(), [](Record *a, Record *b) {
+                           return a->numVotes < b->numVotes;
+                       }) && table.searchRange(INT32_MIN, INT32_MAX).size() == records.size();
+
+        cout << " -> " << table.getNumShards() << " shard(s): " << (long long) (records.size() / elapsed)
+             << " inserts/s, speedup " << singleShardTime / elapsed << "x, largest shard "
+             << largestShard * 100 / records.size() << "% of the records, range scans "
+             << (correct ? "correct" : "INCORRECT") << endl;
+    }
+
+    cout << "===========================================" << endl;
+}
+
+void experimentUpdates(Tree *tree, Disk *disk) {
+    /*
+     * Applies a daily refresh of the vote counts (a tenth of the records gain a few votes) to a copy of the
+     * table: by removing and reinserting whole keys, with Tree::update, and with Tree::updateBatch. The index
+     * keeps a histogram, a Bloom filter and aggregates, which are checked against the final records.
+     */
+    cout << "EXPERIMENT IN-PLACE UPDATES" << endl;
+
+    vector<Record> records;
+    for (Record *record: indexScan(tree, disk, INT32_MIN, INT32_MAX).records) {
+        records.push_back(*record);
+    }
+
+    // a tenth of the records, each gaining up to 2% of their votes plus a few
+    mt19937 generator(4043);
+    vector<pair<size_t, int>> refresh;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (generator() % 10 == 0) {
+            int votes = records[i].numVotes;
+            refresh.emplace_back(i, votes + (int) (generator() % (votes / 50 + 1)) + (int) (generator() % 4));
+        }
+    }
+    shuffle(refresh.begin(), refresh.end(), generator);
+
+    double baselineRate = 0;
+    for (int method = 0; method < 3; method++) {
+        Disk updateDisk = Disk((4 * 1000 * 1000), blockSize);
+        Tree updateTree = Tree(blockSize);
+        vector<Record *> copies;
+        for (Record &record: records) {
+            copies.push_back(updateDisk.insertRecord(record, *disk));
+            updateTree.insert(record.numVotes, copies.back());
+        }
+        Histogram histogram = Histogram(100);
+        BloomFilter bloomFilter = BloomFilter(10);
+        updateTree.setHistogram(&histogram);
+        updateTree.setBloomFilter(&bloomFilter);
+        updateTree.setAggregatesEnabled(true);
+
+        // removing whole keys rewrites every record under them, so it only runs on a part of the refresh
+        size_t numUpdates = method == 0 ? refresh.size() / 10 : refresh.size();
+        size_t updated = 0;
+        auto start = chrono::steady_clock::now();
+        if (method == 0) {
+            for (size_t i = 0; i < numUpdates; i++) {
+                Record *record = copies[refresh[i].first];
+                vector<Record *> others = *updateTree.search(record->numVotes, false);
+                others.erase(find(others.begin(), others.end(), record));
+                updateTree.removeKey(record->numVotes);
+                for (Record *other: others) {
+                    updateTree.insert(other->numVotes, other);
+                }
+                record->numVotes = refresh[i].second;
+                updateTree.insert(record->numVotes, record);
+                updated++;
+            }
+        } else if (method == 1) {
+            for (size_t i = 0; i < numUpdates; i++) {
+                updated += updateTree.update(copies[refresh[i].first], refresh[i].second);
+            }
+        } else {
+            vector<pair<Record *, int>> batch;
+            for (size_t i = 0; i < numUpdates; i++) {
+                batch.emplace_back(copies[refresh[i].first], refresh[i].second);
+            }
+            updated = updateTree.updateBatch(batch);
+        }
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        double rate = numUpdates / elapsed;
+        if (method == 0) {
+            baselineRate = rate;
+        }
+
+        // every key must return its records, the aggregates and histogram must match the records on disk
+        map<int, Aggregate> expected;
+        for (Record *record: copies) {
+            expected[(int) record->numVotes].count++;
+            expected[(int) record->numVotes].ratingSum += record->averageRating;
+        }
+        bool correct = updated == numUpdates && histogram.getTotalRecords() == copies.size() &&
+                       checkLeafLinks(&updateTree) &&
+                       checkAggregates(&updateTree, expected, expected.rbegin()->first, 500);
+        for (auto &entry: expected) {
+            vector<Record *> *result = updateTree.search(entry.first, false);
+            correct = correct && result != nullptr && result->size() == entry.second.count;
+        }
+        for (Record &record: records) {
+            correct = correct && (expected.count((int) record.numVotes) > 0) ==
+                                 (updateTree.search(record.numVotes, false) != nullptr);
+        }
+
+        const char *names[] = {"Remove and reinsert keys", "Tree::update", "Tree::updateBatch"};
+        cout << " -> " << names[method] << ": " << numUpdates << " updates, " << (long long) rate
+             << " updates/s, speedup " << rate / baselineRate << "x, index " << (correct ? "correct" : "INCORRECT")
+             << endl;
+    }
+
+    cout << "===========================================" << endl;
+}
+
+void experimentJoins(Tree *tree, Disk *disk) {
+    /*
+     * Loads the ratings into a catalog as two tables, today's ratings and yesterday's (which lacks a fifth of the
+     * titles and has fewer votes), and joins them on tconst with the index nested-loop join and the hash join.
+     * The outer side is today's titles above a numVotes threshold, so the joins cover different selectivities.
+     */
+    cout << "EXPERIMENT JOINS" << endl;
+
+    Catalog catalog;
+    Table *ratings = catalog.createTable("title.ratings", 4 * 1000 * 1000, blockSize);
+    Table *previous = catalog.createTable("title.ratings.previous", 4 * 1000 * 1000, blockSize);
+    mt19937 generator(4044);
+    for (Record *record: indexScan(tree, disk, INT32_MIN, INT32_MAX).records) {
+        string tconst = disk->decodeTconst(record);
+        ratings->insertRecord(tconst, record->averageRating, record->numVotes);
+        if (generator() % 5 != 0) {
+            previous->insertRecord(tconst, record->averageRating, record->numVotes - record->numVotes / 20);
+        }
+    }
+    cout << " -> Tables:";
+    for (const string &name: catalog.getTableNames()) {
+        cout << " " << name << " (" << catalog.getTable(name)->getNumRecords() << " records)";
+    }
+    cout << endl;
+
+    // numVotes thresholds that keep about 0.1%, 1%, 10% and 100% of today's titles
+    vector<Record *> byVotes = indexScan(ratings->getVotesIndex(), ratings->getDisk(), INT32_MIN, INT32_MAX).records;
+    for (double fraction: {0.001, 0.01, 0.1, 1.0}) {
+        int threshold = byVotes[(size_t) ((byVotes.size() - 1) * (1 - fraction))]->numVotes;
+        vector<Record *> outer =
+                indexScan(ratings->getVotesIndex(), ratings->getDisk(), threshold, INT32_MAX).records;
+
+        auto start = chrono::steady_clock::now();
+        JoinResult nestedLoop = indexNestedLoopJoin(outer, ratings, previous);
+        double nestedLoopTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        // the hash join reads the whole inner table
+        start = chrono::steady_clock::now();
+        vector<Record *> inner = sequentialScan(previous->getDisk(), INT32_MIN, INT32_MAX).records;
+        JoinResult hash = hashJoin(outer, ratings, inner, previous);
+        double hashTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        // both must produce the same pairs, with the same tconst on both sides
+        sort(nestedLoop.rows.begin(), nestedLoop.rows.end());
+        sort(hash.rows.begin(), hash.rows.end());
+        bool correct = nestedLoop.rows == hash.rows;
+        for (auto &row: hash.rows) {
+            correct = correct && ratings->getDisk()->decodeTconst(row.first) ==
+                                 previous->getDisk()->decodeTconst(row.second);
+        }
+
+        cout << " -> numVotes >= " << threshold << ": " << outer.size() << " outer rows, " << hash.rows.size()
+             << " joined, index nested-loop " << nestedLoopTime * 1e3 << " ms (" << nestedLoop.indexProbes
+             << " probes), hash join " << hashTime * 1e3 << " ms (" << hash.partitions << " partitions), "
+             << (nestedLoopTime < hashTime ? "nested-loop" : "hash join") << " wins, results "
+             << (correct ? "match" : "DO NOT MATCH") << endl;
+    }
+
+    cout << "===========================================" << endl;
+}
+
+void printLoadReport(const LoadReport &report) {
+    cout << report.requests << " requests in " << report.seconds << " s, " << (long long) report.qps
+         << " QPS, latency p50 " << report.p50Us << " us, p99 " << report.p99Us << " us, p99.9 " << report.p999Us
+         << " us, max " << report.maxUs << " us, " << report.errors << " errors" << endl;
+}
+
+void experimentQueryServer(Tree *tree, Disk *disk) {
+    /*
+     * Serves a copy of the table over a Unix socket, checks a few answers against the index, and drives it with
+     * the load generator at different connection counts and pipeline depths
+     */
+    cout << "EXPERIMENT QUERY SERVER" << endl;
+
+    Disk serverDisk = Disk((4 * 1000 * 1000), blockSize);
+    Tree serverTree = Tree(blockSize);
+    vector<Record *> records = indexScan(tree, disk, INT32_MIN, INT32_MAX).records;
+    for (Record *record: records) {
+        Record *copy = serverDisk.insertRecord(disk->decodeTconst(record), record->averageRating, record->numVotes);
+        serverTree.insert(copy->numVotes, copy);
+    }
+    int pointKey = records[records.size() / 2]->numVotes;
+
+    int numWorkers = max(2, (int) thread::hardware_concurrency());
+    QueryServer server = QueryServer(&serverTree, &serverDisk, numWorkers);
+    string path = "query_server.sock";
+    if (!server.listen(path)) {
+        cout << " -> Unable to listen on " << path << endl;
+        cout << "===========================================" << endl;
+        return;
+    }
+    thread eventLoop(&QueryServer::run, &server);
+
+    // a point query, a range aggregate, and an insert followed by a delete
+    int fd = connectToServer(path);
+    QueryStatus status;
+    vector<unsigned char> request, response;
+    auto appendInt = [&](int32_t value) {
+        request.insert(request.end(), reinterpret_cast<unsigned char *>(&value),
+                       reinterpret_cast<unsigned char *>(&value) + sizeof(value));
+    };
+    auto readInt = [&](size_t offset) {
+        uint32_t value;
+        memcpy(&value, response.data() + offset, sizeof(value));
+        return value;
+    };
+
+    appendInt(pointKey);
+    appendInt(1000);
+    bool correct = sendQuery(fd, 1, QueryOp::POINT, request, &status, &response) &&
+                   readInt(0) == serverTree.search(pointKey, false)->size();
+    request.clear();
+    appendInt(30000);
+    appendInt(40000);
+    correct = correct && sendQuery(fd, 2, QueryOp::AGGREGATE, request, &status, &response) &&
+              readInt(0) == serverTree.aggregateRange(30000, 40000).count;
+    request = {55};
+    appendInt(123456789);
+    request.push_back(9);
+    request.insert(request.end(), {'t', 't', '0', '0', '0', '0', '0', '0', '1'});
+    correct = correct && sendQuery(fd, 3, QueryOp::INSERT, request, &status, &response) && status == QueryStatus::OK;
+    request.clear();
+    appendInt(123456789);
+    correct = correct && sendQuery(fd, 4, QueryOp::DELETE, request, &status, &response) && readInt(0) == 1;
+    close(fd);
+    cout << " -> Point, aggregate, insert and delete over the socket: " << (correct ? "correct" : "INCORRECT")
+         << endl;
+
+    cout << " -> " << numWorkers << " workers, mix of 80% point, 10% range, 5% aggregate, 4% insert, 1% delete"
+         << endl;
+    LoadMix mix;
+    for (pair<int, int> load: {make_pair(1, 1), make_pair(1, 32), make_pair(4, 1), make_pair(4, 32)}) {
+        size_t requestsBefore = server.getRequestsServed(), batchesBefore = server.getBatchesServed();
+        LoadReport report = runLoadGenerator(path, load.first, load.second, 0.5, mix);
+        size_t batches = server.getBatchesServed() - batchesBefore;
+        cout << " -> " << load.first << " connection(s), pipeline depth " << load.second << ": ";
+        printLoadReport(report);
+        cout << "    " << (double) (server.getRequestsServed() - requestsBefore) / max((size_t) 1, batches)
+             << " requests per batch" << endl;
+    }
+
+    server.stop();
+    eventLoop.join();
+    cout << "===========================================" << endl;
+}
+
+void experimentExternalSort() {
+    /*
+     * Loads the data file into a fresh disk and index through the external sorter and the bulk loader, for a
+     * range of memory budgets, and compares with inserting the records one by one in file order. The sorted
+     * output goes straight to the disk, so the records also end up clustered by numVotes.
+     */
+    cout << "EXPERIMENT EXTERNAL SORT" << endl;
+
+    struct Row {
+        string tconst;
+        unsigned char averageRating;
+        int numVotes;
+    };
+    vector<Row> rows;
+    map<int, int> expectedCounts;
+    ifstream data_file("../data/data.tsv");
+    string line;
+    getline(data_file, line);
+    while (getline(data_file, line)) {
+        istringstream iss(line);
+        string tconst, averageRating, numVotes;
+        getline(iss, tconst, '\t');
+        getline(iss, averageRating, '\t');
+        getline(iss, numVotes, '\t');
+        rows.push_back(Row{tconst, (unsigned char) (stof(averageRating) * 10), stoi(numVotes)});
+        expectedCounts[rows.back().numVotes]++;
+    }
+    cout << " -> " << rows.size() << " records, " << rows.size() * sizeof(Record) / 1024 << " KB of record data"
+         << endl;
+
+    // baseline, one insert per record
+    {
+        Disk loadDisk = Disk((4 * 1000 * 1000), blockSize);
+        Tree loadTree = Tree(blockSize);
+        auto start = chrono::steady_clock::now();
+        for (Row &row: rows) {
+            Record *record = loadDisk.insertRecord(row.tconst, row.averageRating, row.numVotes);
+            loadTree.insert(record->numVotes, record);
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << " -> Insert one by one: " << seconds * 1e3 << " ms, " << (long long) (rows.size() / seconds)
+             << " records/s, " << loadTree.countNodes() << " nodes, clustering ratio "
+             << getClusteringRatio(&loadTree, &loadDisk) << endl;
+    }
+
+    for (auto [budget, threads]: vector<pair<size_t, int>>{{64 * 1024, 1}, {256 * 1024, 1}, {1024 * 1024, 1},
+                                                          {1024 * 1024, 2}, {4 * 1024 * 1024, 1}}) {
+        Disk loadDisk = Disk((4 * 1000 * 1000), blockSize);
+        Tree loadTree = Tree(blockSize);
+        auto start = chrono::steady_clock::now();
+
+        ExternalSorter sorter = ExternalSorter("external_sort_", budget, threads);
+        for (Row &row: rows) {
+            sorter.add(Record{loadDisk.encodeTconst(row.tconst), row.averageRating, row.numVotes});
+        }
+        bool sorted = sorter.finish();
+        double sortSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        // the merge output is written to the disk as it is pulled into the leaves. A failed sort or a full disk
+        // hands out a null record, which aborts the load.
+        bool loaded = sorted && loadTree.bulkLoad([&](int &key, Record *&pRecord) {
+            Record record;
+            if (!sorter.next(record)) {
+                pRecord = nullptr;
+                return sorter.isFailed();
+            }
+            pRecord = loadDisk.insertRecord(record);
+            key = record.numVotes;
+            return true;
+        });
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        // every key with the right number of records, in order through the leaf chain
+        map<int, int> counts;
+        Node *leaf = loadTree.getRoot();
+        while (leaf != nullptr && !leaf->isLeafNode) {
+            leaf = leaf->pointer.pNode[0];
+        }
+        for (; leaf != nullptr; leaf = leaf->pNextLeaf) {
+            for (size_t i = 0; i < leaf->keys.size(); i++) {
+                counts[leaf->keys[i]] += (int) leaf->pointer.pData[i].size();
+            }
+        }
+        bool correct = loaded && counts == expectedCounts && checkLeafLinks(&loadTree);
+
+        cout << " -> Budget " << budget / 1024 << " KB, " << threads << " thread(s): " << sorter.getRunsWritten()
+             << " runs, " << sorter.getMergePasses() << " merge passes, " << sorter.getBytesSpilled() / 1024
+             << " KB spilled, sort " << sortSeconds * 1e3 << " ms, sort + load " << seconds * 1e3 << " ms, "
+             << (long long) (rows.size() / seconds) << " records/s, " << loadTree.countNodes()
+             << " nodes, clustering ratio " << getClusteringRatio(&loadTree, &loadDisk) << ", index "
+             << (correct ? "correct" : "INCORRECT") << (sorter.isFailed() ? " (SORT FAILED)" : "") << endl;
+    }
+
+    cout << "===========================================" << endl;
+}
+
+void experimentParallelIndexScan(Tree *tree, Disk *disk) {
+    /*
+     * Runs wide numVotes range queries through the index on 1 to N worker threads, once collecting the records
+     * and once only computing COUNT / AVG(averageRating), and checks both against a single-threaded index scan
+     */
+    cout << "EXPERIMENT PARALLEL INDEX SCAN" << endl;
+
+    int maxThreads = max(1, (int) thread::hardware_concurrency());
+    for (auto [key1, key2]: vector<pair<int, int>>{{30000, 40000}, {0, 1000000}}) {
+        auto start = chrono::steady_clock::now();
+        vector<Record *> expected = indexScan(tree, disk, key1, key2).records;
+        double serialTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        long long expectedSum = 0;
+        for (Record *record: expected) {
+            expectedSum += record->averageRating;
+        }
+        cout << " -> numVotes in [" << key1 << ", " << key2 << "]: " << expected.size()
+             << " records, index scan " << serialTime * 1e3 << " ms" << endl;
+
+        for (int numThreads = 1;; numThreads = min(numThreads * 2, maxThreads)) {
+            ThreadPool pool(numThreads);
+            ScanAggregate collected, aggregate;
+
+            // keep the best of a few runs
+            double collectTime = 0, aggregateTime = 0;
+            for (int run = 0; run < 5; run++) {
+                start = chrono::steady_clock::now();
+                collected = parallelIndexRangeScan(tree, &pool, key1, key2, true);
+                double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                collectTime = run == 0 ? elapsed : min(collectTime, elapsed);
+
+                start = chrono::steady_clock::now();
+                aggregate = parallelIndexRangeScan(tree, &pool, key1, key2, false);
+                elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+                aggregateTime = run == 0 ? elapsed : min(aggregateTime, elapsed);
+            }
+            bool correct = collected.records == expected && aggregate.count == expected.size() &&
+                           (long long) aggregate.ratingSum == expectedSum;
+
+            cout << "    " << numThreads << " thread(s), "
+                 << splitKeyRange(tree, key1, key2, numThreads * 4).size() + 1 << " parts: collect "
+                 << collectTime * 1e3 << " ms, aggregate " << aggregateTime * 1e3 << " ms (average rating "
+                 << aggregate.getAverageRating() << "), results " << (correct ? "match" : "DO NOT MATCH") << endl;
+
+            if (numThreads == maxThreads) {
+                break;
+            }
+        }
+    }
+
+    cout << "===========================================" << endl;
+}
+
+void experimentIndexEngines(Disk *disk) {
+    /*
+     * Builds the B+ tree and the adaptive radix tree through the Index interface on two keys, numVotes (few
+     * distinct keys with long posting lists) and tconst (unique keys), and compares build time, point lookups,
+     * range scans, removals and memory. Both engines must return the same results.
+     */
+    cout << "EXPERIMENT INDEX ENGINES" << endl;
+
+    vector<Record *> records = sequentialScan(disk, INT32_MIN, INT32_MAX).records;
+    mt19937 generator(4048);
+
+    for (bool byTconst: {false, true}) {
+        auto keyOf = [&](Record *record) { return byTconst ? (int) record->tconst : record->numVotes; };
+        cout << " -> Key " << (byTconst ? "tconst" : "numVotes") << ":" << endl;
+
+        // half of the lookups hit a key, half miss
+        vector<int> keys;
+        for (Record *record: records) {
+            keys.push_back(keyOf(record));
+        }
+        sort(keys.begin(), keys.end());
+        keys.erase(unique(keys.begin(), keys.end()), keys.end());
+        vector<int> lookups;
+        uniform_int_distribution<int> anyKey(keys.front(), keys.back());
+        for (int i = 0; i < 200000; i++) {
+            lookups.push_back(i % 2 == 0 ? keys[generator() % keys.size()] : anyKey(generator));
+        }
+        vector<pair<int, int>> ranges;
+        for (int i = 0; i < 2000; i++) {
+            size_t first = generator() % keys.size();
+            ranges.emplace_back(keys[first], keys[min(keys.size() - 1, first + 50)]);
+        }
+
+        Tree tree = Tree(blockSize);
+        TreeIndex treeIndex = TreeIndex(&tree);
+        ArtIndex artIndex;
+        vector<long long> checksums;
+        for (Index *index: vector<Index *>{&treeIndex, &artIndex}) {
+            auto start = chrono::steady_clock::now();
+            for (Record *record: records) {
+                index->insert(keyOf(record), record);
+            }
+            double buildTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            size_t memory = index->getMemoryUsage();
+
+            long long checksum = 0;
+            start = chrono::steady_clock::now();
+            for (int key: lookups) {
+                vector<Record *> *result = index->search(key);
+                checksum += result == nullptr ? -1 : (long long) result->size();
+            }
+            double lookupTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            start = chrono::steady_clock::now();
+            for (auto [lowerKey, upperKey]: ranges) {
+                index->scanRange(lowerKey, upperKey, [&](int key, vector<Record *> &postings) {
+                    checksum += key % 1000 + (long long) postings.size();
+                });
+            }
+            double scanTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            // remove every other key
+            start = chrono::steady_clock::now();
+            for (size_t i = 0; i < keys.size(); i += 2) {
+                index->removeKey(keys[i]);
+            }
+            double removeTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            checksum += (long long) index->scanRange(INT32_MIN, INT32_MAX, [](int, vector<Record *> &) {});
+            checksums.push_back(checksum);
+
+            cout << "    " << index->getName() << ": build " << buildTime * 1e3 << " ms, " << memory / 1024
+                 << " KB, lookup " << lookupTime / lookups.size() * 1e9 << " ns, range scan "
+                 << scanTime / ranges.size() * 1e6 << " us, remove " << removeTime / ((keys.size() + 1) / 2) * 1e9
+                 << " ns per key" << endl;
+        }
+
+        vector<size_t> nodeCounts = artIndex.countNodes();
+        cout << "    " << keys.size() << " distinct keys, ART inner nodes after removals (Node4 / 16 / 48 / 256): "
+             << nodeCounts[0] << " / " << nodeCounts[1] << " / " << nodeCounts[2] << " / " << nodeCounts[3]
+             << ", results " << (checksums[0] == checksums[1] ? "match" : "DO NOT MATCH") << endl;
+    }
+
+    cout << "===========================================" << endl;
+}
+
+void printIngestReport(const IngestReport &report) {
+    cout << report.rows << " rows in " << report.seconds << " s, " << (long long) report.rowsPerSecond
+         << " rows/s, " << report.batches << " batches (largest " << report.largestBatch << "), " << report.stalls
+         << " stalls (" << report.stallSeconds * 1e3 << " ms), latency p50 " << report.p50Us << " us, p99 "
+         << report.p99Us << " us, p99.9 " << report.p999Us << " us, max " << report.maxUs << " us, "
+         << report.parseErrors << " parse errors, " << report.droppedRows << " dropped" << endl;
+}
+
+void experimentStreamingIngest() {
+    /*
+     * Streams the data file into a fresh disk and index through StreamIngest: from a complete file without
+     * batching, with micro-batches, and with a small queue that forces back-pressure, and then from a file that
+     * a writer thread appends to in bursts while the ingest follows it
+     */
+    cout << "EXPERIMENT STREAMING INGEST" << endl;
+
+    ifstream data_file("../data/data.tsv");
+    vector<string> lines;
+    string line;
+    while (getline(data_file, line)) {
+        lines.push_back(line);
+    }
+    const string path = "stream_ingest.tsv";
+
+    struct IngestRun {
+        const char *name;
+        size_t queueCapacity;
+        size_t maxBatchSize;
+        bool throttled;
+    };
+    for (IngestRun run: {IngestRun{"one row per batch", 65536, 1, false},
+                         IngestRun{"micro-batches", 65536, 4096, false},
+                         IngestRun{"micro-batches, 1024 row queue", 1024, 4096, false},
+                         IngestRun{"growing file, 2000 rows per 5 ms", 65536, 4096, true}}) {
+        ofstream output(path, ios::trunc);
+        if (!run.throttled) {
+            for (string &row: lines) {
+                output << row << '\n';
+            }
+        }
+        output.flush();
+
+        Disk ingestDisk = Disk((4 * 1000 * 1000), blockSize);
+        Tree ingestTree = Tree(blockSize);
+        StreamIngest ingest = StreamIngest(&ingestDisk, &ingestTree, run.queueCapacity, run.maxBatchSize);
+        if (!ingest.start(path, run.throttled)) {
+            cout << " -> Unable to open " << path << endl;
+            break;
+        }
+        if (run.throttled) {
+            for (size_t first = 0; first < lines.size(); first += 2000) {
+                for (size_t i = first; i < min(lines.size(), first + 2000); i++) {
+                    output << lines[i] << '\n';
+                }
+                output.flush();
+                this_thread::sleep_for(chrono::milliseconds(5));
+            }
+            ingest.stop();
+        }
+        IngestReport report = ingest.wait();
+
+        bool correct = true;
+        ingest.read([&](Tree *tree, Disk *disk) {
+            correct = indexScan(tree, disk, INT32_MIN, INT32_MAX).records.size() == lines.size() - 1 &&
+                      checkLeafLinks(tree);
+        });
+        cout << " -> " << run.name << ": ";
+        printIngestReport(report);
+        cout << "    index " << (correct ? "complete" : "INCOMPLETE") << endl;
+    }
+    remove(path.c_str());
+
+    cout << "===========================================" << endl;
+}
+
+void experimentDeferredDeletes(Disk *disk) {
+    /*
+     * Deletes half of the titles from an index on tconst, one key at a time, with eager rebalancing, with
+     * tombstones purged by the background compactor, and with tombstones purged in one batch at the end.
+     * Reports the delete latency percentiles and the cost of the compaction, and checks the index afterwards.
+     */
+    cout << "EXPERIMENT DEFERRED DELETES" << endl;
+
+    vector<pair<int, Record *>> entries;
+    for (Record *record: sequentialScan(disk, INT32_MIN, INT32_MAX).records) {
+        entries.emplace_back((int) record->tconst, record);
+    }
+    sort(entries.begin(), entries.end());
+    vector<int> deleteKeys;
+    for (size_t i = 0; i < entries.size(); i += 2) {
+        deleteKeys.push_back(entries[i].first);
+    }
+    shuffle(deleteKeys.begin(), deleteKeys.end(), mt19937(4050));
+
+    for (int mode = 0; mode < 3; mode++) {
+        Tree deleteTree = Tree(blockSize);
+        size_t next = 0;
+        deleteTree.bulkLoad([&](int &key, Record *&pRecord) {
+            if (next == entries.size()) {
+                return false;
+            }
+            key = entries[next].first;
+            pRecord = entries[next++].second;
+            return true;
+        });
+        deleteTree.setDeferredDeletes(mode > 0);
+        int nodesBefore = deleteTree.countNodes();
+
+        mutex treeLatch;
+        unique_ptr<TombstoneCompactor> compactor;
+        if (mode == 1) {
+            compactor = make_unique<TombstoneCompactor>(&deleteTree, treeLatch);
+        }
+
+        vector<double> latencies;
+        auto start = chrono::steady_clock::now();
+        for (int key: deleteKeys) {
+            auto deleteStart = chrono::steady_clock::now();
+            {
+                lock_guard<mutex> lock(treeLatch);
+                deleteTree.removeKey(key);
+            }
+            latencies.push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - deleteStart).count());
+        }
+        double deleteTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        // deleted keys are invisible right away, even while their tombstones are still in the leaves
+        bool correct = true;
+        {
+            lock_guard<mutex> lock(treeLatch);
+            for (size_t i = 0; i < deleteKeys.size(); i += 97) {
+                correct = correct && deleteTree.search(deleteKeys[i], false) == nullptr;
+            }
+            correct = correct && indexScan(&deleteTree, disk, INT32_MIN, INT32_MAX).records.size() ==
+                                 entries.size() - deleteKeys.size();
+        }
+        size_t tombstones = deleteTree.getTombstones();
+
+        // purge the tombstones, in the background or in one batch
+        start = chrono::steady_clock::now();
+        if (mode == 1) {
+            while (true) {
+                {
+                    lock_guard<mutex> lock(treeLatch);
+                    if (deleteTree.getTombstones() == 0) {
+                        break;
+                    }
+                }
+                this_thread::sleep_for(chrono::microseconds(200));
+            }
+            compactor.reset();
+        } else if (mode == 2) {
+            deleteTree.setDeferredDeletes(false);
+        }
+        double compactTime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        for (size_t i = 0; i < entries.size(); i++) {
+            vector<Record *> *result = deleteTree.search(entries[i].first, false);
+            correct = correct && (i % 2 == 0 ? result == nullptr : result != nullptr && result->size() == 1);
+        }
+        correct = correct && deleteTree.getTombstones() == 0 && checkLeafLinks(&deleteTree);
+
+        sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) {
+            return latencies[min(latencies.size() - 1, (size_t) (p * latencies.size()))];
+        };
+        const char *names[] = {"eager rebalancing", "tombstones, background compactor", "tombstones, batch compaction"};
+        cout << " -> " << names[mode] << ": " << deleteKeys.size() << " deletes in " << deleteTime * 1e3 << " ms, p50 "
+             << percentile(0.5) << " us, p99 " << percentile(0.99) << " us, p99.9 " << percentile(0.999)
+             << " us, max " << latencies.back() << " us" << endl;
+        cout << "    " << tombstones << " tombstones left after the deletes, purged in " << compactTime * 1e3
+             << " ms, nodes " << nodesBefore << " -> " << deleteTree.countNodes() << ", index "
+             << (correct ? "correct" : "INCORRECT") << endl;
+    }
+
+    cout << "===========================================" << endl;
+}
+
+static QueryServer *activeServer = nullptr;
+
+static StreamIngest *activeIngest = nullptr;
+
+static void stopServer(int) {
+    if (activeServer != nullptr) {
+        activeServer->stop();
+    }
+    if (activeIngest != nullptr) {
+        activeIngest->stop();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    // "main client <socket> [connections] [pipeline depth] [seconds]" drives a running server
+    if (argc >= 3 && string(argv[1]) == "client") {
+        LoadReport report = runLoadGenerator(argv[2], argc > 3 ? atoi(argv[3]) : 4, argc > 4 ? atoi(argv[4]) : 16,
+                                             argc > 5 ? atof(argv[5]) : 5, LoadMix());
+        printLoadReport(report);
+        return report.errors == 0 ? 0 : 1;
+    }
+
+    // instantiate a disk that grows in extents of 4MB
+    Disk disk = Disk((4 * 1000 * 1000), blockSize);
+    disk.printInfo();
+
+    // instantiate an empty b+ tree
+    Tree tree = Tree(blockSize);
+    tree.printInfo();
+
+    // "main serve <socket>" loads the data once and answers queries until interrupted
+    if (argc >= 3 && string(argv[1]) == "serve") {
+        experiment12(&tree, &disk);
+        QueryServer server = QueryServer(&tree, &disk, max(2, (int) thread::hardware_concurrency()));
+        if (!server.listen(argv[2])) {
+            cout << "Unable to listen on " << argv[2] << endl;
+            return 1;
+        }
+        activeServer = &server;
+        signal(SIGINT, stopServer);
+        signal(SIGTERM, stopServer);
+        cout << "Serving on " << argv[2] << ", Ctrl-C to stop" << endl;
+        server.run();
+        cout << "Served " << server.getRequestsServed() << " requests" << endl;
+        return 0;
+    }
+
+    // "main ingest <file | -> [follow]" streams rows into the index, following the file until interrupted
+    if (argc >= 3 && string(argv[1]) == "ingest") {
+        StreamIngest ingest = StreamIngest(&disk, &tree);
+        bool follow = argc > 3 && string(argv[3]) == "follow";
+        if (!ingest.start(argv[2], follow)) {
+            cout << "Unable to open " << argv[2] << endl;
+            return 1;
+        }
+        activeIngest = &ingest;
+        signal(SIGINT, stopServer);
+        signal(SIGTERM, stopServer);
+        cout << "Ingesting from " << argv[2] << (follow ? ", Ctrl-C to stop" : "") << endl;
+        printIngestReport(ingest.wait());
+        activeIngest = nullptr;
+        cout << " -> No of nodes in the B+ Tree: " << tree.countNodes() << endl;
+        return 0;
+    }
+
+    // run experiment 1 and 2
+    experiment12(&tree, &disk);
+
+    // build the numVotes histogram from the leaf chain, it is kept up to date from here on
+    Histogram histogram = Histogram(100);
+    tree.setHistogram(&histogram);
+
+    // run experiment 3
+    experiment3(&tree, &disk);
+
+    // run experiment 4
+    experiment4(&tree, &disk);
+    experiment4Bitmap(&tree, &disk);
+
+    // run experiment 5
+    experiment5(&tree, &disk);
+
+    // let the planner pick the access path for range queries
+    experimentPlanner(&tree, &disk);
+
+    // scan the blocks for a non-indexed predicate on 1 to N threads
+    experimentParallelScan(&disk);
+
+    // reorder the records on disk by numVotes
+    experimentCluster(&tree, &disk);
+
+    // scan a file-backed copy of the disk with asynchronous block reads
+    experimentAsyncIO(&tree, &disk);
+
+    // rebuild the index with plain and buffered inserts
+    experimentBufferedIngest(&disk);
+
+    // disk setup time and lookup latency with regular and huge pages
+    experimentDiskAllocation(&disk);
+
+    // piecewise-linear learned index next to the B+ tree
+    experimentLearnedIndex(&tree, &disk);
+
+    // read-only snapshot of the tree in an Eytzinger layout
+    experimentFrozenTree(&tree, &disk);
+
+    // Bloom filter in front of the index for absent keys
+    experimentBloomFilter(&disk);
+
+    // descending scan for ORDER BY numVotes DESC LIMIT k
+    experimentTopK(&tree, &disk);
+
+    // range COUNT / SUM / AVG from per-child aggregates
+    experimentAggregates(&tree, &disk);
+
+    // range scans on snapshots of a copy-on-write index next to a writer
+    experimentVersionedTree(&tree, &disk);
+
+    // ingest into range-partitioned shards with one worker each
+    experimentShardedIngest(&tree, &disk);
+
+    // daily vote count refresh with in-place updates
+    experimentUpdates(&tree, &disk);
+
+    // join two tables on tconst
+    experimentJoins(&tree, &disk);
+
+    // resident query server driven by the load generator
+    experimentQueryServer(&tree, &disk);
+
+    // load a fresh index through the external sorter and the bulk loader
+    experimentExternalSort();
+
+    // wide index range scans split across worker threads
+    experimentParallelIndexScan(&tree, &disk);
+
+    // B+ tree and adaptive radix tree behind the common index interface
+    experimentIndexEngines(&disk);
+
+    // continuous ingest from a growing file with micro-batched index maintenance
+    experimentStreamingIngest();
+
+    // tombstone deletes with background compaction against eager rebalancing
+    experimentDeferredDeletes(&disk);
+
+#if TRACE_LEVEL > TRACE_LEVEL_OFF
+    // write the trace events recorded during the run
+    if (Tracer::instance().dumpChromeTrace("trace.json")) {
+        cout << "Trace written to trace.json (" << Tracer::instance().getEventCount() << " events)" << endl;
+    }
+#endif
 
     cout << "End of program! " << endl;
 }
@@ -0,0 +1,122 @@
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+template<typename T>
+class MpscQueue {
+    /*
+     * Bounded lock-free queue for many producers and a single consumer.
+     *
+     * Every cell carries a sequence number: a cell at position pos is free for a producer when its sequence is pos,
+     * and holds a value for the consumer when it is pos + 1. Producers claim positions by advancing the tail with a
+     * compare-and-swap, the consumer owns the head and never contends with anyone.
+     */
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    alignas(64) std::atomic<size_t> tail;  // next position for the producers
+    alignas(64) size_t head;               // next position for the consumer
+
+    Cell *claim(size_t &pos) {
+        /*
+         * Claims the cell at the tail for a producer, returns nullptr if the queue is full
+         */
+        pos = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell *cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            auto diff = (ptrdiff_t) (sequence - pos);
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    return cell;
+                }
+            } else if (diff < 0) {
+                // the consumer has not freed this cell yet
+                return nullptr;
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+public:
+    explicit MpscQueue(size_t capacity) {
+        /*
+         * Constructor for an empty queue, the capacity is rounded up to a power of two
+         */
+        size_t size = 2;
+        while (size < capacity) {
+            size *= 2;
+        }
+        cells = std::make_unique<Cell[]>(size);
+        for (size_t i = 0; i < size; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        mask = size - 1;
+        tail.store(0, std::memory_order_relaxed);
+        head = 0;
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    bool push(const T &value) {
+        /*
+         * Appends a copy of a value, returns false if the queue is full. Safe to call from any thread.
+         */
+        size_t pos;
+        Cell *cell = claim(pos);
+        if (cell == nullptr) {
+            return false;
+        }
+        cell->value = value;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool push(T &&value) {
+        /*
+         * Moves a value into the queue, returns false if the queue is full. The value is only moved from once a
+         * cell has been claimed, so a caller can retry with the same value after a failed push.
+         */
+        size_t pos;
+        Cell *cell = claim(pos);
+        if (cell == nullptr) {
+            return false;
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &value) {
+        /*
+         * Takes the oldest value, returns false if the queue is empty. Only the consumer thread may call this.
+         */
+        Cell *cell = &cells[head & mask];
+        if (cell->sequence.load(std::memory_order_acquire) != head + 1) {
+            return false;
+        }
+        value = std::move(cell->value);
+        cell->sequence.store(head + mask + 1, std::memory_order_release);
+        head++;
+        return true;
+    }
+
+    bool empty() {
+        // only meaningful on the consumer thread
+        return cells[head & mask].sequence.load(std::memory_order_acquire) != head + 1;
+    }
+};
+
+#endif
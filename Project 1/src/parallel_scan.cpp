@@ -0,0 +1,181 @@
+#include "parallel_scan.h"
+
+#include <algorithm>
+
+using namespace std;
+
+void ScanAggregate::merge(const ScanAggregate &other) {
+    count += other.count;
+    ratingSum += other.ratingSum;
+    minVotes = min(minVotes, other.minVotes);
+    maxVotes = max(maxVotes, other.maxVotes);
+    records.insert(records.end(), other.records.begin(), other.records.end());
+}
+
+double ScanAggregate::getAverageRating() {
+    return count == 0 ? 0 : ((double) ratingSum / 10) / count;
+}
+
+// partial result owned by one worker, padded so that workers never share a cache line
+struct alignas(64) WorkerPartial {
+    ScanAggregate aggregate;
+};
+
+static void scanMorsel(Disk *disk, const RecordFilter &filter, bool collectRecords, size_t firstBlock,
+                       size_t lastBlock, ScanAggregate &partial) {
+    /*
+     * Scans the blocks [firstBlock, lastBlock) and accumulates the qualifying records into partial
+     */
+    for (size_t blockIdx = firstBlock; blockIdx < lastBlock; blockIdx++) {
+        size_t recordsInBlock = disk->getRecordsInBlock(blockIdx);
+
+        for (size_t recordIdx = 0; recordIdx < recordsInBlock; recordIdx++) {
+            Record *record = disk->getRecord(blockIdx, recordIdx);
+            if (record->averageRating < filter.minRating || record->averageRating > filter.maxRating ||
+                record->numVotes < filter.minVotes || record->numVotes > filter.maxVotes ||
+                disk->isDeleted(blockIdx, recordIdx)) {
+                continue;
+            }
+
+            partial.count++;
+            partial.ratingSum += record->averageRating;
+            partial.minVotes = min(partial.minVotes, (int) record->numVotes);
+            partial.maxVotes = max(partial.maxVotes, (int) record->numVotes);
+            if (collectRecords) {
+                partial.records.push_back(record);
+            }
+        }
+    }
+}
+
+ScanAggregate parallelSequentialScan(Disk *disk, ThreadPool *pool, const RecordFilter &filter, bool collectRecords,
+                                     size_t morselBlocks) {
+    /*
+     * Scans every block in use in parallel. The block range is cut into morsels that are dealt out to the workers
+     * round-robin; workers that finish early steal the remaining morsels of the others. Each worker accumulates
+     * into its own partial result, and the partials are merged once all morsels are done.
+     *
+     * Collected records come out grouped by worker, not in block order.
+     */
+    size_t blocksUsed = disk->getBlocksUsed();
+    morselBlocks = max((size_t) 1, morselBlocks);
+
+    vector<WorkerPartial> partials(pool->getNumThreads());
+
+    int morselIdx = 0;
+    for (size_t firstBlock = 0; firstBlock < blocksUsed; firstBlock += morselBlocks) {
+        size_t lastBlock = min(blocksUsed, firstBlock + morselBlocks);
+        pool->submit(morselIdx++, [=, &filter, &partials]() {
+            scanMorsel(disk, filter, collectRecords, firstBlock, lastBlock,
+                       partials[ThreadPool::getWorkerIdx()].aggregate);
+        });
+    }
+    pool->waitIdle();
+
+    // merge the thread-local partial results
+    ScanAggregate result;
+    for (WorkerPartial &partial: partials) {
+        result.merge(partial.aggregate);
+    }
+    return result;
+}
+
+vector<int> splitKeyRange(Tree *tree, int lowerKey, int upperKey, int numParts) {
+    /*
+     * Cuts [lowerKey, upperKey] into sub-ranges that cover about the same number of leaves. The separator keys
+     * inside the range are collected level by level, going one level deeper as long as there are fewer than 4
+     * per part and the level above the leaves has not been reached. Consecutive separators bound subtrees of
+     * the same height, which hold about the same number of keys, so every part gets an even share of them.
+     */
+    vector<int> bounds;
+    Node *rootNode = tree->getRoot();
+    if (rootNode == nullptr || numParts <= 1 || lowerKey >= upperKey) {
+        return bounds;
+    }
+
+    vector<int> separators;
+    vector<Node *> level = {rootNode};
+    while (!level.empty() && !level[0]->isLeafNode && separators.size() < 4 * (size_t) numParts) {
+        vector<Node *> children;
+        for (Node *node: level) {
+            // the children whose key range overlaps [lowerKey, upperKey], and the separators between them
+            int first = upper_bound(node->keys.begin(), node->keys.end(), lowerKey) - node->keys.begin();
+            int last = upper_bound(node->keys.begin(), node->keys.end(), upperKey) - node->keys.begin();
+            separators.insert(separators.end(), node->keys.begin() + first, node->keys.begin() + last);
+            children.insert(children.end(), node->pointer.pNode.begin() + first,
+                            node->pointer.pNode.begin() + last + 1);
+        }
+        level.swap(children);
+    }
+    sort(separators.begin(), separators.end());
+
+    // part p starts at subtree p x subtrees / numParts
+    size_t subtrees = separators.size() + 1;
+    size_t previous = 0;
+    for (int part = 1; part < numParts; part++) {
+        size_t subtree = part * subtrees / numParts;
+        if (subtree > previous) {
+            bounds.push_back(separators[subtree - 1]);
+            previous = subtree;
+        }
+    }
+    return bounds;
+}
+
+static void scanKeyRange(Tree *tree, int lowerKey, int upperKey, bool collectRecords, ScanAggregate &partial) {
+    /*
+     * Descends to the leaf of lowerKey and walks the leaf chain up to upperKey, accumulating into partial
+     */
+    Node *currentNode = tree->searchNode(lowerKey, false);
+    if (currentNode == nullptr) {
+        return;
+    }
+    auto idx = lower_bound(currentNode->keys.begin(), currentNode->keys.end(), lowerKey) - currentNode->keys.begin();
+
+    for (; currentNode != nullptr; currentNode = currentNode->pNextLeaf, idx = 0) {
+        for (auto i = idx; i < currentNode->keys.size(); i++) {
+            if (currentNode->keys[i] > upperKey) {
+                return;
+            }
+            for (Record *record: currentNode->pointer.pData[i]) {
+                partial.count++;
+                partial.ratingSum += record->averageRating;
+                partial.minVotes = min(partial.minVotes, (int) record->numVotes);
+                partial.maxVotes = max(partial.maxVotes, (int) record->numVotes);
+                if (collectRecords) {
+                    partial.records.push_back(record);
+                }
+            }
+        }
+    }
+}
+
+ScanAggregate parallelIndexRangeScan(Tree *tree, ThreadPool *pool, int lowerKey, int upperKey, bool collectRecords,
+                                     int partsPerThread) {
+    /*
+     * Scans the index range in parallel. The range is split with splitKeyRange into several parts per worker,
+     * so that workers that finish early can steal the rest, and every part descends to its first leaf and walks
+     * the leaf chain on its own. Each part accumulates into its own partial result, and the partials are merged
+     * in key order, so collected records come out in key order as with indexScan.
+     */
+    // the leaf chain only reflects buffered inserts and removals once they are applied
+    tree->flushAllBuffers();
+
+    vector<int> bounds = splitKeyRange(tree, lowerKey, upperKey, pool->getNumThreads() * max(1, partsPerThread));
+    vector<WorkerPartial> partials(bounds.size() + 1);
+
+    for (size_t part = 0; part < partials.size(); part++) {
+        int partLower = part == 0 ? lowerKey : bounds[part - 1];
+        int partUpper = part == bounds.size() ? upperKey : bounds[part] - 1;
+        pool->submit((int) part, [=, &partials]() {
+            scanKeyRange(tree, partLower, partUpper, collectRecords, partials[part].aggregate);
+        });
+    }
+    pool->waitIdle();
+
+    ScanAggregate result;
+    for (WorkerPartial &partial: partials) {
+        result.merge(partial.aggregate);
+    }
+    return result;
+}
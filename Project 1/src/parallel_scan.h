@@ -0,0 +1,43 @@
+#ifndef PARALLEL_SCAN_H
+#define PARALLEL_SCAN_H
+
+#include <climits>
+#include <cstddef>
+#include <vector>
+#include "dtypes.h"
+#include "disk.h"
+#include "tree.h"
+#include "thread_pool.h"
+
+struct RecordFilter {
+    // inclusive bounds, averageRating in tenths (as stored in Record)
+    int minRating = 0;
+    int maxRating = 255;
+    int minVotes = INT_MIN;
+    int maxVotes = INT_MAX;
+};
+
+struct ScanAggregate {
+    size_t count = 0;
+    unsigned long long ratingSum = 0;  // in tenths
+    int minVotes = INT_MAX;
+    int maxVotes = INT_MIN;
+    std::vector<Record *> records;  // only filled when the records are collected
+
+    void merge(const ScanAggregate &other);
+
+    double getAverageRating();
+};
+
+// splits [0, getBlocksUsed()) into morsels of morselBlocks blocks and scans them on the pool
+ScanAggregate parallelSequentialScan(Disk *disk, ThreadPool *pool, const RecordFilter &filter, bool collectRecords,
+                                     size_t morselBlocks = 256);
+
+// start keys of up to numParts - 1 sub-ranges after the first, taken from the separator keys of the index
+std::vector<int> splitKeyRange(Tree *tree, int lowerKey, int upperKey, int numParts);
+
+// scans [lowerKey, upperKey] through the leaf chain, split into partsPerThread sub-ranges per worker
+ScanAggregate parallelIndexRangeScan(Tree *tree, ThreadPool *pool, int lowerKey, int upperKey, bool collectRecords,
+                                     int partsPerThread = 4);
+
+#endif
@@ -0,0 +1,89 @@
+#include "planner.h"
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+// cost of reading a block out of order, relative to a sequential block read
+const double randomBlockCost = 4.0;
+
+// cost of evaluating the predicate on one record, relative to a sequential block read
+const double recordCpuCost = 0.01;
+
+// leaves are assumed to be this full on average
+const double leafFillFactor = 0.7;
+
+const char *getAccessPathName(AccessPath accessPath) {
+    switch (accessPath) {
+        case AccessPath::INDEX_SCAN:
+            return "index scan";
+        case AccessPath::BITMAP_HEAP_SCAN:
+            return "bitmap heap scan";
+        case AccessPath::SEQUENTIAL_SCAN:
+            return "sequential scan";
+    }
+    return "unknown";
+}
+
+Plan planRangeQuery(Tree *tree, Disk *disk, int lowerKey, int upperKey) {
+    /*
+     * Estimates the cost of each access path with a simple I/O cost model and picks the cheapest:
+     *  -> index scan: one random block read per qualifying record
+     *  -> bitmap heap scan: one read per distinct block holding a qualifying record, where the expected number of
+     *     distinct blocks follows Cardenas' formula B * (1 - (1 - 1/B)^r). The blocks are read in ascending order,
+     *     so their cost moves from random towards sequential as the fraction of blocks read grows
+     *  -> sequential scan: every block in use, read sequentially, plus the predicate on every record
+     * Both index paths also pay for the descent and for the leaf nodes walked.
+     *
+     * Without a histogram there is no estimate, so the plan falls back to the index scan.
+     */
+    Plan plan{AccessPath::INDEX_SCAN, 0, 0, 0, 0};
+
+    Histogram *histogram = tree->getHistogram();
+    if (histogram == nullptr) {
+        return plan;
+    }
+
+    double blocks = (double) max((size_t) 1, disk->getBlocksUsed());
+    double records = (double) max((size_t) 1, histogram->getTotalRecords());
+    double distinctKeys = (double) max((size_t) 1, histogram->getDistinctKeys());
+    double estimated = histogram->estimateRange(lowerKey, upperKey);
+    plan.estimatedRecords = estimated;
+
+    // index traversal: the descent plus the leaves holding the qualifying keys
+    double recordsPerLeaf = max(1.0, leafFillFactor * tree->getN() * (records / distinctKeys));
+    double traversalCost = tree->countHeight() + ceil(estimated / recordsPerLeaf);
+
+    // index scan
+    plan.indexScanCost = traversalCost + estimated * randomBlockCost + estimated * recordCpuCost;
+
+    // bitmap heap scan
+    double distinctBlocks = blocks * (1 - pow(1 - 1 / blocks, estimated));
+    double blockCost = randomBlockCost - (randomBlockCost - 1) * sqrt(distinctBlocks / blocks);
+    plan.bitmapHeapScanCost = traversalCost + distinctBlocks * blockCost + estimated * recordCpuCost;
+
+    // sequential scan
+    plan.sequentialScanCost = blocks + records * recordCpuCost;
+
+    // pick the cheapest access path
+    if (plan.bitmapHeapScanCost < plan.indexScanCost) {
+        plan.accessPath = AccessPath::BITMAP_HEAP_SCAN;
+    }
+    if (plan.sequentialScanCost < min(plan.indexScanCost, plan.bitmapHeapScanCost)) {
+        plan.accessPath = AccessPath::SEQUENTIAL_SCAN;
+    }
+    return plan;
+}
+
+ScanResult executeRangeQuery(Tree *tree, Disk *disk, const Plan &plan, int lowerKey, int upperKey) {
+    switch (plan.accessPath) {
+        case AccessPath::BITMAP_HEAP_SCAN:
+            return bitmapHeapScan(tree, disk, lowerKey, upperKey);
+        case AccessPath::SEQUENTIAL_SCAN:
+            return sequentialScan(disk, lowerKey, upperKey);
+        default:
+            return indexScan(tree, disk, lowerKey, upperKey);
+    }
+}
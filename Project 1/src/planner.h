@@ -0,0 +1,31 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include "disk.h"
+#include "tree.h"
+#include "scan.h"
+
+enum class AccessPath {
+    INDEX_SCAN,
+    BITMAP_HEAP_SCAN,
+    SEQUENTIAL_SCAN
+};
+
+struct Plan {
+    AccessPath accessPath;
+    double estimatedRecords;
+
+    // estimated costs, in units of one sequential block read
+    double indexScanCost;
+    double bitmapHeapScanCost;
+    double sequentialScanCost;
+};
+
+const char *getAccessPathName(AccessPath accessPath);
+
+// picks the cheapest access path for lowerKey <= numVotes <= upperKey, using the tree's histogram
+Plan planRangeQuery(Tree *tree, Disk *disk, int lowerKey, int upperKey);
+
+ScanResult executeRangeQuery(Tree *tree, Disk *disk, const Plan &plan, int lowerKey, int upperKey);
+
+#endif
@@ -0,0 +1,508 @@
+#include "query_server.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+template<typename T>
+static void appendValue(vector<unsigned char> &buffer, T value) {
+    size_t offset = buffer.size();
+    buffer.resize(offset + sizeof(T));
+    memcpy(buffer.data() + offset, &value, sizeof(T));
+}
+
+template<typename T>
+static T readValue(const unsigned char *data) {
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+QueryServer::QueryServer(Tree *aTree, Disk *aDisk, int numWorkers) : pool(numWorkers) {
+    /*
+     * Constructor for a QueryServer over a loaded disk and tree. Nothing is served until listen() and run().
+     */
+    tree = aTree;
+    disk = aDisk;
+    listenFd = epollFd = -1;
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    stopping.store(false);
+    requestsServed.store(0);
+    batchesServed.store(0);
+
+    // buffered searches are not safe to run concurrently
+    tree->setBufferCapacity(0);
+}
+
+QueryServer::~QueryServer() {
+    /*
+     * Waits for the batches still with the workers, then closes every socket
+     */
+    pool.waitIdle();
+    for (auto &entry: connections) {
+        close(entry.first);
+    }
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(socketPath.c_str());
+    }
+    if (epollFd >= 0) {
+        close(epollFd);
+    }
+    close(wakeFd);
+}
+
+bool QueryServer::listen(const string &path) {
+    /*
+     * Binds the socket at path (replacing a stale one) and sets up the event loop. Returns false on failure.
+     */
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path.c_str());
+
+    unlink(path.c_str());
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0 ||
+        ::listen(listenFd, 128) < 0) {
+        TRACE_ERROR("server.listen.error", errno);
+        return false;
+    }
+    socketPath = path;
+
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listenFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+    event.data.fd = wakeFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+    return true;
+}
+
+void QueryServer::run() {
+    /*
+     * Runs the event loop until stop() is called
+     */
+    epoll_event events[64];
+    while (!stopping.load()) {
+        int ready = epoll_wait(epollFd, events, 64, -1);
+        if (ready < 0 && errno != EINTR) {
+            TRACE_ERROR("server.epoll.error", errno);
+            break;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            int fd = events[i].data.fd;
+            if (fd == listenFd) {
+                acceptConnections();
+                continue;
+            }
+            if (fd == wakeFd) {
+                uint64_t signals;
+                while (read(wakeFd, &signals, sizeof(signals)) > 0) {
+                }
+                collectCompleted();
+                continue;
+            }
+
+            auto itr = connections.find(fd);
+            if (itr == connections.end()) {
+                continue;
+            }
+            Connection *connection = itr->second.get();
+            if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                // both directions are down, nothing can be sent back anymore
+                closeConnection(connection);
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT) && !writeConnection(connection)) {
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+                readConnection(connection);
+            } else {
+                serviceConnection(connection);
+            }
+        }
+    }
+}
+
+void QueryServer::stop() {
+    /*
+     * Makes run() return. Only writes to the eventfd, so it can be called from a signal handler.
+     */
+    stopping.store(true);
+    uint64_t signal = 1;
+    ssize_t written = write(wakeFd, &signal, sizeof(signal));
+    (void) written;
+}
+
+void QueryServer::acceptConnections() {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        auto connection = make_unique<Connection>();
+        connection->fd = fd;
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+        connections[fd] = std::move(connection);
+        TRACE_DEBUG("server.accept", fd);
+    }
+}
+
+void QueryServer::readConnection(Connection *connection) {
+    /*
+     * Reads what is available (up to QUERY_MAX_BUFFERED of input), then hands the complete requests to the
+     * workers unless a batch is in flight. At the end of the input, the requests that have arrived are still
+     * answered before the connection is closed.
+     */
+    unsigned char buffer[64 * 1024];
+    while (connection->input.size() < QUERY_MAX_BUFFERED) {
+        ssize_t bytesRead = read(connection->fd, buffer, sizeof(buffer));
+        if (bytesRead > 0) {
+            connection->input.insert(connection->input.end(), buffer, buffer + bytesRead);
+            continue;
+        }
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead == 0) {
+            TRACE_DEBUG("server.peerClosed", connection->fd);
+            connection->peerClosed = true;
+            break;
+        }
+
+        // the connection failed
+        closeConnection(connection);
+        return;
+    }
+
+    serviceConnection(connection);
+}
+
+void QueryServer::serviceConnection(Connection *connection) {
+    /*
+     * Dispatches the next batch of a connection if it has none in flight and its output is under the limit,
+     * closes a connection the peer has shut down once everything is answered, and otherwise updates which
+     * events the connection waits for
+     */
+    if (!connection->busy && connection->output.size() - connection->outputOffset < QUERY_MAX_BUFFERED &&
+        !dispatchBatch(connection)) {
+        return;
+    }
+    if (connection->peerClosed && !connection->busy && connection->output.empty()) {
+        closeConnection(connection);
+        return;
+    }
+    updateEvents(connection);
+}
+
+void QueryServer::updateEvents(Connection *connection) {
+    /*
+     * Registers the events the connection waits for: input while it has room for it, and output while the
+     * socket is full
+     */
+    uint32_t events = 0;
+    if (!connection->peerClosed && connection->input.size() < QUERY_MAX_BUFFERED &&
+        connection->output.size() - connection->outputOffset < QUERY_MAX_BUFFERED) {
+        events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (connection->waitingToWrite) {
+        events |= EPOLLOUT;
+    }
+    if (events != connection->events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = connection->fd;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->events = events;
+        TRACE_DEBUG("server.events", (int64_t) events);
+    }
+}
+
+bool QueryServer::dispatchBatch(Connection *connection) {
+    /*
+     * Moves the complete requests at the front of the input into a batch for the worker pool. Returns false if
+     * the connection was closed because of a malformed frame.
+     */
+    size_t batchSize = 0;
+    while (batchSize < QUERY_MAX_BATCH && connection->input.size() - batchSize >= sizeof(uint32_t)) {
+        auto length = readValue<uint32_t>(connection->input.data() + batchSize);
+        if (length < sizeof(uint32_t) + sizeof(uint8_t) || length > QUERY_MAX_FRAME) {
+            TRACE_INFO("server.badFrame", length);
+            closeConnection(connection);
+            return false;
+        }
+        if (connection->input.size() - batchSize < sizeof(uint32_t) + length) {
+            break;
+        }
+        batchSize += sizeof(uint32_t) + length;
+    }
+    if (batchSize == 0) {
+        return true;
+    }
+
+    auto batch = make_shared<vector<unsigned char>>(connection->input.begin(), connection->input.begin() + batchSize);
+    connection->input.erase(connection->input.begin(), connection->input.begin() + batchSize);
+    connection->busy = true;
+
+    pool.submit([this, connection, batch]() {
+        CompletedBatch done;
+        done.connection = connection;
+        done.numRequests = executeBatch(*batch, done.responses);
+        {
+            lock_guard<mutex> lock(completedLatch);
+            completed.push_back(std::move(done));
+        }
+        uint64_t signal = 1;
+        ssize_t written = write(wakeFd, &signal, sizeof(signal));
+        (void) written;
+    });
+    return true;
+}
+
+void QueryServer::collectCompleted() {
+    /*
+     * Sends the responses of the batches the workers have finished, and dispatches the next batch of each
+     * connection
+     */
+    vector<CompletedBatch> batches;
+    {
+        lock_guard<mutex> lock(completedLatch);
+        batches.swap(completed);
+    }
+
+    for (CompletedBatch &batch: batches) {
+        Connection *connection = batch.connection;
+        connection->busy = false;
+        requestsServed += batch.numRequests;
+        batchesServed++;
+        if (connection->closing) {
+            closeConnection(connection);
+            continue;
+        }
+
+        connection->output.insert(connection->output.end(), batch.responses.begin(), batch.responses.end());
+        if (writeConnection(connection)) {
+            serviceConnection(connection);
+        }
+    }
+}
+
+bool QueryServer::writeConnection(Connection *connection) {
+    /*
+     * Writes as much pending output as the socket takes. Waits for EPOLLOUT if it fills up. Returns false if the
+     * connection was closed. The caller updates the registered events (serviceConnection).
+     */
+    while (connection->outputOffset < connection->output.size()) {
+        ssize_t written = send(connection->fd, connection->output.data() + connection->outputOffset,
+                               connection->output.size() - connection->outputOffset, MSG_NOSIGNAL);
+        if (written >= 0) {
+            connection->outputOffset += written;
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            connection->waitingToWrite = true;
+            return true;
+        }
+        closeConnection(connection);
+        return false;
+    }
+
+    connection->output.clear();
+    connection->outputOffset = 0;
+    connection->waitingToWrite = false;
+    return true;
+}
+
+void QueryServer::closeConnection(Connection *connection) {
+    /*
+     * Closes a connection. One with a batch in flight is only taken out of the event loop, it is closed when the
+     * batch comes back (so its fd cannot be reused in the meantime).
+     */
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+    if (connection->busy) {
+        connection->closing = true;
+        return;
+    }
+    int fd = connection->fd;
+    close(fd);
+    connections.erase(fd);
+    TRACE_DEBUG("server.close", fd);
+}
+
+size_t QueryServer::executeBatch(const vector<unsigned char> &requests, vector<unsigned char> &responses) {
+    /*
+     * Executes the requests of a batch in order and appends their responses. Returns the number of requests.
+     */
+    size_t numRequests = 0;
+    size_t offset = 0;
+    while (offset < requests.size()) {
+        auto length = readValue<uint32_t>(requests.data() + offset);
+        const unsigned char *frame = requests.data() + offset + sizeof(uint32_t);
+        auto requestId = readValue<uint32_t>(frame);
+        auto op = (QueryOp) frame[sizeof(uint32_t)];
+        size_t headerSize = sizeof(uint32_t) + sizeof(uint8_t);
+        executeRequest(requestId, op, frame + headerSize, length - headerSize, responses);
+        offset += sizeof(uint32_t) + length;
+        numRequests++;
+    }
+    return numRequests;
+}
+
+static void appendRecord(vector<unsigned char> &responses, Disk *disk, Record *record) {
+    string tconst = disk->decodeTconst(record);
+    appendValue<uint8_t>(responses, record->averageRating);
+    appendValue<int32_t>(responses, record->numVotes);
+    appendValue<uint8_t>(responses, (uint8_t) min(tconst.size(), (size_t) 255));
+    responses.insert(responses.end(), tconst.begin(), tconst.begin() + min(tconst.size(), (size_t) 255));
+}
+
+void QueryServer::executeRequest(uint32_t requestId, QueryOp op, const unsigned char *payload, size_t payloadSize,
+                                 vector<unsigned char> &responses) {
+    /*
+     * Executes one request and appends its response
+     */
+    size_t start = responses.size();
+    appendValue<uint32_t>(responses, 0);  // length, filled in at the end
+    appendValue<uint32_t>(responses, requestId);
+    appendValue<uint8_t>(responses, (uint8_t) QueryStatus::OK);
+    size_t statusOffset = responses.size() - 1;
+    auto setStatus = [&](QueryStatus status) {
+        responses[statusOffset] = (uint8_t) status;
+    };
+
+    switch (op) {
+        case QueryOp::POINT:
+        case QueryOp::RANGE: {
+            size_t expected = op == QueryOp::POINT ? 8 : 12;
+            if (payloadSize != expected) {
+                setStatus(QueryStatus::BAD_REQUEST);
+                break;
+            }
+            int lowerKey = readValue<int32_t>(payload);
+            int upperKey = op == QueryOp::POINT ? lowerKey : readValue<int32_t>(payload + 4);
+            uint32_t limit = readValue<uint32_t>(payload + expected - 4);
+
+            size_t countOffset = responses.size();
+            appendValue<uint32_t>(responses, 0);
+            appendValue<uint32_t>(responses, 0);
+            uint32_t matching = 0, returned = 0;
+            {
+                shared_lock<shared_mutex> lock(dataLatch);
+                Node *leaf = tree->searchNode(lowerKey, false);
+                auto idx = leaf == nullptr ? 0 : lower_bound(leaf->keys.begin(), leaf->keys.end(), lowerKey) -
+                                                 leaf->keys.begin();
+                for (bool finished = false; leaf != nullptr && !finished; leaf = leaf->pNextLeaf, idx = 0) {
+                    for (auto i = idx; i < leaf->keys.size(); i++) {
+                        if (leaf->keys[i] > upperKey) {
+                            finished = true;
+                            break;
+                        }
+                        for (Record *record: leaf->pointer.pData[i]) {
+                            matching++;
+                            if (returned < limit) {
+                                appendRecord(responses, disk, record);
+                                returned++;
+                            }
+                        }
+                    }
+                }
+            }
+            memcpy(responses.data() + countOffset, &matching, sizeof(matching));
+            memcpy(responses.data() + countOffset + 4, &returned, sizeof(returned));
+            if (matching == 0) {
+                setStatus(QueryStatus::NOT_FOUND);
+            }
+            break;
+        }
+        case QueryOp::AGGREGATE: {
+            if (payloadSize != 8) {
+                setStatus(QueryStatus::BAD_REQUEST);
+                break;
+            }
+            Aggregate aggregate;
+            {
+                shared_lock<shared_mutex> lock(dataLatch);
+                aggregate = tree->aggregateRange(readValue<int32_t>(payload), readValue<int32_t>(payload + 4));
+            }
+            appendValue<uint64_t>(responses, aggregate.count);
+            appendValue<uint64_t>(responses, aggregate.ratingSum);
+            break;
+        }
+        case QueryOp::INSERT: {
+            if (payloadSize < 6 || payloadSize != 6 + (size_t) payload[5]) {
+                setStatus(QueryStatus::BAD_REQUEST);
+                break;
+            }
+            string tconst(reinterpret_cast<const char *>(payload + 6), payload[5]);
+            unique_lock<shared_mutex> lock(dataLatch);
+            Record *record = disk->insertRecord(tconst, payload[0], readValue<int32_t>(payload + 1));
+            if (record == nullptr) {
+                setStatus(QueryStatus::DISK_FULL);
+                break;
+            }
+            tree->insert(record->numVotes, record);
+            break;
+        }
+        case QueryOp::DELETE: {
+            if (payloadSize != 4) {
+                setStatus(QueryStatus::BAD_REQUEST);
+                break;
+            }
+            int key = readValue<int32_t>(payload);
+            uint32_t removed = 0;
+            {
+                // mark the records as deleted on disk, then remove the key from the index
+                unique_lock<shared_mutex> lock(dataLatch);
+                vector<Record *> *records = tree->search(key, false);
+                if (records != nullptr) {
+                    for (Record *record: *records) {
+                        disk->deleteRecord(record);
+                    }
+                    removed = records->size();
+                    tree->removeKey(key);
+                }
+            }
+            appendValue<uint32_t>(responses, removed);
+            if (removed == 0) {
+                setStatus(QueryStatus::NOT_FOUND);
+            }
+            break;
+        }
+        default:
+            setStatus(QueryStatus::BAD_REQUEST);
+    }
+
+    auto length = (uint32_t) (responses.size() - start - sizeof(uint32_t));
+    memcpy(responses.data() + start, &length, sizeof(length));
+}
+
+size_t QueryServer::getRequestsServed() {
+    return requestsServed.load();
+}
+
+size_t QueryServer::getBatchesServed() {
+    return batchesServed.load();
+}
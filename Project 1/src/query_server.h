@@ -0,0 +1,145 @@
+#ifndef QUERY_SERVER_H
+#define QUERY_SERVER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/epoll.h>
+#include "disk.h"
+#include "tree.h"
+#include "thread_pool.h"
+
+/*
+ * Binary protocol, all integers in host byte order (the socket is local).
+ *
+ * Request:  uint32 length (of what follows) | uint32 requestId | uint8 opcode | payload
+ *   POINT      int32 key | uint32 limit
+ *   RANGE      int32 lowerKey | int32 upperKey | uint32 limit
+ *   AGGREGATE  int32 lowerKey | int32 upperKey
+ *   INSERT     uint8 averageRating | int32 numVotes | uint8 tconstLength | tconst
+ *   DELETE     int32 key
+ *
+ * Response: uint32 length (of what follows) | uint32 requestId | uint8 status | payload
+ *   POINT, RANGE  uint32 matching records | uint32 returned (at most limit) |
+ *                 returned x (uint8 averageRating | int32 numVotes | uint8 tconstLength | tconst)
+ *   AGGREGATE     uint64 count | uint64 ratingSum (in tenths)
+ *   INSERT        nothing (status DISK_FULL if the disk has no room for the record)
+ *   DELETE        uint32 records removed
+ *
+ * Responses come back in request order on every connection, so a client can pipeline as many requests as it
+ * likes and match the responses up by order (or by requestId). A client that shuts down its sending side still
+ * gets the responses to every complete request sent before.
+ */
+enum class QueryOp : uint8_t {POINT = 1, RANGE = 2, AGGREGATE = 3, INSERT = 4, DELETE = 5};
+
+enum class QueryStatus : uint8_t {OK = 0, NOT_FOUND = 1, BAD_REQUEST = 2, DISK_FULL = 3};
+
+// frames larger than this close the connection
+const uint32_t QUERY_MAX_FRAME = 64 * 1024;
+
+// a connection is not read from while its unprocessed input or its unsent output is over this many bytes
+const size_t QUERY_MAX_BUFFERED = 1024 * 1024;
+
+// a batch takes requests until it holds this many bytes of them, which also bounds the size of its responses
+const size_t QUERY_MAX_BATCH = 64 * 1024;
+
+class QueryServer {
+    /*
+     * Keeps a Disk and its numVotes Tree resident and answers requests over a Unix domain socket.
+     *
+     * One thread runs an epoll event loop that accepts connections, reads requests and writes responses, all
+     * on non-blocking sockets. Every complete request that has arrived on a connection is handed to the worker
+     * pool as one batch, and the responses of the batch go back in a single write. A connection has at most one
+     * batch in flight, which keeps its responses in order; requests arriving meanwhile form the next batch.
+     * A client that sends faster than it reads is pushed back on: once its unprocessed input or unsent output is
+     * over QUERY_MAX_BUFFERED, the server stops reading from it (and stops dispatching its batches) until that
+     * drains.
+     *
+     * Workers read under a shared latch and write (insert, delete) under an exclusive one. The tree must not be in
+     * buffered mode, since buffered searches share a result buffer.
+     */
+private:
+    struct Connection {
+        int fd;
+        std::vector<unsigned char> input;
+        std::vector<unsigned char> output;
+        size_t outputOffset = 0;
+        uint32_t events = EPOLLIN | EPOLLRDHUP;  // registered with epoll
+        bool waitingToWrite = false;  // the socket is full, EPOLLOUT is wanted
+        bool busy = false;        // a batch is with the workers
+        bool peerClosed = false;  // the peer shut down its side, answer what has arrived and then close
+        bool closing = false;     // the connection failed, close once the batch is back
+    };
+
+    struct CompletedBatch {
+        Connection *connection;
+        std::vector<unsigned char> responses;
+        size_t numRequests;
+    };
+
+    Tree *tree;
+    Disk *disk;
+    ThreadPool pool;
+    std::shared_mutex dataLatch;
+
+    int listenFd;
+    int epollFd;
+    int wakeFd;  // eventfd, signalled by the workers and by stop()
+    std::string socketPath;
+    std::atomic<bool> stopping;
+
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    std::mutex completedLatch;
+    std::vector<CompletedBatch> completed;
+
+    std::atomic<size_t> requestsServed;
+    std::atomic<size_t> batchesServed;
+
+    void acceptConnections();
+
+    void readConnection(Connection *connection);
+
+    bool dispatchBatch(Connection *connection);
+
+    void serviceConnection(Connection *connection);
+
+    void updateEvents(Connection *connection);
+
+    void collectCompleted();
+
+    bool writeConnection(Connection *connection);
+
+    void closeConnection(Connection *connection);
+
+    size_t executeBatch(const std::vector<unsigned char> &requests, std::vector<unsigned char> &responses);
+
+    void executeRequest(uint32_t requestId, QueryOp op, const unsigned char *payload, size_t payloadSize,
+                        std::vector<unsigned char> &responses);
+
+public:
+    QueryServer(Tree *aTree, Disk *aDisk, int numWorkers);
+
+    ~QueryServer();
+
+    QueryServer(const QueryServer &) = delete;
+
+    QueryServer &operator=(const QueryServer &) = delete;
+
+    bool listen(const std::string &path);
+
+    void run();
+
+    void stop();
+
+    size_t getRequestsServed();
+
+    size_t getBatchesServed();
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "scan.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <set>
+
+using namespace std;
+
+template<typename Visitor>
+static int walkLeaves(Tree *tree, int lowerKey, int upperKey, Visitor visit) {
+    /*
+     * Walks the leaf chain from the leaf that lowerKey should reside in, calling visit(key, records) for every
+     * key in [lowerKey, upperKey]. Returns the number of index nodes accessed.
+     */
+    // the leaf chain only reflects buffered inserts and removals once they are applied
+    tree->flushAllBuffers();
+
+    tree->setNodesAccessedNum(0);
+    Node *currentNode = tree->searchNode(lowerKey, false);
+    if (currentNode == nullptr) {
+        return tree->getNodesAccessedNum();
+    }
+
+    // the leaf that the search ended in has already been counted
+    int indexNodesAccessed = tree->getNodesAccessedNum() - 1;
+    auto idx = lower_bound(currentNode->keys.begin(), currentNode->keys.end(), lowerKey) - currentNode->keys.begin();
+
+    bool finished = false;
+    while (currentNode != nullptr && !finished) {
+        indexNodesAccessed++;
+
+        for (auto i = idx; i < currentNode->keys.size(); i++) {
+            // when upper bound of the key is reached
+            if (currentNode->keys[i] > upperKey) {
+                finished = true;
+                break;
+            }
+            visit(currentNode->keys[i], currentNode->pointer.pData[i]);
+        }
+
+        // move to the next leaf node
+        idx = 0;
+        currentNode = currentNode->pNextLeaf;
+    }
+
+    tree->setNodesAccessedNum(0);
+    return indexNodesAccessed;
+}
+
+ScanResult indexScan(Tree *tree, Disk *disk, int lowerKey, int upperKey) {
+    /*
+     * Fetches the records with lowerKey <= key <= upperKey in key order. Every record costs one data block access,
+     * so blocks holding several qualifying records are accessed several times, in random order.
+     */
+    ScanResult result;
+    set<size_t> uniqueBlocks;
+
+    result.indexNodesAccessed = walkLeaves(tree, lowerKey, upperKey, [&](int, vector<Record *> &records) {
+        for (Record *record: records) {
+            result.records.push_back(record);
+            uniqueBlocks.insert(disk->getBlockId(record));
+        }
+    });
+
+    result.dataBlocksAccessed = result.records.size();
+    result.uniqueDataBlocksAccessed = uniqueBlocks.size();
+    return result;
+}
+
+vector<uint64_t> buildRecordBitmap(Tree *tree, Disk *disk, int lowerKey, int upperKey, int *indexNodesAccessed) {
+    /*
+     * Walks the leaf chain and marks the slot of every record with lowerKey <= key <= upperKey
+     */
+    size_t recordsPerBlock = disk->getMaxRecordsPerBlock();
+    size_t totalSlots = disk->getBlocksUsed() * recordsPerBlock;
+    vector<uint64_t> bitmap((totalSlots + 63) / 64, 0);
+
+    *indexNodesAccessed = walkLeaves(tree, lowerKey, upperKey, [&](int, vector<Record *> &records) {
+        for (Record *record: records) {
+            size_t slot = disk->getBlockId(record) * recordsPerBlock + disk->getRecordIdx(record);
+            bitmap[slot / 64] |= (uint64_t) 1 << (slot % 64);
+        }
+    });
+    return bitmap;
+}
+
+ScanResult bitmapHeapScan(Tree *tree, Disk *disk, int lowerKey, int upperKey) {
+    /*
+     * Fetches the records with lowerKey <= key <= upperKey in two phases:
+     *  1. the leaf chain is walked and the location (blockIdx, recordIdx) of every qualifying record is marked in
+     *     a bitmap, without touching the data blocks
+     *  2. the bitmap is swept in ascending order, each block with at least one marked record is read exactly once,
+     *     and the predicate is rechecked on the marked records of that block
+     *
+     * The bitmap is exact (one bit per record slot) rather than one bit per block, so records that are still on
+     * disk but no longer indexed (e.g. after removeKey) are not returned. Records come out in block order.
+     */
+    ScanResult result;
+    size_t recordsPerBlock = disk->getMaxRecordsPerBlock();
+
+    // phase 1: build the bitmap from the index
+    vector<uint64_t> bitmap = buildRecordBitmap(tree, disk, lowerKey, upperKey, &result.indexNodesAccessed);
+
+    // phase 2: visit the marked blocks in ascending order
+    size_t currentBlockIdx = SIZE_MAX;
+    for (size_t word = 0; word < bitmap.size(); word++) {
+        uint64_t bits = bitmap[word];
+        while (bits != 0) {
+            size_t slot = word * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+
+            size_t blockIdx = slot / recordsPerBlock;
+            if (blockIdx != currentBlockIdx) {
+                // first marked record of a new block, so the block is read once here
+                currentBlockIdx = blockIdx;
+                result.dataBlocksAccessed++;
+            }
+
+            Record *record = disk->getRecord(blockIdx, slot % recordsPerBlock);
+            if (record->numVotes >= lowerKey && record->numVotes <= upperKey) {
+                result.records.push_back(record);
+            }
+        }
+    }
+
+    result.uniqueDataBlocksAccessed = result.dataBlocksAccessed;
+    return result;
+}
+
+ScanResult sequentialScan(Disk *disk, int lowerKey, int upperKey) {
+    /*
+     * Fetches the records with lowerKey <= numVotes <= upperKey by reading every block in use, in ascending order.
+     * Deleted records are skipped.
+     */
+    ScanResult result;
+
+    for (size_t blockIdx = 0; blockIdx < disk->getBlocksUsed(); blockIdx++) {
+        size_t recordsInBlock = disk->getRecordsInBlock(blockIdx);
+        if (recordsInBlock == 0) {
+            continue;
+        }
+        result.dataBlocksAccessed++;
+
+        for (size_t recordIdx = 0; recordIdx < recordsInBlock; recordIdx++) {
+            Record *record = disk->getRecord(blockIdx, recordIdx);
+            if (record->numVotes >= lowerKey && record->numVotes <= upperKey && !disk->isDeleted(blockIdx, recordIdx)) {
+                result.records.push_back(record);
+            }
+        }
+    }
+
+    result.uniqueDataBlocksAccessed = result.dataBlocksAccessed;
+    return result;
+}
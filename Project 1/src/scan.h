@@ -0,0 +1,31 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "dtypes.h"
+#include "disk.h"
+#include "tree.h"
+
+struct ScanResult {
+    std::vector<Record *> records;
+    int indexNodesAccessed = 0;
+    size_t dataBlocksAccessed = 0;
+    size_t uniqueDataBlocksAccessed = 0;
+};
+
+// follows the leaf chain and fetches the records in key order
+ScanResult indexScan(Tree *tree, Disk *disk, int lowerKey, int upperKey);
+
+// follows the leaf chain into a record bitmap, then fetches every marked block once, in block order
+ScanResult bitmapHeapScan(Tree *tree, Disk *disk, int lowerKey, int upperKey);
+
+// the first phase of a bitmap heap scan: one bit per record slot (blockIdx x maxRecordsPerBlock + recordIdx)
+std::vector<uint64_t> buildRecordBitmap(Tree *tree, Disk *disk, int lowerKey, int upperKey,
+                                        int *indexNodesAccessed);
+
+// reads every block in use once, in ascending order, without using the index
+ScanResult sequentialScan(Disk *disk, int lowerKey, int upperKey);
+
+#endif
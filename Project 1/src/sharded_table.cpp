@@ -0,0 +1,236 @@
+#include "sharded_table.h"
+#include "scan.h"
+#include "trace.h"
+
+#include <algorithm>
+
+using namespace std;
+
+ShardedTable::Shard::Shard(size_t extentSize, int blockSize, size_t queueCapacity)
+        : disk(extentSize, blockSize), tree(blockSize), queue(queueCapacity) {
+    records = 0;
+    sleeping.store(false);
+}
+
+ShardedTable::ShardedTable(const vector<int> &sampleKeys, int numShards, size_t extentSize, int blockSize,
+                           size_t queueCapacity) {
+    /*
+     * Constructor for an empty table with numShards shards, with the boundaries chosen so that the sampled keys
+     * are spread evenly. Starts one worker per shard.
+     */
+    boundaries = chooseBoundaries(sampleKeys, numShards);
+    stopping.store(false);
+
+    for (size_t i = 0; i <= boundaries.size(); i++) {
+        shards.push_back(make_unique<Shard>(extentSize, blockSize, queueCapacity));
+    }
+    for (unique_ptr<Shard> &shard: shards) {
+        shard->worker = thread(&ShardedTable::workerLoop, this, shard.get());
+    }
+    TRACE_INFO("sharded.init", (int64_t) shards.size());
+}
+
+ShardedTable::~ShardedTable() {
+    /*
+     * Applies the queued operations, then stops and joins the workers
+     */
+    stopping.store(true);
+    for (unique_ptr<Shard> &shard: shards) {
+        {
+            lock_guard<mutex> lock(shard->latch);
+        }
+        shard->wakeup.notify_one();
+        shard->worker.join();
+    }
+}
+
+vector<int> ShardedTable::chooseBoundaries(vector<int> sampleKeys, int numShards) {
+    /*
+     * Returns up to numShards - 1 ascending boundaries at the quantiles of the sampled keys. Duplicate boundaries
+     * are dropped, so a heavily skewed sample can yield fewer shards than asked for.
+     */
+    vector<int> result;
+    if (sampleKeys.empty()) {
+        return result;
+    }
+    sort(sampleKeys.begin(), sampleKeys.end());
+    for (int i = 1; i < numShards; i++) {
+        int boundary = sampleKeys[sampleKeys.size() * i / numShards];
+        if (boundary > sampleKeys.front() && (result.empty() || boundary > result.back())) {
+            result.push_back(boundary);
+        }
+    }
+    return result;
+}
+
+int ShardedTable::getShardIdx(int key) {
+    return (int) (upper_bound(boundaries.begin(), boundaries.end(), key) - boundaries.begin());
+}
+
+void ShardedTable::workerLoop(Shard *shard) {
+    /*
+     * Applies the operations of one shard until the table is destroyed. After a short spin on an empty queue the
+     * worker goes to sleep until a producer wakes it up.
+     */
+    ShardOp op;
+    int idleRounds = 0;
+    while (true) {
+        if (shard->queue.pop(op)) {
+            apply(shard, op);
+            idleRounds = 0;
+            continue;
+        }
+        if (stopping.load()) {
+            break;
+        }
+        if (++idleRounds < 64) {
+            this_thread::yield();
+            continue;
+        }
+
+        // publish the sleeping flag before the last look at the queue, see enqueue()
+        unique_lock<mutex> lock(shard->latch);
+        shard->sleeping.store(true);
+        atomic_thread_fence(memory_order_seq_cst);
+        shard->wakeup.wait(lock, [&]() { return !shard->queue.empty() || stopping.load(); });
+        shard->sleeping.store(false);
+        idleRounds = 0;
+    }
+}
+
+void ShardedTable::apply(Shard *shard, ShardOp &op) {
+    switch (op.type) {
+        case ShardOpType::INSERT: {
+            Record *record = op.tconst.empty() ? shard->disk.insertRecord(op.record) :
+                             shard->disk.insertRecord(op.tconst, op.record.averageRating, op.record.numVotes);
+            if (record == nullptr) {
+                // the shard's disk is full (traced by the disk), the record is dropped
+                break;
+            }
+            shard->tree.insert(record->numVotes, record);
+            shard->records++;
+            break;
+        }
+        case ShardOpType::REMOVE: {
+            // mark the records as deleted on disk, then remove the key from the index
+            vector<Record *> *records = shard->tree.search(op.lowerKey, false);
+            if (records != nullptr) {
+                for (Record *record: *records) {
+                    shard->disk.deleteRecord(record);
+                }
+                shard->records -= records->size();
+                shard->tree.removeKey(op.lowerKey);
+            }
+            break;
+        }
+        case ShardOpType::SCAN:
+            op.result->set_value(indexScan(&shard->tree, &shard->disk, op.lowerKey, op.upperKey).records);
+            break;
+        case ShardOpType::FLUSH:
+            op.result->set_value({});
+            break;
+    }
+}
+
+void ShardedTable::enqueue(Shard *shard, ShardOp op) {
+    /*
+     * Hands an operation to the worker of a shard, waiting while its queue is full
+     */
+    while (!shard->queue.push(std::move(op))) {
+        this_thread::yield();
+    }
+
+    // pairs with the fence in workerLoop: either the worker sees the operation, or we see it sleeping
+    atomic_thread_fence(memory_order_seq_cst);
+    if (shard->sleeping.load()) {
+        {
+            lock_guard<mutex> lock(shard->latch);
+        }
+        shard->wakeup.notify_one();
+    }
+}
+
+void ShardedTable::insert(const Record &record, Disk &source) {
+    /*
+     * Queues a record of the source disk for the shard of its numVotes, the record is copied into that shard's
+     * disk. An escaped tconst only has a meaning in the source disk, so it is decoded here, on the calling thread.
+     */
+    ShardOp op;
+    op.type = ShardOpType::INSERT;
+    op.record = record;
+    if (record.tconst & TCONST_ESCAPE_BIT) {
+        op.tconst = source.decodeTconst(&record);
+    }
+    enqueue(shards[getShardIdx(record.numVotes)].get(), std::move(op));
+}
+
+void ShardedTable::removeKey(int key) {
+    /*
+     * Queues the removal of a key and all its records
+     */
+    ShardOp op;
+    op.type = ShardOpType::REMOVE;
+    op.lowerKey = key;
+    enqueue(shards[getShardIdx(key)].get(), std::move(op));
+}
+
+vector<Record *> ShardedTable::searchRange(int lowerKey, int upperKey) {
+    /*
+     * Returns the records with lowerKey <= numVotes <= upperKey in key order. Every shard the range covers scans
+     * its part after the operations queued before this call; the scans run in parallel.
+     */
+    vector<Record *> result;
+    if (lowerKey > upperKey) {
+        return result;
+    }
+
+    int firstShard = getShardIdx(lowerKey);
+    int lastShard = getShardIdx(upperKey);
+    vector<promise<vector<Record *>>> promises(lastShard - firstShard + 1);
+    vector<future<vector<Record *>>> futures;
+    for (int shardIdx = firstShard; shardIdx <= lastShard; shardIdx++) {
+        futures.push_back(promises[shardIdx - firstShard].get_future());
+        ShardOp op;
+        op.type = ShardOpType::SCAN;
+        op.lowerKey = lowerKey;
+        op.upperKey = upperKey;
+        op.result = &promises[shardIdx - firstShard];
+        enqueue(shards[shardIdx].get(), std::move(op));
+    }
+
+    for (future<vector<Record *>> &shardFuture: futures) {
+        vector<Record *> shardResult = shardFuture.get();
+        result.insert(result.end(), shardResult.begin(), shardResult.end());
+    }
+    return result;
+}
+
+void ShardedTable::waitIdle() {
+    /*
+     * Waits until every operation queued so far has been applied
+     */
+    vector<promise<vector<Record *>>> promises(shards.size());
+    vector<future<vector<Record *>>> futures;
+    for (size_t shardIdx = 0; shardIdx < shards.size(); shardIdx++) {
+        futures.push_back(promises[shardIdx].get_future());
+        ShardOp op;
+        op.result = &promises[shardIdx];
+        enqueue(shards[shardIdx].get(), std::move(op));
+    }
+    for (future<vector<Record *>> &shardFuture: futures) {
+        shardFuture.wait();
+    }
+}
+
+int ShardedTable::getNumShards() {
+    return (int) shards.size();
+}
+
+const vector<int> &ShardedTable::getBoundaries() {
+    return boundaries;
+}
+
+size_t ShardedTable::getShardRecords(int shardIdx) {
+    // only exact after waitIdle()
+    return shards[shardIdx]->records;
+}
@@ -0,0 +1,94 @@
+#ifndef SHARDED_TABLE_H
+#define SHARDED_TABLE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "dtypes.h"
+#include "disk.h"
+#include "tree.h"
+#include "mpsc_queue.h"
+
+enum class ShardOpType {INSERT, REMOVE, SCAN, FLUSH};
+
+struct ShardOp {
+    ShardOpType type = ShardOpType::FLUSH;
+    Record record{};       // INSERT, copied into the shard's disk
+    std::string tconst;    // INSERT, the decoded tconst if it is escaped in the source disk
+    int lowerKey = 0;      // REMOVE (the key) and SCAN
+    int upperKey = 0;      // SCAN
+    std::promise<std::vector<Record *>> *result = nullptr;  // SCAN and FLUSH
+};
+
+class ShardedTable {
+    /*
+     * Table partitioned on numVotes ranges. Every shard owns a Disk, a Tree over it and a worker thread, which
+     * is the only thread that ever touches them. Operations are routed to the shard of their key and handed to
+     * its worker through a lock-free MPSC queue, so any number of threads can ingest at the same time and the
+     * shards never contend with each other.
+     *
+     * Shard i holds the keys in [boundaries[i - 1], boundaries[i]). Operations on a shard are applied in the order
+     * they were queued; a range scan is queued behind the writes to the shards it covers, and the per-shard
+     * results are concatenated in shard order, which is key order since the ranges are disjoint.
+     */
+private:
+    struct Shard {
+        Disk disk;
+        Tree tree;
+        MpscQueue<ShardOp> queue;
+        std::thread worker;
+        size_t records;  // live records, only updated by the worker
+
+        // the worker sleeps on wakeup when its queue stays empty
+        std::atomic<bool> sleeping;
+        std::mutex latch;
+        std::condition_variable wakeup;
+
+        Shard(size_t extentSize, int blockSize, size_t queueCapacity);
+    };
+
+    std::vector<int> boundaries;
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<bool> stopping;
+
+    void workerLoop(Shard *shard);
+
+    void apply(Shard *shard, ShardOp &op);
+
+    void enqueue(Shard *shard, ShardOp op);
+
+public:
+    ShardedTable(const std::vector<int> &sampleKeys, int numShards, size_t extentSize, int blockSize,
+                 size_t queueCapacity = 4096);
+
+    ~ShardedTable();
+
+    ShardedTable(const ShardedTable &) = delete;
+
+    ShardedTable &operator=(const ShardedTable &) = delete;
+
+    static std::vector<int> chooseBoundaries(std::vector<int> sampleKeys, int numShards);
+
+    int getShardIdx(int key);
+
+    void insert(const Record &record, Disk &source);
+
+    void removeKey(int key);
+
+    std::vector<Record *> searchRange(int lowerKey, int upperKey);
+
+    void waitIdle();
+
+    int getNumShards();
+
+    const std::vector<int> &getBoundaries();
+
+    size_t getShardRecords(int shardIdx);
+};
+
+#endif
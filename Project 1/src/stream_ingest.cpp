@@ -0,0 +1,264 @@
+#include "stream_ingest.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fcntl.h>
+#include <mutex>
+#include <unistd.h>
+
+using namespace std;
+
+StreamIngest::StreamIngest(Disk *aDisk, Tree *aTree, size_t queueCapacity, size_t aMaxBatchSize)
+        : queue(queueCapacity) {
+    disk = aDisk;
+    tree = aTree;
+    maxBatchSize = max((size_t) 1, aMaxBatchSize);
+    fileDescriptor = -1;
+    follow = false;
+    stopping = false;
+    readerDone = false;
+    rowsApplied = 0;
+    parseErrors = 0;
+    stalls = 0;
+    stallSeconds = 0;
+    droppedRows = 0;
+    batches = 0;
+    largestBatch = 0;
+}
+
+StreamIngest::~StreamIngest() {
+    if (reader.joinable() || applier.joinable()) {
+        stop();
+        wait();
+    }
+}
+
+bool StreamIngest::start(const string &path, bool aFollow) {
+    /*
+     * Opens the input and starts the reader and applier threads, returns false if the input cannot be opened
+     */
+    fileDescriptor = path == "-" ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+    if (fileDescriptor < 0) {
+        return false;
+    }
+    follow = aFollow;
+    stopping = false;
+    readerDone = false;
+    startTime = chrono::steady_clock::now();
+    applier = thread(&StreamIngest::applierLoop, this);
+    reader = thread(&StreamIngest::readerLoop, this);
+    TRACE_INFO("ingest.start", follow ? 1 : 0);
+    return true;
+}
+
+void StreamIngest::stop() {
+    stopping.store(true);
+}
+
+bool StreamIngest::parseLine(const string &line, IngestRow &row) {
+    /*
+     * Parses "tconst \t averageRating \t numVotes", returns false for the header and malformed rows
+     */
+    size_t firstTab = line.find('\t');
+    size_t secondTab = firstTab == string::npos ? string::npos : line.find('\t', firstTab + 1);
+    if (secondTab == string::npos) {
+        return false;
+    }
+
+    const char *ratingStart = line.c_str() + firstTab + 1;
+    const char *votesStart = line.c_str() + secondTab + 1;
+    char *end;
+    float averageRating = strtof(ratingStart, &end);
+    if (end == ratingStart || averageRating < 0 || averageRating > 25.5) {
+        return false;
+    }
+    long numVotes = strtol(votesStart, &end, 10);
+    if (end == votesStart) {
+        return false;
+    }
+
+    row.tconst = line.substr(0, firstTab);
+    row.averageRating = (unsigned char) (averageRating * 10);
+    row.numVotes = (int) numVotes;
+    return true;
+}
+
+void StreamIngest::readerLoop() {
+    /*
+     * Reads the input in chunks, splits it into lines and queues the parsed rows. At the end of the input it
+     * either stops or, when following, waits for more.
+     */
+    vector<char> chunk(64 * 1024);
+    string line;
+    bool header = true;
+    IngestRow row;
+
+    auto queueRow = [&]() {
+        if (header) {
+            // the first line is the header if it does not parse
+            header = false;
+            if (!parseLine(line, row)) {
+                return;
+            }
+        } else if (!parseLine(line, row)) {
+            parseErrors++;
+            return;
+        }
+        row.arrival = chrono::steady_clock::now();
+        if (queue.push(row)) {
+            return;
+        }
+
+        // back-pressure: the index is behind, stop reading until there is room
+        stalls++;
+        auto stallStart = chrono::steady_clock::now();
+        TRACE_DEBUG("ingest.stall", (int64_t) stalls);
+        while (!queue.push(row)) {
+            this_thread::sleep_for(chrono::microseconds(50));
+        }
+        stallSeconds += chrono::duration<double>(chrono::steady_clock::now() - stallStart).count();
+    };
+
+    while (true) {
+        ssize_t bytesRead = ::read(fileDescriptor, chunk.data(), chunk.size());
+        if (bytesRead < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytesRead > 0) {
+            for (ssize_t i = 0; i < bytesRead; i++) {
+                if (chunk[i] != '\n') {
+                    line.push_back(chunk[i]);
+                    continue;
+                }
+                if (!line.empty() && line.back() == '\r') {
+                    line.pop_back();
+                }
+                if (!line.empty()) {
+                    queueRow();
+                }
+                line.clear();
+            }
+            continue;
+        }
+
+        // end of the input for now, a partial line is kept until the rest of it arrives
+        if (!follow || stopping.load()) {
+            break;
+        }
+        this_thread::sleep_for(chrono::microseconds(200));
+    }
+    if (!line.empty()) {
+        queueRow();
+    }
+
+    if (fileDescriptor != STDIN_FILENO) {
+        close(fileDescriptor);
+    }
+    readerDone.store(true);
+}
+
+void StreamIngest::applierLoop() {
+    /*
+     * Applies whatever the reader has queued, up to maxBatchSize rows at a time, until the reader is done and
+     * the queue is empty
+     */
+    vector<IngestRow> batch;
+    batch.reserve(maxBatchSize);
+    IngestRow row;
+    int idleRounds = 0;
+    while (true) {
+        while (batch.size() < maxBatchSize && queue.pop(row)) {
+            batch.push_back(std::move(row));
+        }
+        if (!batch.empty()) {
+            applyBatch(batch);
+            batch.clear();
+            idleRounds = 0;
+            continue;
+        }
+
+        // the reader may have queued its last rows right before finishing
+        if (readerDone.load() && queue.empty()) {
+            break;
+        }
+        if (++idleRounds < 64) {
+            this_thread::yield();
+        } else {
+            this_thread::sleep_for(chrono::microseconds(50));
+        }
+    }
+}
+
+void StreamIngest::applyBatch(vector<IngestRow> &batch) {
+    /*
+     * Appends the rows to the disk and inserts them into the tree, sorted by key, under the write latch
+     */
+    vector<pair<int, Record *>> entries;
+    entries.reserve(batch.size());
+    {
+        unique_lock<shared_mutex> lock(treeLatch);
+        for (IngestRow &row: batch) {
+            Record *record = disk->insertRecord(row.tconst, row.averageRating, row.numVotes);
+            if (record == nullptr) {
+                droppedRows++;
+                continue;
+            }
+            // copied out first, the packed field must not be bound to a reference
+            int key = record->numVotes;
+            entries.emplace_back(key, record);
+        }
+        tree->insertBatch(entries);
+    }
+
+    auto visible = chrono::steady_clock::now();
+    for (IngestRow &row: batch) {
+        latencies.push_back((float) chrono::duration<double, micro>(visible - row.arrival).count());
+    }
+    batches++;
+    largestBatch = max(largestBatch, batch.size());
+    rowsApplied.fetch_add(entries.size());
+    TRACE_DEBUG("ingest.batch", (int64_t) batch.size());
+}
+
+IngestReport StreamIngest::wait() {
+    if (reader.joinable()) {
+        reader.join();
+    }
+    if (applier.joinable()) {
+        applier.join();
+    }
+
+    IngestReport report;
+    report.rows = rowsApplied.load();
+    report.parseErrors = parseErrors;
+    report.droppedRows = droppedRows;
+    report.batches = batches;
+    report.largestBatch = largestBatch;
+    report.stalls = stalls;
+    report.stallSeconds = stallSeconds;
+    report.seconds = chrono::duration<double>(chrono::steady_clock::now() - startTime).count();
+    report.rowsPerSecond = report.rows / report.seconds;
+    if (!latencies.empty()) {
+        sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) {
+            return latencies[min(latencies.size() - 1, (size_t) (p * latencies.size()))];
+        };
+        report.p50Us = percentile(0.5);
+        report.p99Us = percentile(0.99);
+        report.p999Us = percentile(0.999);
+        report.maxUs = latencies.back();
+    }
+    TRACE_INFO("ingest.done", (int64_t) report.rows);
+    return report;
+}
+
+size_t StreamIngest::getRowsApplied() {
+    return rowsApplied.load();
+}
+
+void StreamIngest::read(const function<void(Tree *, Disk *)> &query) {
+    shared_lock<shared_mutex> lock(treeLatch);
+    query(tree, disk);
+}
@@ -0,0 +1,115 @@
+#ifndef STREAM_INGEST_H
+#define STREAM_INGEST_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "disk.h"
+#include "tree.h"
+#include "mpsc_queue.h"
+
+struct IngestRow {
+    std::string tconst;
+    unsigned char averageRating = 0;
+    int numVotes = 0;
+    std::chrono::steady_clock::time_point arrival;  // when the row was read
+};
+
+struct IngestReport {
+    size_t rows = 0;         // applied to the disk and the index
+    size_t parseErrors = 0;  // malformed rows, skipped
+    size_t droppedRows = 0;  // rows that did not fit on the disk
+    size_t batches = 0;
+    size_t largestBatch = 0;
+    size_t stalls = 0;       // times the reader found the queue full
+    double stallSeconds = 0;
+    double seconds = 0;
+    double rowsPerSecond = 0;
+
+    // from the arrival of a row to its batch becoming visible
+    double p50Us = 0;
+    double p99Us = 0;
+    double p999Us = 0;
+    double maxUs = 0;
+};
+
+class StreamIngest {
+    /*
+     * Continuous ingest of ratings rows (tconst, averageRating, numVotes, tab separated, as in data.tsv) from a
+     * file that keeps growing, or from stdin.
+     *
+     * A reader thread parses the rows and hands them to the applier thread through a bounded queue. The applier
+     * takes whatever is queued, up to maxBatchSize rows, appends the rows to the disk and inserts them into the
+     * tree as one batch sorted by key (Tree::insertBatch), so inserts into the same leaf share a descent. Batches
+     * stay small while the index keeps up and grow when rows pile up. When the queue is full the reader stops
+     * reading until the applier catches up, which pushes back on whoever writes the file or the pipe.
+     *
+     * The disk and the tree may only be used through read() while an ingest is running. A row is visible to
+     * read() once its batch is applied; the time from reading the row to that point is its latency.
+     */
+private:
+    Disk *disk;
+    Tree *tree;
+    size_t maxBatchSize;
+    MpscQueue<IngestRow> queue;
+    std::shared_mutex treeLatch;
+
+    int fileDescriptor;
+    bool follow;
+    std::thread reader;
+    std::thread applier;
+    std::atomic<bool> stopping;
+    std::atomic<bool> readerDone;
+    std::atomic<size_t> rowsApplied;
+
+    // owned by the reader, then by wait()
+    size_t parseErrors;
+    size_t stalls;
+    double stallSeconds;
+
+    // owned by the applier, then by wait()
+    size_t droppedRows;
+    size_t batches;
+    size_t largestBatch;
+    std::vector<float> latencies;  // in microseconds
+
+    std::chrono::steady_clock::time_point startTime;
+
+    bool parseLine(const std::string &line, IngestRow &row);
+
+    void readerLoop();
+
+    void applierLoop();
+
+    void applyBatch(std::vector<IngestRow> &batch);
+
+public:
+    StreamIngest(Disk *aDisk, Tree *aTree, size_t queueCapacity = 65536, size_t aMaxBatchSize = 4096);
+
+    ~StreamIngest();
+
+    StreamIngest(const StreamIngest &) = delete;
+
+    StreamIngest &operator=(const StreamIngest &) = delete;
+
+    // starts ingesting from path ("-" for stdin). With aFollow set, the end of the file only means "no rows yet".
+    bool start(const std::string &path, bool aFollow);
+
+    // stops following the file, the rows read up to its current end are still applied
+    void stop();
+
+    // waits until every row read has been applied and returns the statistics
+    IngestReport wait();
+
+    size_t getRowsApplied();
+
+    // runs a query on the disk and tree while no batch is being applied
+    void read(const std::function<void(Tree *, Disk *)> &query);
+};
+
+#endif
@@ -0,0 +1,97 @@
+#include "table.h"
+#include "trace.h"
+
+using namespace std;
+
+Table::Table(const string &aName, size_t extentSize, int blockSize)
+        : disk(extentSize, blockSize), votesIndex(blockSize), tconstIndex(blockSize) {
+    /*
+     * Constructor for an empty table
+     */
+    name = aName;
+    numRecords = 0;
+}
+
+Record *Table::insertRecord(const string &tconst, unsigned char avgRating, int numVotes) {
+    /*
+     * Stores a record on the table's disk and adds it to both indexes. Returns nullptr, and leaves the indexes
+     * unchanged, if the disk is full.
+     */
+    Record *record = disk.insertRecord(tconst, avgRating, numVotes);
+    if (record == nullptr) {
+        // the disk is full (traced by the disk), the record is dropped
+        return nullptr;
+    }
+    votesIndex.insert(record->numVotes, record);
+    if (isEscaped(record)) {
+        escapedIndex[tconst].push_back(record);
+    } else {
+        tconstIndex.insert((int) record->tconst, record);
+    }
+    numRecords++;
+    return record;
+}
+
+vector<Record *> *Table::lookupTconst(Table *source, const Record *record) {
+    /*
+     * Returns the records of this table with the same tconst as a record of the source table, or nullptr if
+     * there are none
+     */
+    if (!isEscaped(record)) {
+        return tconstIndex.search((int) record->tconst, false);
+    }
+    auto itr = escapedIndex.find(source->getDisk()->decodeTconst(record));
+    return itr == escapedIndex.end() ? nullptr : &itr->second;
+}
+
+bool Table::isEscaped(const Record *record) {
+    return (record->tconst & TCONST_ESCAPE_BIT) != 0;
+}
+
+const string &Table::getName() {
+    return name;
+}
+
+Disk *Table::getDisk() {
+    return &disk;
+}
+
+Tree *Table::getVotesIndex() {
+    return &votesIndex;
+}
+
+Tree *Table::getTconstIndex() {
+    return &tconstIndex;
+}
+
+size_t Table::getNumRecords() {
+    return numRecords;
+}
+
+Table *Catalog::createTable(const string &name, size_t extentSize, int blockSize) {
+    /*
+     * Creates an empty table, returns nullptr if a table with that name already exists
+     */
+    if (tables.count(name) > 0) {
+        return nullptr;
+    }
+    TRACE_INFO("catalog.createTable", (int64_t) tables.size());
+    return (tables[name] = make_unique<Table>(name, extentSize, blockSize)).get();
+}
+
+Table *Catalog::getTable(const string &name) {
+    auto itr = tables.find(name);
+    return itr == tables.end() ? nullptr : itr->second.get();
+}
+
+bool Catalog::dropTable(const string &name) {
+    return tables.erase(name) > 0;
+}
+
+vector<string> Catalog::getTableNames() {
+    vector<string> names;
+    for (auto &entry: tables) {
+        names.push_back(entry.first);
+    }
+    return names;
+}
@@ -0,0 +1,71 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "dtypes.h"
+#include "disk.h"
+#include "tree.h"
+
+class Table {
+    /*
+     * A named table of Records with its own Disk, an index on numVotes and an index on tconst.
+     *
+     * The tconst index is a Tree keyed by the encoded tconst. Encoded values are only comparable between disks
+     * for conforming ids (see dtypes.h); escaped ids index into their disk's escape table, so those are indexed
+     * by their string in a separate map instead.
+     */
+private:
+    std::string name;
+    Disk disk;
+    Tree votesIndex;
+    Tree tconstIndex;
+    std::unordered_map<std::string, std::vector<Record *>> escapedIndex;
+    size_t numRecords;
+
+public:
+    Table(const std::string &aName, size_t extentSize, int blockSize);
+
+    Table(const Table &) = delete;
+
+    Table &operator=(const Table &) = delete;
+
+    Record *insertRecord(const std::string &tconst, unsigned char avgRating, int numVotes);
+
+    std::vector<Record *> *lookupTconst(Table *source, const Record *record);
+
+    static bool isEscaped(const Record *record);
+
+    const std::string &getName();
+
+    Disk *getDisk();
+
+    Tree *getVotesIndex();
+
+    Tree *getTconstIndex();
+
+    size_t getNumRecords();
+};
+
+class Catalog {
+    /*
+     * The tables of a database, by name
+     */
+private:
+    std::map<std::string, std::unique_ptr<Table>> tables;
+
+public:
+    Table *createTable(const std::string &name, size_t extentSize, int blockSize);
+
+    Table *getTable(const std::string &name);
+
+    bool dropTable(const std::string &name);
+
+    std::vector<std::string> getTableNames();
+};
+
+#endif
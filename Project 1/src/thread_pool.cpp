@@ -0,0 +1,137 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+static thread_local int currentWorkerIdx = -1;
+
+ThreadPool::ThreadPool(int numThreads) {
+    /*
+     * Constructor for a ThreadPool, starts numThreads workers (at least 1)
+     */
+    if (numThreads < 1) {
+        numThreads = 1;
+    }
+
+    nextQueue.store(0);
+    queuedTasks.store(0);
+    unfinishedTasks.store(0);
+    stopping = false;
+
+    for (int i = 0; i < numThreads; i++) {
+        queues.push_back(make_unique<WorkerQueue>());
+    }
+    for (int i = 0; i < numThreads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    /*
+     * Finishes the queued tasks, then stops and joins the workers
+     */
+    waitIdle();
+    {
+        lock_guard<mutex> lock(poolLatch);
+        stopping = true;
+    }
+    workAvailable.notify_all();
+
+    for (thread &worker: workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(function<void()> task) {
+    /*
+     * Queues a task on the workers in round-robin order
+     */
+    submit((int) (nextQueue.fetch_add(1, memory_order_relaxed) % queues.size()), std::move(task));
+}
+
+void ThreadPool::submit(int workerIdx, function<void()> task) {
+    /*
+     * Queues a task on a specific worker. Idle workers may still steal it.
+     */
+    unfinishedTasks.fetch_add(1);
+    {
+        // counted before the push, so a worker that pops the task right away never takes the counter below zero.
+        // The pool latch orders the update against a worker going to sleep.
+        lock_guard<mutex> lock(poolLatch);
+        queuedTasks.fetch_add(1);
+    }
+    {
+        WorkerQueue &queue = *queues[workerIdx % queues.size()];
+        lock_guard<mutex> lock(queue.latch);
+        queue.tasks.push_back(std::move(task));
+    }
+    workAvailable.notify_one();
+}
+
+bool ThreadPool::popTask(int workerIdx, function<void()> &task) {
+    /*
+     * Takes the newest task of the worker's own queue, otherwise steals the oldest task of another queue
+     */
+    {
+        WorkerQueue &own = *queues[workerIdx];
+        lock_guard<mutex> lock(own.latch);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i < queues.size(); i++) {
+        WorkerQueue &victim = *queues[(workerIdx + i) % queues.size()];
+        lock_guard<mutex> lock(victim.latch);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::workerLoop(int workerIdx) {
+    currentWorkerIdx = workerIdx;
+    function<void()> task;
+
+    while (true) {
+        if (popTask(workerIdx, task)) {
+            queuedTasks.fetch_sub(1);
+            task();
+            task = nullptr;
+
+            // wake up waiters once the last task has finished
+            if (unfinishedTasks.fetch_sub(1) == 1) {
+                lock_guard<mutex> lock(poolLatch);
+                allDone.notify_all();
+            }
+            continue;
+        }
+
+        // sleep until there is work or the pool shuts down
+        unique_lock<mutex> lock(poolLatch);
+        workAvailable.wait(lock, [this] { return stopping || queuedTasks.load() > 0; });
+        if (stopping && queuedTasks.load() == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::waitIdle() {
+    /*
+     * Blocks until every submitted task has finished
+     */
+    unique_lock<mutex> lock(poolLatch);
+    allDone.wait(lock, [this] { return unfinishedTasks.load() == 0; });
+}
+
+int ThreadPool::getNumThreads() {
+    return (int) workers.size();
+}
+
+int ThreadPool::getWorkerIdx() {
+    return currentWorkerIdx;
+}
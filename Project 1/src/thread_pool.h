@@ -0,0 +1,56 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+    /*
+     * Work-stealing thread pool. Every worker owns a task queue: it takes work from the back of its own queue,
+     * and when that runs dry it steals from the front of the other workers' queues.
+     */
+private:
+    struct WorkerQueue {
+        std::mutex latch;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::atomic<size_t> nextQueue;
+    std::atomic<size_t> queuedTasks;
+    std::atomic<size_t> unfinishedTasks;
+    bool stopping;
+
+    std::mutex poolLatch;
+    std::condition_variable workAvailable;
+    std::condition_variable allDone;
+
+    bool popTask(int workerIdx, std::function<void()> &task);
+
+    void workerLoop(int workerIdx);
+
+public:
+    explicit ThreadPool(int numThreads);
+
+    ~ThreadPool();
+
+    void submit(std::function<void()> task);
+
+    void submit(int workerIdx, std::function<void()> task);
+
+    void waitIdle();
+
+    int getNumThreads();
+
+    // index of the calling worker thread, or -1 when called from outside the pool
+    static int getWorkerIdx();
+};
+
+#endif
@@ -0,0 +1,63 @@
+#include "tombstone_compactor.h"
+#include "trace.h"
+
+using namespace std;
+
+TombstoneCompactor::TombstoneCompactor(Tree *aTree, mutex &aTreeLatch, size_t aLeavesPerRound,
+                                       chrono::microseconds aInterval) : treeLatch(aTreeLatch) {
+    tree = aTree;
+    leavesPerRound = max((size_t) 1, aLeavesPerRound);
+    interval = aInterval;
+    stopping = false;
+    rounds = 0;
+    purged = 0;
+    worker = thread(&TombstoneCompactor::workerLoop, this);
+}
+
+TombstoneCompactor::~TombstoneCompactor() {
+    {
+        lock_guard<mutex> lock(latch);
+        stopping.store(true);
+    }
+    wakeup.notify_one();
+    worker.join();
+}
+
+void TombstoneCompactor::wake() {
+    wakeup.notify_one();
+}
+
+void TombstoneCompactor::workerLoop() {
+    /*
+     * Runs rounds back to back while there are tombstones, yielding in between so the foreground can take the
+     * latch, and sleeps for the interval otherwise
+     */
+    while (!stopping.load()) {
+        bool ranRound = false;
+        {
+            lock_guard<mutex> lock(treeLatch);
+            if (tree->getTombstones() > 0) {
+                size_t purgedInRound = tree->compactTombstones(leavesPerRound);
+                purged.fetch_add(purgedInRound);
+                rounds.fetch_add(1);
+                ranRound = true;
+                TRACE_DEBUG("compactor.round", (int64_t) purgedInRound);
+            }
+        }
+        if (ranRound) {
+            this_thread::yield();
+            continue;
+        }
+
+        unique_lock<mutex> lock(latch);
+        wakeup.wait_for(lock, interval, [&]() { return stopping.load(); });
+    }
+}
+
+size_t TombstoneCompactor::getRounds() {
+    return rounds.load();
+}
+
+size_t TombstoneCompactor::getPurged() {
+    return purged.load();
+}
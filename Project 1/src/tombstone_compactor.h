@@ -0,0 +1,53 @@
+#ifndef TOMBSTONE_COMPACTOR_H
+#define TOMBSTONE_COMPACTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include "tree.h"
+
+class TombstoneCompactor {
+    /*
+     * Background maintenance task for a tree with deferred deletes. A worker thread runs compaction rounds of
+     * leavesPerRound leaves (Tree::compactTombstones) while there are tombstones, and checks again every
+     * interval once there are none. Each round holds treeLatch, the latch every other user of the tree must hold
+     * as well, so a round is the longest a foreground operation waits for it.
+     */
+private:
+    Tree *tree;
+    std::mutex &treeLatch;
+    size_t leavesPerRound;
+    std::chrono::microseconds interval;
+
+    std::thread worker;
+    std::atomic<bool> stopping;
+    std::mutex latch;
+    std::condition_variable wakeup;
+
+    std::atomic<size_t> rounds;
+    std::atomic<size_t> purged;
+
+    void workerLoop();
+
+public:
+    TombstoneCompactor(Tree *aTree, std::mutex &aTreeLatch, size_t aLeavesPerRound = 8,
+                       std::chrono::microseconds aInterval = std::chrono::microseconds(1000));
+
+    ~TombstoneCompactor();
+
+    TombstoneCompactor(const TombstoneCompactor &) = delete;
+
+    TombstoneCompactor &operator=(const TombstoneCompactor &) = delete;
+
+    // starts a round now instead of at the end of the current interval
+    void wake();
+
+    size_t getRounds();
+
+    size_t getPurged();
+};
+
+#endif
@@ -0,0 +1,99 @@
+#include "trace.h"
+
+#include <chrono>
+#include <cstdio>
+
+using namespace std;
+
+// each thread gets a small sequential id the first time it records an event
+static atomic<uint32_t> nextThreadId{1};
+static thread_local uint32_t currentThreadId = 0;
+
+Tracer::Tracer() {
+    /*
+     * Constructor for the Tracer, the ring buffer is allocated once up front so that recording never allocates
+     */
+    events = new TraceEvent[capacity]();
+    nextSlot.store(0);
+    runtimeLevel.store(TRACE_LEVEL);
+}
+
+Tracer &Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+uint64_t Tracer::now() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Tracer::setLevel(int level) {
+    /*
+     * Sets the runtime level. Levels above the compiled TRACE_LEVEL are compiled out and cannot be enabled.
+     */
+    runtimeLevel.store(level < TRACE_LEVEL ? level : TRACE_LEVEL, memory_order_relaxed);
+}
+
+int Tracer::getLevel() {
+    return runtimeLevel.load(memory_order_relaxed);
+}
+
+void Tracer::record(int level, char phase, const char *name, int64_t arg, uint64_t timestampNs,
+                    uint64_t durationNs) {
+    /*
+     * Writes an event into the next slot of the ring buffer, overwriting the oldest event when full.
+     */
+    if (currentThreadId == 0) {
+        currentThreadId = nextThreadId.fetch_add(1, memory_order_relaxed);
+    }
+
+    uint64_t slot = nextSlot.fetch_add(1, memory_order_relaxed);
+    TraceEvent &event = events[slot & (capacity - 1)];
+    event.timestampNs = timestampNs;
+    event.durationNs = durationNs;
+    event.name = name;
+    event.arg = arg;
+    event.threadId = currentThreadId;
+    event.level = (unsigned char) level;
+    event.phase = phase;
+}
+
+size_t Tracer::getEventCount() {
+    uint64_t recorded = nextSlot.load(memory_order_relaxed);
+    return recorded < capacity ? recorded : capacity;
+}
+
+void Tracer::clear() {
+    nextSlot.store(0, memory_order_relaxed);
+}
+
+bool Tracer::dumpChromeTrace(const string &path) {
+    /*
+     * Dumps the events currently held in the ring buffer (oldest first) as a Chrome trace JSON file.
+     * Timestamps are written in microseconds, as expected by the format.
+     */
+    FILE *file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+
+    uint64_t recorded = nextSlot.load(memory_order_relaxed);
+    uint64_t first = recorded > capacity ? recorded - capacity : 0;
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (uint64_t slot = first; slot < recorded; slot++) {
+        const TraceEvent &event = events[slot & (capacity - 1)];
+        fprintf(file, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+                event.name, event.phase, (double) event.timestampNs / 1000, event.threadId);
+        if (event.phase == 'X') {
+            fprintf(file, ",\"dur\":%.3f", (double) event.durationNs / 1000);
+        } else {
+            fprintf(file, ",\"s\":\"t\"");
+        }
+        fprintf(file, ",\"args\":{\"value\":%lld}}%s\n", (long long) event.arg, slot + 1 < recorded ? "," : "");
+    }
+    fprintf(file, "]}\n");
+
+    fclose(file);
+    return true;
+}
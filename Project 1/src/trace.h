@@ -0,0 +1,124 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/*
+ * Compile-time selectable tracing layer.
+ *
+ * TRACE_LEVEL is fixed at build time (see CMakeLists.txt):
+ *  -> 0: off, every TRACE_* macro expands to nothing and the hot paths pay nothing
+ *  -> 1: error, 2: info, 3: debug
+ *
+ * Events up to the compiled level are further filtered by a runtime level, and are stored as small
+ * binary records in a fixed-size in-memory ring buffer. The buffer can be dumped in the Chrome trace
+ * event format, which can be opened with chrome://tracing or ui.perfetto.dev.
+ */
+#define TRACE_LEVEL_OFF 0
+#define TRACE_LEVEL_ERROR 1
+#define TRACE_LEVEL_INFO 2
+#define TRACE_LEVEL_DEBUG 3
+
+#ifndef TRACE_LEVEL
+#define TRACE_LEVEL TRACE_LEVEL_OFF
+#endif
+
+struct TraceEvent {
+    uint64_t timestampNs;
+    uint64_t durationNs;
+    const char *name;  // must point to a string literal, only the pointer is stored
+    int64_t arg;
+    uint32_t threadId;
+    unsigned char level;
+    char phase;  // 'i' = instant event, 'X' = complete event (with duration)
+};
+
+class Tracer {
+private:
+    static const size_t capacity = 1 << 16;  // must be a power of 2
+    TraceEvent *events;
+    std::atomic<uint64_t> nextSlot;
+    std::atomic<int> runtimeLevel;
+
+    Tracer();
+
+public:
+    static Tracer &instance();
+
+    static uint64_t now();
+
+    void setLevel(int level);
+
+    int getLevel();
+
+    bool isEnabled(int level) {
+        return level <= runtimeLevel.load(std::memory_order_relaxed);
+    }
+
+    void record(int level, char phase, const char *name, int64_t arg, uint64_t timestampNs, uint64_t durationNs);
+
+    void emit(int level, const char *name, int64_t arg) {
+        if (isEnabled(level)) {
+            record(level, 'i', name, arg, now(), 0);
+        }
+    }
+
+    size_t getEventCount();
+
+    void clear();
+
+    bool dumpChromeTrace(const std::string &path);
+};
+
+class TraceScope {
+    /*
+     * Records a complete ('X') event spanning the lifetime of the object.
+     */
+private:
+    int level;
+    const char *name;
+    int64_t arg;
+    uint64_t start;
+
+public:
+    TraceScope(int aLevel, const char *aName, int64_t aArg) : level(aLevel), name(aName), arg(aArg), start(0) {
+        if (Tracer::instance().isEnabled(level)) {
+            start = Tracer::now();
+        }
+    }
+
+    ~TraceScope() {
+        if (start != 0) {
+            Tracer::instance().record(level, 'X', name, arg, start, Tracer::now() - start);
+        }
+    }
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+#if TRACE_LEVEL >= TRACE_LEVEL_ERROR
+#define TRACE_ERROR(name, arg) Tracer::instance().emit(TRACE_LEVEL_ERROR, name, arg)
+#else
+#define TRACE_ERROR(name, arg) ((void) 0)
+#endif
+
+#if TRACE_LEVEL >= TRACE_LEVEL_INFO
+#define TRACE_INFO(name, arg) Tracer::instance().emit(TRACE_LEVEL_INFO, name, arg)
+#define TRACE_SCOPE_INFO(name, arg) TraceScope TRACE_CONCAT(traceScope, __LINE__)(TRACE_LEVEL_INFO, name, arg)
+#else
+#define TRACE_INFO(name, arg) ((void) 0)
+#define TRACE_SCOPE_INFO(name, arg) ((void) 0)
+#endif
+
+#if TRACE_LEVEL >= TRACE_LEVEL_DEBUG
+#define TRACE_DEBUG(name, arg) Tracer::instance().emit(TRACE_LEVEL_DEBUG, name, arg)
+#define TRACE_SCOPE_DEBUG(name, arg) TraceScope TRACE_CONCAT(traceScope, __LINE__)(TRACE_LEVEL_DEBUG, name, arg)
+#else
+#define TRACE_DEBUG(name, arg) ((void) 0)
+#define TRACE_SCOPE_DEBUG(name, arg) ((void) 0)
+#endif
+
+#endif
@@ -1,6 +1,10 @@
 #include <iostream>
 #include <queue>
+#include <climits>
 #include "tree.h"
+#include "histogram.h"
+#include "bloom_filter.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -15,6 +19,7 @@ Node::ptr::~ptr() {
 Node::Node() {
     this->isLeafNode = false;
     this->pNextLeaf = nullptr;
+    this->pPrevLeaf = nullptr;
 }
 
 
@@ -32,7 +37,24 @@ Tree::Tree(int blockSize) {
     n = (blockSize - 8) / (8 + 4);
     maxInternalChild = n + 1;
     rootNode = nullptr;
+    histogram = nullptr;
+    bloomFilter = nullptr;
+    bufferCapacity = 0;
+    aggregatesEnabled = false;
+    deferredDeletes = false;
+    tombstones = 0;
+    compactCursor = INT_MIN;
+    pendingMessages = 0;
+    nodesAccessedNum = 0;
+    this->blockSize = blockSize;
+
+    TRACE_INFO("tree.init", n);
+}
 
+void Tree::printInfo() {
+    /*
+     * Prints the parameters of the B+ tree
+     */
     cout << "Instantiating B+ Tree" << endl;
     cout << " -> Nodes bounded by block size of = " << blockSize << endl;
     cout << " -> Maximum number of keys in a node: n = " << n << endl;
@@ -65,6 +87,36 @@ void Tree::setRoot(Node *ptr) {
     this->rootNode = ptr;
 }
 
+Histogram *Tree::getHistogram() {
+    return histogram;
+}
+
+void Tree::setHistogram(Histogram *aHistogram) {
+    /*
+     * Attaches a histogram that is (re)built from the leaf chain and then kept up to date on insert and remove.
+     * Passing nullptr detaches it.
+     */
+    histogram = aHistogram;
+    if (histogram != nullptr) {
+        histogram->build(this);
+    }
+}
+
+BloomFilter *Tree::getBloomFilter() {
+    return bloomFilter;
+}
+
+void Tree::setBloomFilter(BloomFilter *aBloomFilter) {
+    /*
+     * Attaches a Bloom filter that search() consults before walking the tree. It is built from the tree and then
+     * kept up to date on insert, and rebuilt periodically to drop removed keys. Passing nullptr detaches it.
+     */
+    bloomFilter = aBloomFilter;
+    if (bloomFilter != nullptr) {
+        bloomFilter->build(this);
+    }
+}
+
 Node **Tree::findParentNode(Node *currentNode, Node *child) {
     /*
      * Finds and return the parent node.
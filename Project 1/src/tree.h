@@ -1,14 +1,51 @@
 #ifndef TREE_H
 #define TREE_H
 
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <utility>
 #include <vector>
 #include "dtypes.h"
 
+class Histogram;
+
+class BloomFilter;
+
+class FrozenTree;
+
+struct BufferMessage {
+    int key;
+    Record *pRecord;  // record to insert under key, or nullptr to remove the key
+};
+
+// COUNT and SUM(averageRating) over the records of a subtree, averageRating in tenths as stored in Record
+struct Aggregate {
+    long long count = 0;
+    long long ratingSum = 0;
+
+    void merge(const Aggregate &other) {
+        count += other.count;
+        ratingSum += other.ratingSum;
+    }
+
+    double getAverageRating() const {
+        return count == 0 ? 0 : (double) ratingSum / count / 10;
+    }
+};
+
 class Node {
 public:
     bool isLeafNode;
     std::vector<int> keys;
     Node *pNextLeaf;
+    Node *pPrevLeaf;
+
+    // pending insert/remove messages for this subtree, oldest first (internal nodes in buffered mode only)
+    std::vector<BufferMessage> buffer;
+
+    // aggregate of the subtree under each child pointer (internal nodes, when aggregates are enabled)
+    std::vector<Aggregate> childAggregates;
 
     union ptr {
         std::vector<Node *> pNode;
@@ -23,22 +60,105 @@ public:
     Node();
 };
 
+class ReverseCursor {
+    /*
+     * Walks the keys of a tree in descending order through the backward leaf links. The cursor is invalidated
+     * by any change to the tree.
+     */
+private:
+    Node *leaf;
+    int keyIdx;
+
+public:
+    ReverseCursor(Node *aLeaf, int aKeyIdx);
+
+    bool isValid();
+
+    int getKey();
+
+    std::vector<Record *> &getRecords();
+
+    void prev();
+};
+
 class Tree {
 private:
+    int blockSize;
     int maxInternalChild;
     int n;
-    int nodesAccessedNum;
+    // relaxed loads and stores rather than increments, so concurrent readers (see query_server.h) only lose counts
+    std::atomic<int> nodesAccessedNum;
     Node *rootNode;
+    Histogram *histogram;
+    BloomFilter *bloomFilter;
+
+    // buffered (B-epsilon) ingest mode, see tree_buffer.cpp
+    int bufferCapacity;
+    size_t pendingMessages;
+    std::vector<BufferMessage> leafBatch;
+    std::vector<Record *> bufferedResult;
+
+    // per-child aggregates, see tree_aggregate.cpp
+    bool aggregatesEnabled;
+
+    // deferred deletes, see tree_tombstone.cpp
+    bool deferredDeletes;
+    size_t tombstones;
+    int compactCursor;  // key of the leaf the next compaction round starts at
+
+    void countNodeAccess() {
+        nodesAccessedNum.store(nodesAccessedNum.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
 
     void insertInternal(int x, Node **currentNode, Node **child);
 
     Node **findParentNode(Node *currentNode, Node *child);
 
+    std::vector<Record *> *searchLeaf(int key, bool printNode);
+
+    void insertIntoLeaf(int key, Record *pRecord);
+
+    void removeFromLeaf(int key);
+
+    void rebalanceLeaf(Node *leaf, Node *parentNode, int parentLeft, int parentRight);
+
+    void noteInsert(int key, Record *pRecord, bool newKey);
+
+    void noteRemove(int key, std::vector<Record *> &records, bool keyRemoved);
+
+    void enqueueMessage(const BufferMessage &message);
+
+    void flushBuffer(Node *currentNode, bool flushAll);
+
+    void applyLeafBatch();
+
+    void moveMessages(Node *from, Node *to, int splitKey, bool moveUpper);
+
+    Aggregate computeAggregate(Node *node);
+
+    Aggregate buildAggregates(Node *node);
+
+    void addToAggregates(int key, const Aggregate &delta, int sign);
+
+    void aggregateNode(Node *node, int lowerKey, int upperKey, bool checkLower, bool checkUpper, Aggregate &result);
+
+    Node *findLeaf(int key, long long *lowerKey, long long *upperKey);
+
+    bool updateInLeaf(Node *leaf, long long lowerKey, long long upperKey, Record *pRecord, int newKey);
+
+    bool moveRecord(Node *leaf, Record *pRecord, int newKey);
+
+    void markTombstone(int key);
+
+    size_t purgeLeaf(int key);
+
 public:
     explicit Tree(int blockSize);
 
     Node *getRoot();
 
+    void printInfo();
+
     int countNodes();
 
     int countHeight();
@@ -53,6 +173,14 @@ public:
 
     void setRoot(Node *);
 
+    Histogram *getHistogram();
+
+    void setHistogram(Histogram *aHistogram);
+
+    BloomFilter *getBloomFilter();
+
+    void setBloomFilter(BloomFilter *aBloomFilter);
+
     void displayCurrentNode(Node *currentNode);
 
     std::vector<Record *> *search(int key, bool printNode);
@@ -65,6 +193,42 @@ public:
 
     void removeInternal(int x, Node *currentNode, Node *child);
 
+    void setBufferCapacity(int capacity);
+
+    int getBufferCapacity();
+
+    size_t getPendingMessages();
+
+    void flushAllBuffers();
+
+    void insertBatch(const std::vector<std::pair<int, Record *>> &entries);
+
+    FrozenTree freeze();
+
+    ReverseCursor reverseCursor(int upperKey);
+
+    std::vector<Record *> topK(size_t k);
+
+    void setAggregatesEnabled(bool enabled);
+
+    bool isAggregatesEnabled();
+
+    Aggregate aggregateRange(int lowerKey, int upperKey);
+
+    bool update(Record *pRecord, int newKey);
+
+    size_t updateBatch(std::vector<std::pair<Record *, int>> &updates);
+
+    void setDeferredDeletes(bool enabled);
+
+    bool isDeferredDeletes();
+
+    size_t getTombstones();
+
+    size_t compactTombstones(size_t maxLeaves);
+
+    bool bulkLoad(const std::function<bool(int &key, Record *&pRecord)> &next);
+
 };
 
 
@@ -0,0 +1,183 @@
+#include <algorithm>
+#include "tree.h"
+#include "trace.h"
+
+using namespace std;
+
+/*
+ * Per-child aggregates.
+ *
+ * When enabled, every internal node keeps the COUNT and SUM(averageRating) of the subtree under each of its child
+ * pointers in childAggregates, parallel to pointer.pNode. An insert or remove adds its records to the entries on
+ * its path before the leaf is changed. Splits, borrows and merges then recompute the entries of the nodes
+ * involved, and move the entries of the children that change parents along with them.
+ *
+ * aggregateRange() only descends along the paths of its two boundary keys and takes every child in between from
+ * these entries, so a range COUNT / SUM / AVG visits O(height) nodes.
+ */
+
+void Tree::setAggregatesEnabled(bool enabled) {
+    /*
+     * Enables the aggregates, computing them for the whole tree, or disables and drops them
+     */
+    aggregatesEnabled = enabled;
+    if (rootNode == nullptr) {
+        return;
+    }
+    if (enabled) {
+        buildAggregates(rootNode);
+    } else {
+        // clear the entries on every internal node
+        vector<Node *> nodes = {rootNode};
+        while (!nodes.empty()) {
+            Node *node = nodes.back();
+            nodes.pop_back();
+            if (!node->isLeafNode) {
+                node->childAggregates.clear();
+                nodes.insert(nodes.end(), node->pointer.pNode.begin(), node->pointer.pNode.end());
+            }
+        }
+    }
+}
+
+bool Tree::isAggregatesEnabled() {
+    return aggregatesEnabled;
+}
+
+Aggregate Tree::computeAggregate(Node *node) {
+    /*
+     * Returns the aggregate of a subtree: from the records of a leaf, or from the entries of an internal node
+     */
+    Aggregate result;
+    if (node->isLeafNode) {
+        for (auto &records: node->pointer.pData) {
+            for (Record *record: records) {
+                result.count++;
+                result.ratingSum += record->averageRating;
+            }
+        }
+    } else {
+        for (Aggregate &entry: node->childAggregates) {
+            result.merge(entry);
+        }
+    }
+    return result;
+}
+
+Aggregate Tree::buildAggregates(Node *node) {
+    /*
+     * Computes the entries of every internal node in a subtree, bottom up, and returns the subtree's aggregate
+     */
+    if (node->isLeafNode) {
+        return computeAggregate(node);
+    }
+
+    node->childAggregates.clear();
+    for (Node *child: node->pointer.pNode) {
+        node->childAggregates.push_back(buildAggregates(child));
+    }
+    return computeAggregate(node);
+}
+
+void Tree::addToAggregates(int key, const Aggregate &delta, int sign) {
+    /*
+     * Adds (sign 1) or subtracts (sign -1) delta on every entry along the path to the leaf of key
+     */
+    Node *currentNode = rootNode;
+    while (currentNode != nullptr && !currentNode->isLeafNode) {
+        int idx = upper_bound(currentNode->keys.begin(), currentNode->keys.end(), key) - currentNode->keys.begin();
+        Aggregate &entry = currentNode->childAggregates[idx];
+        entry.count += sign * delta.count;
+        entry.ratingSum += sign * delta.ratingSum;
+        currentNode = currentNode->pointer.pNode[idx];
+    }
+}
+
+void Tree::aggregateNode(Node *node, int lowerKey, int upperKey, bool checkLower, bool checkUpper,
+                         Aggregate &result) {
+    /*
+     * Adds the records of a subtree with lowerKey <= key <= upperKey to result. checkLower / checkUpper are
+     * cleared once the subtree is known to lie above lowerKey / below upperKey.
+     */
+    countNodeAccess();
+
+    if (node->isLeafNode) {
+        for (int i = 0; i < node->keys.size(); i++) {
+            if ((!checkLower || node->keys[i] >= lowerKey) && (!checkUpper || node->keys[i] <= upperKey)) {
+                for (Record *record: node->pointer.pData[i]) {
+                    result.count++;
+                    result.ratingSum += record->averageRating;
+                }
+            }
+        }
+        return;
+    }
+
+    // the children holding the two boundary keys
+    int first = checkLower ? upper_bound(node->keys.begin(), node->keys.end(), lowerKey) - node->keys.begin() : 0;
+    int last = checkUpper ? upper_bound(node->keys.begin(), node->keys.end(), upperKey) - node->keys.begin()
+                          : (int) node->keys.size();
+
+    if (first == last) {
+        aggregateNode(node->pointer.pNode[first], lowerKey, upperKey, checkLower, checkUpper, result);
+        return;
+    }
+
+    // the children in between are covered entirely
+    for (int i = first + 1; i < last; i++) {
+        result.merge(node->childAggregates[i]);
+    }
+    if (checkLower) {
+        aggregateNode(node->pointer.pNode[first], lowerKey, upperKey, true, false, result);
+    } else {
+        result.merge(node->childAggregates[first]);
+    }
+    if (checkUpper) {
+        aggregateNode(node->pointer.pNode[last], lowerKey, upperKey, false, true, result);
+    } else {
+        result.merge(node->childAggregates[last]);
+    }
+}
+
+Aggregate Tree::aggregateRange(int lowerKey, int upperKey) {
+    /*
+     * Returns COUNT and SUM(averageRating) of the records with lowerKey <= key <= upperKey, after applying any
+     * buffered messages. Uses the per-child aggregates if they are enabled, and walks the leaves otherwise.
+     */
+    TRACE_SCOPE_DEBUG("tree.aggregateRange", lowerKey);
+    flushAllBuffers();
+
+    Aggregate result;
+    if (rootNode == nullptr || lowerKey > upperKey) {
+        return result;
+    }
+
+    if (aggregatesEnabled) {
+        aggregateNode(rootNode, lowerKey, upperKey, true, true, result);
+        return result;
+    }
+
+    // no aggregates: descend to the first leaf and follow the leaf chain
+    Node *currentNode = rootNode;
+    while (!currentNode->isLeafNode) {
+        countNodeAccess();
+        int idx = upper_bound(currentNode->keys.begin(), currentNode->keys.end(), lowerKey) -
+                  currentNode->keys.begin();
+        currentNode = currentNode->pointer.pNode[idx];
+    }
+    for (; currentNode != nullptr; currentNode = currentNode->pNextLeaf) {
+        countNodeAccess();
+        for (int i = 0; i < currentNode->keys.size(); i++) {
+            if (currentNode->keys[i] > upperKey) {
+                return result;
+            }
+            if (currentNode->keys[i] >= lowerKey) {
+                for (Record *record: currentNode->pointer.pData[i]) {
+                    result.count++;
+                    result.ratingSum += record->averageRating;
+                }
+            }
+        }
+    }
+    return result;
+}
@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <climits>
+#include "tree.h"
+#include "bloom_filter.h"
+#include "trace.h"
+
+using namespace std;
+
+/*
+ * Buffered (B-epsilon) ingest mode.
+ *
+ * Instead of descending to a leaf on every insert and removeKey, the operation is appended as a message to the
+ * buffer of the root. When a buffer reaches bufferCapacity messages, all of them are routed down into the buffers
+ * of the children in one pass, and children that fill up in turn are flushed the same way. Buffers
+ * right above the leaves are emptied into one batch, which is sorted by key and applied to the leaves so that
+ * consecutive messages for the same leaf share a single descent.
+ *
+ * Messages higher up in the tree are newer than the ones below them, and within a buffer they are kept in arrival
+ * order. search() replays the messages on its path on top of the leaf entry, so lookups stay exact.
+ */
+
+void Tree::setBufferCapacity(int capacity) {
+    /*
+     * Enables buffered mode with the given buffer size per internal node, or disables it with 0.
+     * When disabling, every pending message is applied first.
+     */
+    if (capacity <= 0) {
+        flushAllBuffers();
+        bufferCapacity = 0;
+    } else {
+        bufferCapacity = capacity;
+    }
+}
+
+int Tree::getBufferCapacity() {
+    return bufferCapacity;
+}
+
+size_t Tree::getPendingMessages() {
+    return pendingMessages;
+}
+
+void Tree::enqueueMessage(const BufferMessage &message) {
+    /*
+     * Appends a message to the root's buffer, and flushes it if it is full
+     */
+    rootNode->buffer.push_back(message);
+    pendingMessages++;
+
+    if (rootNode->buffer.size() >= bufferCapacity) {
+        flushBuffer(rootNode, false);
+        applyLeafBatch();
+    }
+}
+
+void Tree::flushBuffer(Node *currentNode, bool flushAll) {
+    /*
+     * Moves the pending messages of an internal node down one level.
+     *  -> if its children are leaves, the messages go into the leaf batch
+     *  -> otherwise each message is appended to the buffer of its child, and the child buffers that are full
+     *     (or all of them, if flushAll is set) are flushed in turn
+     * The tree structure is not changed here.
+     */
+    if (currentNode->buffer.empty()) {
+        if (flushAll) {
+            for (Node *child: currentNode->pointer.pNode) {
+                if (!child->isLeafNode) {
+                    flushBuffer(child, true);
+                }
+            }
+        }
+        return;
+    }
+
+    // children are leaves, the messages are applied to them as one sorted batch
+    if (currentNode->pointer.pNode[0]->isLeafNode) {
+        pendingMessages -= currentNode->buffer.size();
+        leafBatch.insert(leafBatch.end(), currentNode->buffer.begin(), currentNode->buffer.end());
+        currentNode->buffer.clear();
+        return;
+    }
+
+    TRACE_DEBUG("tree.buffer.flush", (int64_t) currentNode->buffer.size());
+
+    // route every message to its child, keeping their order
+    for (BufferMessage &message: currentNode->buffer) {
+        int idx = upper_bound(currentNode->keys.begin(), currentNode->keys.end(), message.key) -
+                  currentNode->keys.begin();
+        currentNode->pointer.pNode[idx]->buffer.push_back(message);
+    }
+    currentNode->buffer.clear();
+
+    // flush the children that filled up (or all of them)
+    for (Node *child: currentNode->pointer.pNode) {
+        if (flushAll || child->buffer.size() >= bufferCapacity) {
+            flushBuffer(child, flushAll);
+        }
+    }
+}
+
+void Tree::applyLeafBatch() {
+    /*
+     * Applies the messages collected from the buffers above the leaves in key order (keeping the arrival order of
+     * messages for the same key). One descent is shared by all consecutive messages that land in the same leaf
+     * and can be applied without a split or merge; the others go through insertIntoLeaf / removeFromLeaf.
+     */
+    while (!leafBatch.empty()) {
+        // structural changes below may hand new messages to leafBatch, those are picked up in the next round
+        vector<BufferMessage> batch;
+        batch.swap(leafBatch);
+        stable_sort(batch.begin(), batch.end(), [](const BufferMessage &a, const BufferMessage &b) {
+            return a.key < b.key;
+        });
+
+        size_t i = 0;
+        while (i < batch.size()) {
+            size_t applied = 0;
+
+            if (rootNode != nullptr) {
+                // descend once, remembering the exclusive upper bound of the leaf's key range
+                Node *leaf = rootNode;
+                long long upperKey = LLONG_MAX;
+                while (!leaf->isLeafNode) {
+                    int idx = upper_bound(leaf->keys.begin(), leaf->keys.end(), batch[i].key) - leaf->keys.begin();
+                    if (idx < leaf->keys.size()) {
+                        upperKey = leaf->keys[idx];
+                    }
+                    leaf = leaf->pointer.pNode[idx];
+                }
+
+                // apply the messages that fit in this leaf without restructuring the tree
+                for (size_t j = i; j < batch.size() && batch[j].key < upperKey; j++) {
+                    int key = batch[j].key;
+                    int pos = lower_bound(leaf->keys.begin(), leaf->keys.end(), key) - leaf->keys.begin();
+                    bool found = pos < leaf->keys.size() && leaf->keys[pos] == key;
+
+                    if (batch[j].pRecord != nullptr) {
+                        if (!found && leaf->keys.size() >= n) {
+                            break;
+                        }
+                        // noteInsert may rebuild the histogram from the leaves, so it goes before the leaf changes
+                        noteInsert(key, batch[j].pRecord, !found || leaf->pointer.pData[pos].empty());
+                        if (found) {
+                            if (leaf->pointer.pData[pos].empty()) {
+                                tombstones--;
+                            }
+                            leaf->pointer.pData[pos].push_back(batch[j].pRecord);
+                        } else {
+                            leaf->keys.insert(leaf->keys.begin() + pos, key);
+                            leaf->pointer.pData.insert(leaf->pointer.pData.begin() + pos,
+                                                       vector<Record *>{batch[j].pRecord});
+                        }
+                    } else if (found) {
+                        int minKeys = leaf == rootNode ? 1 : (n + 1) / 2;
+                        if (leaf->keys.size() - 1 < minKeys) {
+                            break;
+                        }
+                        if (leaf->pointer.pData[pos].empty()) {
+                            tombstones--;
+                        }
+                        noteRemove(key, leaf->pointer.pData[pos], true);
+                        leaf->keys.erase(leaf->keys.begin() + pos);
+                        leaf->pointer.pData.erase(leaf->pointer.pData.begin() + pos);
+                        TRACE_INFO("tree.remove", key);
+                    } else {
+                        TRACE_INFO("tree.remove.miss", key);
+                    }
+                    applied++;
+                }
+            }
+
+            // the message needs a split or a merge (or the tree is empty)
+            if (applied == 0) {
+                if (batch[i].pRecord != nullptr) {
+                    insertIntoLeaf(batch[i].key, batch[i].pRecord);
+                } else {
+                    removeFromLeaf(batch[i].key);
+                }
+                applied = 1;
+            }
+            i += applied;
+        }
+    }
+}
+
+void Tree::flushAllBuffers() {
+    /*
+     * Applies every pending message to the leaves
+     */
+    while (pendingMessages > 0 || !leafBatch.empty()) {
+        if (rootNode != nullptr && !rootNode->isLeafNode) {
+            flushBuffer(rootNode, true);
+        }
+        applyLeafBatch();
+    }
+}
+
+void Tree::insertBatch(const vector<pair<int, Record *>> &entries) {
+    /*
+     * Inserts a batch of key-pointer pairs the way a flush applies the buffers above the leaves: sorted by key,
+     * with one descent shared by the consecutive pairs that land in the same leaf. In buffered mode the pairs
+     * are queued as messages instead.
+     */
+    if (bufferCapacity > 0 && rootNode != nullptr && !rootNode->isLeafNode) {
+        for (auto &entry: entries) {
+            insert(entry.first, entry.second);
+        }
+        return;
+    }
+
+    for (auto &entry: entries) {
+        if (bloomFilter != nullptr) {
+            if (bloomFilter->needsRebuild()) {
+                bloomFilter->build(this);
+            }
+            bloomFilter->add(entry.first);
+        }
+        leafBatch.push_back(BufferMessage{entry.first, entry.second});
+    }
+    applyLeafBatch();
+}
+
+void Tree::moveMessages(Node *from, Node *to, int splitKey, bool moveUpper) {
+    /*
+     * Moves the messages of from with key >= splitKey (moveUpper) or key < splitKey (!moveUpper) to the end of
+     * to's buffer, keeping their order. Used when a child pointer moves between internal nodes.
+     */
+    int kept = 0;
+    for (BufferMessage &message: from->buffer) {
+        if ((message.key >= splitKey) == moveUpper) {
+            to->buffer.push_back(message);
+        } else {
+            from->buffer[kept++] = message;
+        }
+    }
+    from->buffer.resize(kept);
+}
@@ -0,0 +1,146 @@
+#include "tree.h"
+#include "bloom_filter.h"
+#include "histogram.h"
+#include "trace.h"
+
+using namespace std;
+
+/*
+ * Bulk loading from sorted input.
+ *
+ * Leaves are filled left to right with n keys each (records with equal keys share one posting list), then every
+ * internal level is built from groups of maxInternalChild nodes of the level below, until one node is left.
+ * The separator in front of a child is the smallest key of its subtree, as insertInternal would have placed it.
+ * The last node of a level is topped up from its left neighbour if it ends up below the minimum fill, so the
+ * result is a valid tree that later inserts and removes can work on as usual.
+ */
+
+static void rebalanceLast(vector<Node *> &level, vector<int> &minKeys, size_t minSize, bool leaves) {
+    /*
+     * Moves entries from the second to last node of a level to the last one, so they end up with about half
+     * of their combined entries each
+     */
+    if (level.size() < 2) {
+        return;
+    }
+    Node *left = level[level.size() - 2];
+    Node *right = level.back();
+    size_t rightSize = leaves ? right->keys.size() : right->pointer.pNode.size();
+    if (rightSize >= minSize) {
+        return;
+    }
+    size_t leftSize = leaves ? left->keys.size() : left->pointer.pNode.size();
+    size_t moved = (leftSize + rightSize) / 2 - rightSize;
+
+    if (leaves) {
+        right->keys.insert(right->keys.begin(), left->keys.end() - moved, left->keys.end());
+        right->pointer.pData.insert(right->pointer.pData.begin(),
+                                    make_move_iterator(left->pointer.pData.end() - moved),
+                                    make_move_iterator(left->pointer.pData.end()));
+        left->keys.resize(leftSize - moved);
+        left->pointer.pData.resize(leftSize - moved);
+        minKeys.back() = right->keys[0];
+        return;
+    }
+
+    // the key between the two nodes comes down, and the one in front of the first moved child goes up
+    right->keys.insert(right->keys.begin(), minKeys.back());
+    right->keys.insert(right->keys.begin(), left->keys.end() - (moved - 1), left->keys.end());
+    right->pointer.pNode.insert(right->pointer.pNode.begin(), left->pointer.pNode.end() - moved,
+                                left->pointer.pNode.end());
+    minKeys.back() = left->keys[leftSize - moved - 1];
+    left->keys.resize(leftSize - moved - 1);
+    left->pointer.pNode.resize(leftSize - moved);
+}
+
+bool Tree::bulkLoad(const function<bool(int &key, Record *&pRecord)> &next) {
+    /*
+     * Builds the tree from (key, record) pairs in ascending key order, pulled from next until it returns false.
+     * A source that fails (a sort that lost a run, a full disk) aborts the load by handing out a null record.
+     * Returns false without loading anything if the tree is not empty, the keys are out of order or the load was
+     * aborted.
+     */
+    if (rootNode != nullptr) {
+        return false;
+    }
+
+    // fill the leaves
+    vector<Node *> level;
+    vector<int> minKeys;
+    int key;
+    Record *pRecord;
+    size_t loaded = 0;
+    while (next(key, pRecord)) {
+        Node *leaf = level.empty() ? nullptr : level.back();
+        if (pRecord == nullptr || (leaf != nullptr && key < leaf->keys.back())) {
+            if (pRecord == nullptr) {
+                TRACE_ERROR("tree.bulk.abort", (int64_t) loaded);
+            } else {
+                TRACE_ERROR("tree.bulk.order", key);
+            }
+            for (Node *node: level) {
+                node->pointer.pData.~vector();
+                delete node;
+            }
+            return false;
+        }
+        loaded++;
+        if (leaf != nullptr && key == leaf->keys.back()) {
+            leaf->pointer.pData.back().push_back(pRecord);
+            continue;
+        }
+        if (leaf == nullptr || leaf->keys.size() == n) {
+            Node *newLeafNode = new Node;
+            newLeafNode->isLeafNode = true;
+            new(&newLeafNode->pointer.pData) vector<vector<Record *>>;
+            newLeafNode->pointer.pData.reserve(n);
+            newLeafNode->pPrevLeaf = leaf;
+            if (leaf != nullptr) {
+                leaf->pNextLeaf = newLeafNode;
+            }
+            level.push_back(newLeafNode);
+            minKeys.push_back(key);
+            leaf = newLeafNode;
+        }
+        leaf->keys.push_back(key);
+        leaf->pointer.pData.push_back(vector<Record *>{pRecord});
+    }
+    if (level.empty()) {
+        return true;
+    }
+    rebalanceLast(level, minKeys, (n + 1) / 2, true);
+
+    // build the internal levels bottom up
+    size_t minChildren = (maxInternalChild + 1) / 2;
+    while (level.size() > 1) {
+        vector<Node *> parents;
+        vector<int> parentMinKeys;
+        for (size_t i = 0; i < level.size(); i++) {
+            if (i % maxInternalChild == 0) {
+                Node *newInternalNode = new Node;
+                new(&newInternalNode->pointer.pNode) vector<Node *>;
+                parents.push_back(newInternalNode);
+                parentMinKeys.push_back(minKeys[i]);
+            } else {
+                parents.back()->keys.push_back(minKeys[i]);
+            }
+            parents.back()->pointer.pNode.push_back(level[i]);
+        }
+        rebalanceLast(parents, parentMinKeys, minChildren, false);
+        level.swap(parents);
+        minKeys.swap(parentMinKeys);
+    }
+    rootNode = level[0];
+    TRACE_INFO("tree.bulk", (int64_t) loaded);
+
+    if (aggregatesEnabled) {
+        buildAggregates(rootNode);
+    }
+    if (histogram != nullptr) {
+        histogram->build(this);
+    }
+    if (bloomFilter != nullptr) {
+        bloomFilter->build(this);
+    }
+    return true;
+}
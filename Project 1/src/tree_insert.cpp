@@ -2,19 +2,71 @@
 #include <algorithm>
 #include "dtypes.h"
 #include "tree.h"
+#include "histogram.h"
+#include "bloom_filter.h"
+#include "trace.h"
 
 using namespace std;
 
-void Tree::insert(int key, Record *pRecord) {  //in Leaf Node
+void Tree::insert(int key, Record *pRecord) {
     /*
      * Inserts a key-pointer pair into the B+ tree index.
+     * In buffered mode the insertion is queued as a message in the root's buffer instead.
      */
+    TRACE_SCOPE_DEBUG("tree.insert", key);
 
+    // the filter learns the key before it can be looked up, even while it is still buffered
+    if (bloomFilter != nullptr) {
+        if (bloomFilter->needsRebuild()) {
+            bloomFilter->build(this);
+        }
+        bloomFilter->add(key);
+    }
+
+    if (bufferCapacity > 0 && rootNode != nullptr && !rootNode->isLeafNode) {
+        enqueueMessage(BufferMessage{key, pRecord});
+        return;
+    }
+    insertIntoLeaf(key, pRecord);
+}
+
+void Tree::noteInsert(int key, Record *pRecord, bool newKey) {
+    /*
+     * Bookkeeping for a record that is about to be added to a leaf. newKey is set if the key has no records yet
+     * (it is not in the tree, or only as a tombstone). Call it before the leaf changes: a rebuild of the
+     * histogram in here reads the leaves, and would count the record twice otherwise.
+     */
+    // keep the histogram up to date, rebuilding it first if it has drifted too far
+    if (histogram != nullptr) {
+        if (histogram->needsRebuild()) {
+            histogram->build(this);
+        }
+        histogram->add(key, 1, newKey);
+    }
+
+    // account for the record on the path down to its leaf
+    if (aggregatesEnabled) {
+        Aggregate delta;
+        delta.count = 1;
+        delta.ratingSum = pRecord->averageRating;
+        addToAggregates(key, delta, 1);
+    }
+}
+
+void Tree::insertIntoLeaf(int key, Record *pRecord) {  //in Leaf Node
+    /*
+     * Inserts a key-pointer pair into the leaf it belongs to, splitting nodes as needed.
+     */
     // search the tree for the key
-    vector<Record *> *result = search(key, false);
+    vector<Record *> *result = searchLeaf(key, false);
+    noteInsert(key, pRecord, result == nullptr || result->empty());
 
     // if the key exists, simply add the currentNode Record pointer to the existing vector and return
     if (result != nullptr) {
+        // an empty list is a tombstone (deferred deletes), which the record brings back to life
+        if (result->empty()) {
+            tombstones--;
+        }
         (*result).push_back(pRecord);
         return;
     }
@@ -90,10 +142,14 @@ void Tree::insert(int key, Record *pRecord) {  //in Leaf Node
             newLeafNode->isLeafNode = true;
             new(&newLeafNode->pointer.pData) vector<Record *>;
 
-            // swap pNextLeaf pointers
+            // swap pNextLeaf pointers, and link the new node back to its neighbours
             Node *temp = currentNode->pNextLeaf;
             currentNode->pNextLeaf = newLeafNode;
             newLeafNode->pNextLeaf = temp;
+            newLeafNode->pPrevLeaf = currentNode;
+            if (temp != nullptr) {
+                temp->pPrevLeaf = newLeafNode;
+            }
 
             // resize and copy key-pointer pairs into the old node
             currentNode->keys.resize((n) / 2 + 1);
@@ -109,6 +165,8 @@ void Tree::insert(int key, Record *pRecord) {  //in Leaf Node
                 newLeafNode->pointer.pData.push_back(virtualDataNode[i]);
             }
 
+            TRACE_DEBUG("tree.split.leaf", newLeafNode->keys[0]);
+
             // if currentNode points to rootNode, create a new node
             if (currentNode == rootNode) {
                 Node *newRootNode = new Node;
@@ -116,6 +174,9 @@ void Tree::insert(int key, Record *pRecord) {  //in Leaf Node
                 new(&newRootNode->pointer.pNode) vector<Node *>;
                 newRootNode->pointer.pNode.push_back(currentNode);
                 newRootNode->pointer.pNode.push_back(newLeafNode);
+                if (aggregatesEnabled) {
+                    newRootNode->childAggregates = {computeAggregate(currentNode), computeAggregate(newLeafNode)};
+                }
                 rootNode = newRootNode;
             } else {
                 // insert new key into the parentNode
@@ -153,6 +214,13 @@ void Tree::insertInternal(int x, Node **currentNode, Node **child) {
             (*currentNode)->keys[idx] = x;
             (*currentNode)->pointer.pNode[idx + 1] = *child;
         }
+
+        // the child was split off its left sibling, so both aggregates change
+        if (aggregatesEnabled) {
+            (*currentNode)->childAggregates.insert((*currentNode)->childAggregates.begin() + idx + 1,
+                                                   computeAggregate(*child));
+            (*currentNode)->childAggregates[idx] = computeAggregate((*currentNode)->pointer.pNode[idx]);
+        }
     } else {  //splitting
         // the currentNode node is full, we have to split the node
         vector<int> virtualKeyNode((*currentNode)->keys);
@@ -181,6 +249,14 @@ void Tree::insertInternal(int x, Node **currentNode, Node **child) {
             virtualTreePNode[idx + 1] = *child;
         }
 
+        // the child aggregates follow the pointers
+        vector<Aggregate> virtualAggregates;
+        if (aggregatesEnabled) {
+            virtualAggregates = (*currentNode)->childAggregates;
+            virtualAggregates.insert(virtualAggregates.begin() + idx + 1, computeAggregate(*child));
+            virtualAggregates[idx] = computeAggregate(virtualTreePNode[idx]);
+        }
+
         int partitionKey;  // middle element excluded
         partitionKey = virtualKeyNode[(virtualKeyNode.size() / 2)];  // split is right-biased
         auto partitionIdx = (virtualKeyNode.size() / 2);
@@ -200,6 +276,9 @@ void Tree::insertInternal(int x, Node **currentNode, Node **child) {
         Node *newInternalNode = new Node;
         new(&newInternalNode->pointer.pNode) std::vector<Node *>;
 
+        // pending messages for the children that move to the new node move along with them
+        moveMessages(*currentNode, newInternalNode, partitionKey, true);
+
         // copy key-pointer pairs into the newly created node
         for (auto i = partitionIdx + 1; i < virtualKeyNode.size(); i++) {
             newInternalNode->keys.push_back(virtualKeyNode[i]);
@@ -210,6 +289,15 @@ void Tree::insertInternal(int x, Node **currentNode, Node **child) {
             newInternalNode->pointer.pNode.push_back(virtualTreePNode[i]);
         }
 
+        if (aggregatesEnabled) {
+            (*currentNode)->childAggregates.assign(virtualAggregates.begin(),
+                                                   virtualAggregates.begin() + partitionIdx + 1);
+            newInternalNode->childAggregates.assign(virtualAggregates.begin() + partitionIdx + 1,
+                                                    virtualAggregates.end());
+        }
+
+        TRACE_DEBUG("tree.split.internal", partitionKey);
+
         // if currentNode points to rootNode, create a new node
         if ((*currentNode) == rootNode) {
             Node *newRootNode = new Node;
@@ -217,6 +305,9 @@ void Tree::insertInternal(int x, Node **currentNode, Node **child) {
             new(&newRootNode->pointer.pNode) std::vector<Node *>;
             newRootNode->pointer.pNode.push_back(*currentNode);
             newRootNode->pointer.pNode.push_back(newInternalNode);
+            if (aggregatesEnabled) {
+                newRootNode->childAggregates = {computeAggregate(*currentNode), computeAggregate(newInternalNode)};
+            }
             rootNode = newRootNode;
         } else {
             insertInternal(partitionKey, findParentNode(rootNode, *currentNode), &newInternalNode);
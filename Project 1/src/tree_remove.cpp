@@ -1,18 +1,68 @@
 #include <iostream>
+#include <climits>
 #include <cstring>
+#include <iterator>
 #include "tree.h"
+#include "histogram.h"
+#include "bloom_filter.h"
+#include "trace.h"
 
 using namespace std;
 
 void Tree::removeKey(int x) {
     /*
-     * Removes a key from the B+ tree.
+     * Removes a key, and all the Record pointers stored under it, from the B+ tree.
+     * In buffered mode the removal is queued as a message in the root's buffer instead, and with deferred
+     * deletes the key is only marked as a tombstone in its leaf.
+     */
+    TRACE_SCOPE_DEBUG("tree.removeKey", x);
+
+    if (bufferCapacity > 0 && rootNode != nullptr && !rootNode->isLeafNode) {
+        enqueueMessage(BufferMessage{x, nullptr});
+    } else if (deferredDeletes) {
+        markTombstone(x);
+    } else {
+        removeFromLeaf(x);
+    }
+
+    // removed keys stay in the filter until it is rebuilt
+    if (bloomFilter != nullptr) {
+        bloomFilter->remove(x);
+        if (bloomFilter->needsRebuild()) {
+            bloomFilter->build(this);
+        }
+    }
+}
+
+void Tree::noteRemove(int key, vector<Record *> &records, bool keyRemoved) {
+    /*
+     * Bookkeeping for records of a key that are about to be removed from a leaf, keyRemoved if they are all of
+     * its records. A tombstone has no records left, its key was already accounted for as removed.
+     */
+    if (histogram != nullptr) {
+        histogram->remove(key, records.size(), keyRemoved && !records.empty());
+    }
+
+    // take the records out of the aggregates on the path down to their leaf
+    if (aggregatesEnabled) {
+        Aggregate delta;
+        for (Record *record: records) {
+            delta.count++;
+            delta.ratingSum += record->averageRating;
+        }
+        addToAggregates(key, delta, -1);
+    }
+}
+
+void Tree::removeFromLeaf(int x) {
+    /*
+     * Removes a key from its leaf, then borrows from or merges with a sibling if the leaf becomes underfull.
      */
     Node *rootNode = getRoot();
 
     // check if the B+ tree is empty
     if (rootNode == nullptr) {
-        cout << "Unable to remove: The B+ tree is empty!" << endl;
+        TRACE_INFO("tree.remove.empty", x);
         return;
     }
 
@@ -20,108 +70,115 @@ void Tree::removeKey(int x) {
     Node *parentNode;
     int parentLeft, parentRight;
 
-    // traverse until the leaf node
+    // traverse until the leaf node, remembering the positions of its siblings in the parent
     while (!currentNode->isLeafNode) {
-        for (int i = 0; i < currentNode->keys.size(); i++) {
-            parentNode = currentNode;
-            parentLeft = i - 1;  // left side of parentNode
-            parentRight = i + 1;  // right side of parentNode
-
-            if (x < currentNode->keys[i]) {
-                currentNode = currentNode->pointer.pNode[i];
-                break;
-            }
-            if (i == currentNode->keys.size() - 1) {
-                parentLeft = i;
-                parentRight = i + 2;
-                currentNode = currentNode->pointer.pNode[i + 1];
-                break;
-            }
-        }
+        int idx = upper_bound(currentNode->keys.begin(), currentNode->keys.end(), x) - currentNode->keys.begin();
+        parentNode = currentNode;
+        parentLeft = idx - 1;  // left side of parentNode
+        parentRight = idx + 1;  // right side of parentNode
+        currentNode = currentNode->pointer.pNode[idx];
     }
 
     // check if the key exist in the currentNode leaf node
-    int pos = 0;
-    for (pos = 0; pos < currentNode->keys.size(); pos++) {
-        if (currentNode->keys[pos] == x) {
-            break;
-        }
+    int pos = lower_bound(currentNode->keys.begin(), currentNode->keys.end(), x) - currentNode->keys.begin();
+    if (pos == currentNode->keys.size() || currentNode->keys[pos] != x) {
+        TRACE_INFO("tree.remove.miss", x);
+        return;
     }
 
-    auto itr = lower_bound(currentNode->keys.begin(), currentNode->keys.end(), x);
-
-    // if the iterator points to the last key, the key was not found
-    if (itr == currentNode->keys.end()) {
-        cout << "Unable to remove: The key '" << x << "' was not found in the B+ Tree." << endl;
-        return;
+    // a tombstone left by a deferred delete goes for good
+    if (currentNode->pointer.pData[pos].empty()) {
+        tombstones--;
     }
+    noteRemove(x, currentNode->pointer.pData[pos], true);
 
-    // erase the vector of Record pointers from the position
+    // close the gap, moving the posting lists rather than copying them
+    currentNode->keys.erase(currentNode->keys.begin() + pos);
     currentNode->pointer.pData.erase(currentNode->pointer.pData.begin() + pos);
 
-    // shift key-pointer pairs to fill up the gap
-    for (int i = pos; i < currentNode->keys.size() - 1; i++) {
-        currentNode->keys[i] = currentNode->keys[i + 1];
-        currentNode->pointer.pData[i] = currentNode->pointer.pData[i + 1];
-    }
+    TRACE_INFO("tree.remove", x);
 
-    // resize the vectors
-    auto new_size = currentNode->keys.size() - 1;
-    currentNode->keys.resize(new_size);
-    currentNode->pointer.pData.resize(new_size);
+    rebalanceLeaf(currentNode, parentNode, parentLeft, parentRight);
+}
 
-    // if the currentNode is the rootNode and is empty, the tree is empty
-    if (currentNode == rootNode && currentNode->keys.empty()) {
-        setRoot(nullptr);
-    }
+void Tree::rebalanceLeaf(Node *currentNode, Node *parentNode, int parentLeft, int parentRight) {
+    /*
+     * Restores a leaf that lost keys: a root leaf is dropped once empty, any other leaf that became underfull
+     * borrows as many keys as it is short of from a sibling that can spare them, or else merges with one.
+     * The leaf may be short of more than one key when several were purged from it at once.
+     */
+    Node *rootNode = getRoot();
+    size_t minKeys = (getN() + 1) / 2;
 
-    cout << "Removed '" << x << "' from the B+ Tree successfully!" << endl;
+    // a root leaf has no siblings to rebalance with, and if it is empty the tree is empty
+    if (currentNode == rootNode) {
+        if (currentNode->keys.empty()) {
+            setRoot(nullptr);
+            delete currentNode;
+        }
+        return;
+    }
 
     // return if the B+ tree is still balanced
-    if (currentNode->keys.size() >= (getN() + 1) / 2) {
+    if (currentNode->keys.size() >= minKeys) {
         return;
     }
+    size_t missing = minKeys - currentNode->keys.size();
 
-    // attempt to borrow a key from the left sibling if we have a left sibling
+    // attempt to borrow keys from the left sibling if we have a left sibling
     if (parentLeft >= 0) {
         Node *leftNode = parentNode->pointer.pNode[parentLeft];
 
-        // check if left sibling has extra key to lend
-        if (leftNode->keys.size() >= (getN() + 1) / 2 + 1) {
+        // check if left sibling has enough extra keys to lend
+        if (leftNode->keys.size() >= minKeys + missing) {
 
-            // transfer the largest key from the left Sibling
-            auto maxIdx = leftNode->keys.size() - 1;
-            currentNode->keys.insert(currentNode->keys.begin(), leftNode->keys[maxIdx]);
-            currentNode->pointer.pData.insert(currentNode->pointer.pData.begin(), leftNode->pointer.pData[maxIdx]);
+            // transfer the largest keys from the left Sibling
+            auto firstIdx = leftNode->keys.size() - missing;
+            currentNode->keys.insert(currentNode->keys.begin(), leftNode->keys.begin() + firstIdx,
+                                     leftNode->keys.end());
+            currentNode->pointer.pData.insert(currentNode->pointer.pData.begin(),
+                                              make_move_iterator(leftNode->pointer.pData.begin() + firstIdx),
+                                              make_move_iterator(leftNode->pointer.pData.end()));
 
             // resize the left sibling node
-            leftNode->keys.resize(maxIdx);
-            leftNode->pointer.pData.resize(maxIdx);
+            leftNode->keys.resize(firstIdx);
+            leftNode->pointer.pData.resize(firstIdx);
 
             // update the parentNode
             parentNode->keys[parentLeft] = currentNode->keys[0];
+            if (aggregatesEnabled) {
+                parentNode->childAggregates[parentLeft] = computeAggregate(leftNode);
+                parentNode->childAggregates[parentLeft + 1] = computeAggregate(currentNode);
+            }
             return;
         }
     }
 
-    // attempt to borrow a key from the right sibling, if we have a right sibling
+    // attempt to borrow keys from the right sibling, if we have a right sibling
     if (parentRight < parentNode->pointer.pNode.size()) {
         Node *rightNode = parentNode->pointer.pNode[parentRight];
 
-        // check if right sibling has extra key to lend
-        if (rightNode->keys.size() >= (getN() + 1) / 2 + 1) {
+        // check if right sibling has enough extra keys to lend
+        if (rightNode->keys.size() >= minKeys + missing) {
 
-            // transfer the smallest key from the right Sibling
-            int minIdx = 0;
-            currentNode->keys.push_back(rightNode->keys[minIdx]);
-            currentNode->pointer.pData.push_back(rightNode->pointer.pData[minIdx]);
+            // transfer the smallest keys from the right Sibling
+            currentNode->keys.insert(currentNode->keys.end(), rightNode->keys.begin(),
+                                     rightNode->keys.begin() + missing);
+            currentNode->pointer.pData.insert(currentNode->pointer.pData.end(),
+                                              make_move_iterator(rightNode->pointer.pData.begin()),
+                                              make_move_iterator(rightNode->pointer.pData.begin() + missing));
 
             // resize the right sibling node
-            rightNode->keys.erase(rightNode->keys.begin());
-            rightNode->pointer.pData.erase(rightNode->pointer.pData.begin());
+            rightNode->keys.erase(rightNode->keys.begin(), rightNode->keys.begin() + missing);
+            rightNode->pointer.pData.erase(rightNode->pointer.pData.begin(),
+                                           rightNode->pointer.pData.begin() + missing);
 
             // update the parentNode
             parentNode->keys[parentRight - 1] = rightNode->keys[0];
+            if (aggregatesEnabled) {
+                parentNode->childAggregates[parentRight - 1] = computeAggregate(currentNode);
+                parentNode->childAggregates[parentRight] = computeAggregate(rightNode);
+            }
             return;
         }
     }
@@ -134,10 +191,16 @@ void Tree::removeKey(int x) {
         // merge the two leaf nodes by transferring the key-pointer pairs
         for (int i = 0; i < currentNode->keys.size(); i++) {
             leftNode->keys.push_back(currentNode->keys[i]);
-            leftNode->pointer.pData.push_back(currentNode->pointer.pData[i]);
+            leftNode->pointer.pData.push_back(std::move(currentNode->pointer.pData[i]));
         }
-        // update the pointer to the next leaf node
+        // update the pointers to and from the next leaf node
         leftNode->pNextLeaf = currentNode->pNextLeaf;
+        if (leftNode->pNextLeaf != nullptr) {
+            leftNode->pNextLeaf->pPrevLeaf = leftNode;
+        }
+        if (aggregatesEnabled) {
+            parentNode->childAggregates[parentLeft] = computeAggregate(leftNode);
+        }
 
         // delete the node
         removeInternal(parentNode->keys[parentLeft], parentNode, currentNode);//delete parentNode Node Key
@@ -148,10 +211,16 @@ void Tree::removeKey(int x) {
         // merge the two leaf nodes by transferring the key-pointer pairs
         for (int i = 0; i < rightNode->keys.size(); i++) {
             currentNode->keys.push_back(rightNode->keys[i]);
-            currentNode->pointer.pData.push_back(rightNode->pointer.pData[i]);
+            currentNode->pointer.pData.push_back(std::move(rightNode->pointer.pData[i]));
         }
-        // update the pointer to the next leaf node
+        // update the pointers to and from the next leaf node
         currentNode->pNextLeaf = rightNode->pNextLeaf;
+        if (currentNode->pNextLeaf != nullptr) {
+            currentNode->pNextLeaf->pPrevLeaf = currentNode;
+        }
+        if (aggregatesEnabled) {
+            parentNode->childAggregates[parentRight - 1] = computeAggregate(currentNode);
+        }
 
         // delete the node
         removeInternal(parentNode->keys[parentRight - 1], parentNode, rightNode);
@@ -170,12 +239,23 @@ void Tree::removeInternal(int x, Node *currentNode, Node *child) {
     if (currentNode == rootNode) {
         if (currentNode->keys.size() == 1) {
             // if only one key is left in the rootNode and matches the child, set child as the rootNode
+            Node *newRootNode = nullptr;
             if (currentNode->pointer.pNode[1] == child) {
-                setRoot(currentNode->pointer.pNode[0]);
-                delete currentNode;
-                return;
+                newRootNode = currentNode->pointer.pNode[0];
             } else if (currentNode->pointer.pNode[0] == child) {
-                setRoot(currentNode->pointer.pNode[1]);
+                newRootNode = currentNode->pointer.pNode[1];
+            }
+
+            if (newRootNode != nullptr) {
+                // pending messages of the old root are the newest, so they go after those of the new root
+                if (newRootNode->isLeafNode) {
+                    pendingMessages -= currentNode->buffer.size();
+                    leafBatch.insert(leafBatch.end(), currentNode->buffer.begin(), currentNode->buffer.end());
+                } else {
+                    moveMessages(currentNode, newRootNode, INT_MIN, true);
+                }
+
+                setRoot(newRootNode);
                 delete currentNode;
                 return;
             }
@@ -212,6 +292,9 @@ void Tree::removeInternal(int x, Node *currentNode, Node *child) {
 
     // reduce the size of the keys vector, effectively deleting the last element
     currentNode->pointer.pNode.resize(currentNode->pointer.pNode.size() - 1);
+    if (aggregatesEnabled) {
+        currentNode->childAggregates.erase(currentNode->childAggregates.begin() + pos);
+    }
 
     // return if the B+ tree is still balanced
     if (currentNode->keys.size() >= (getMaxInternalChild() + 1) / 2 - 1) {
@@ -253,7 +336,19 @@ void Tree::removeInternal(int x, Node *currentNode, Node *child) {
 
             // resize the left sibling node
             leftNode->keys.resize(maxIdxKey);
-            leftNode->pointer.pData.resize(maxIdxPtr);
+            leftNode->pointer.pNode.resize(maxIdxPtr);
+
+            // pending messages for the transferred child move along with it
+            moveMessages(leftNode, currentNode, parentNode->keys[parentLeft], true);
+
+            // and so does its aggregate
+            if (aggregatesEnabled) {
+                currentNode->childAggregates.insert(currentNode->childAggregates.begin(),
+                                                    leftNode->childAggregates.back());
+                leftNode->childAggregates.pop_back();
+                parentNode->childAggregates[parentLeft] = computeAggregate(leftNode);
+                parentNode->childAggregates[parentLeft + 1] = computeAggregate(currentNode);
+            }
 
             return;
         }
@@ -267,14 +362,24 @@ void Tree::removeInternal(int x, Node *currentNode, Node *child) {
         if (rightNode->keys.size() >= (getMaxInternalChild() + 1) / 2) {
 
             // transfer the key from right sibling through parentNode
-            auto maxIdxKey = rightNode->keys.size() - 1;
             currentNode->keys.push_back(parentNode->keys[pos]);
             parentNode->keys[pos] = rightNode->keys[0];
             rightNode->keys.erase(rightNode->keys.begin());
 
             // transfer the pointer from parentRight to currentNode
             currentNode->pointer.pNode.push_back(rightNode->pointer.pNode[0]);
-            currentNode->pointer.pNode.erase(currentNode->pointer.pNode.begin());
+            rightNode->pointer.pNode.erase(rightNode->pointer.pNode.begin());
+
+            // pending messages for the transferred child move along with it
+            moveMessages(rightNode, currentNode, parentNode->keys[pos], false);
+
+            // and so does its aggregate
+            if (aggregatesEnabled) {
+                currentNode->childAggregates.push_back(rightNode->childAggregates.front());
+                rightNode->childAggregates.erase(rightNode->childAggregates.begin());
+                parentNode->childAggregates[pos] = computeAggregate(currentNode);
+                parentNode->childAggregates[pos + 1] = computeAggregate(rightNode);
+            }
 
             return;
         }
@@ -297,6 +402,13 @@ void Tree::removeInternal(int x, Node *currentNode, Node *child) {
 
         currentNode->pointer.pNode.resize(0);
         currentNode->keys.resize(0);
+        moveMessages(currentNode, leftNode, INT_MIN, true);
+        if (aggregatesEnabled) {
+            leftNode->childAggregates.insert(leftNode->childAggregates.end(), currentNode->childAggregates.begin(),
+                                             currentNode->childAggregates.end());
+            currentNode->childAggregates.clear();
+            parentNode->childAggregates[parentLeft] = computeAggregate(leftNode);
+        }
 
         removeInternal(parentNode->keys[parentLeft], parentNode, currentNode);
     } else if (parentRight < parentNode->pointer.pNode.size()) {
@@ -317,6 +429,13 @@ void Tree::removeInternal(int x, Node *currentNode, Node *child) {
 
         rightNode->pointer.pNode.resize(0);
         rightNode->keys.resize(0);
+        moveMessages(rightNode, currentNode, INT_MIN, true);
+        if (aggregatesEnabled) {
+            currentNode->childAggregates.insert(currentNode->childAggregates.end(),
+                                                rightNode->childAggregates.begin(), rightNode->childAggregates.end());
+            rightNode->childAggregates.clear();
+            parentNode->childAggregates[parentRight - 1] = computeAggregate(currentNode);
+        }
 
         removeInternal(parentNode->keys[parentRight - 1], parentNode, rightNode);
     }
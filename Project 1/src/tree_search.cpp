@@ -1,8 +1,11 @@
 #include <iostream>
 #include <algorithm>
+#include <climits>
 #include <vector>
 #include "dtypes.h"
 #include "tree.h"
+#include "bloom_filter.h"
+#include "trace.h"
 
 using namespace std;
 
@@ -10,6 +13,63 @@ vector<Record *> *Tree::search(int key, bool printNode) {
     /*
      * Searches the B+ tree for a key and returns the corresponding pointer to a vector of Record pointers.
      * If the key is not found in the tree, a nullptr is returned.
+     *
+     * In buffered mode, the messages still pending in the buffers on the way down are applied on top of the leaf
+     * entry. The result is then a copy owned by the tree, which stays valid until the next search.
+     *
+     * If a Bloom filter is attached, keys it rules out are answered without walking the tree.
+     */
+    TRACE_SCOPE_DEBUG("tree.search", key);
+
+    if (bloomFilter != nullptr && !bloomFilter->mayContain(key)) {
+        TRACE_DEBUG("tree.search.filtered", key);
+        return nullptr;
+    }
+
+    if (pendingMessages == 0 || rootNode == nullptr || rootNode->isLeafNode) {
+        // a tombstone (deferred deletes) is a key without records
+        vector<Record *> *result = searchLeaf(key, printNode);
+        return result != nullptr && result->empty() ? nullptr : result;
+    }
+
+    // collect the buffers on the path from the root down, newest (root) first
+    vector<Node *> path;
+    Node *currentNode = rootNode;
+    while (!currentNode->isLeafNode) {
+        path.push_back(currentNode);
+        int idx = upper_bound(currentNode->keys.begin(), currentNode->keys.end(), key) - currentNode->keys.begin();
+        currentNode = currentNode->pointer.pNode[idx];
+    }
+
+    // start from the leaf entry, then replay the pending messages from the oldest (deepest) to the newest
+    vector<Record *> *leafEntry = searchLeaf(key, printNode);
+    bufferedResult.clear();
+    if (leafEntry != nullptr) {
+        bufferedResult = *leafEntry;
+    }
+    for (auto node = path.rbegin(); node != path.rend(); node++) {
+        for (BufferMessage &message: (*node)->buffer) {
+            if (message.key != key) {
+                continue;
+            }
+            if (message.pRecord == nullptr) {
+                bufferedResult.clear();
+            } else {
+                bufferedResult.push_back(message.pRecord);
+            }
+        }
+    }
+
+    return bufferedResult.empty() ? nullptr : &bufferedResult;
+}
+
+vector<Record *> *Tree::searchLeaf(int key, bool printNode) {
+    /*
+     * Searches the B+ tree nodes for a key and returns the pointer to the vector of Record pointers in its leaf,
+     * ignoring any buffered messages. If the key is not found in the leaf, a nullptr is returned.
+     *
+     * With printNode set, the nodes on the path are printed once the lookup is done, so the descent itself is not
+     * interleaved with console output.
      */
 
     // check if the B+ tree is empty
@@ -18,35 +78,40 @@ vector<Record *> *Tree::search(int key, bool printNode) {
     } else {
         // start the currentNode at the rootNode
         Node *currentNode = rootNode;
+        vector<Node *> visited;
 
         // traverse to the leaf node
         while (!currentNode->isLeafNode) {
             int idx = upper_bound(currentNode->keys.begin(), currentNode->keys.end(), key) - currentNode->keys.begin();
 
             // count accesses for intermediate internal nodes
-            nodesAccessedNum++;
+            countNodeAccess();
 
-            // print intermediate internal nodes
+            // remember intermediate internal nodes for printing
             if (printNode) {
-                displayCurrentNode(currentNode);
+                visited.push_back(currentNode);
             }
 
             currentNode = currentNode->pointer.pNode[idx];
         }
 
-        // print the leaf node
-        if (printNode) {
-            displayCurrentNode(currentNode);
-        }
-
         // count the access for the leaf node
-        nodesAccessedNum++;
+        countNodeAccess();
 
         // binary search of the keys in the leaf node
         int idx = lower_bound(currentNode->keys.begin(), currentNode->keys.end(), key) - currentNode->keys.begin();
+        bool found = idx < currentNode->keys.size() && currentNode->keys[idx] == key;
+
+        // print the path, leaf node included
+        if (printNode) {
+            visited.push_back(currentNode);
+            for (Node *node: visited) {
+                displayCurrentNode(node);
+            }
+        }
 
         // key not found
-        if (idx == currentNode->keys.size() || currentNode->keys[idx] != key) {
+        if (!found) {
             return nullptr;
         }
 
@@ -59,6 +124,8 @@ Node *Tree::searchNode(int key, bool printNode) {
     /*
      * Searches the B+ tree for a key and returns the corresponding leaf node that the key resides in.
      * If the key is not found in the tree, a nullptr is returned.
+     *
+     * With printNode set, the internal nodes on the path are printed once the leaf is reached.
      */
 
     // check if the B+ tree is empty
@@ -67,26 +134,110 @@ Node *Tree::searchNode(int key, bool printNode) {
     } else {
         // start the currentNode at the rootNode
         Node *currentNode = rootNode;
+        vector<Node *> visited;
 
         // traverse to the leaf node
         while (!currentNode->isLeafNode) {
             int idx = upper_bound(currentNode->keys.begin(), currentNode->keys.end(), key) - currentNode->keys.begin();
 
             // count accesses for intermediate internal nodes
-            nodesAccessedNum++;
+            countNodeAccess();
 
-            // print intermediate internal nodes
+            // remember intermediate internal nodes for printing
             if (printNode) {
-                displayCurrentNode(currentNode);
+                visited.push_back(currentNode);
             }
 
             currentNode = currentNode->pointer.pNode[idx];
         }
 
         // count the access for the leaf node
-        nodesAccessedNum++;
+        countNodeAccess();
+
+        // print intermediate internal nodes
+        for (Node *node: visited) {
+            displayCurrentNode(node);
+        }
 
         // return the leaf node
         return currentNode;
     }
 }
+
+ReverseCursor::ReverseCursor(Node *aLeaf, int aKeyIdx) {
+    leaf = aLeaf;
+    keyIdx = aKeyIdx;
+}
+
+bool ReverseCursor::isValid() {
+    return leaf != nullptr;
+}
+
+int ReverseCursor::getKey() {
+    return leaf->keys[keyIdx];
+}
+
+vector<Record *> &ReverseCursor::getRecords() {
+    return leaf->pointer.pData[keyIdx];
+}
+
+void ReverseCursor::prev() {
+    /*
+     * Moves to the next smaller key, stepping back to the previous leaf when this one is exhausted.
+     * Tombstones (keys without records) are skipped.
+     */
+    keyIdx--;
+    while (leaf != nullptr) {
+        if (keyIdx < 0) {
+            leaf = leaf->pPrevLeaf;
+            if (leaf != nullptr) {
+                keyIdx = (int) leaf->keys.size() - 1;
+            }
+        } else if (leaf->pointer.pData[keyIdx].empty()) {
+            keyIdx--;
+        } else {
+            break;
+        }
+    }
+}
+
+ReverseCursor Tree::reverseCursor(int upperKey) {
+    /*
+     * Returns a cursor on the largest key <= upperKey, after applying any buffered messages. The cursor is not
+     * valid if there is no such key.
+     */
+    flushAllBuffers();
+    if (rootNode == nullptr) {
+        return {nullptr, 0};
+    }
+
+    Node *currentNode = rootNode;
+    while (!currentNode->isLeafNode) {
+        int idx = upper_bound(currentNode->keys.begin(), currentNode->keys.end(), upperKey) -
+                  currentNode->keys.begin();
+        countNodeAccess();
+        currentNode = currentNode->pointer.pNode[idx];
+    }
+    countNodeAccess();
+
+    // one past the key, then step back onto it (possibly into the previous leaf)
+    int idx = upper_bound(currentNode->keys.begin(), currentNode->keys.end(), upperKey) - currentNode->keys.begin();
+    ReverseCursor cursor = ReverseCursor(currentNode, idx);
+    cursor.prev();
+    return cursor;
+}
+
+vector<Record *> Tree::topK(size_t k) {
+    /*
+     * Returns the k records with the largest keys, in descending key order (ORDER BY key DESC LIMIT k).
+     * Descends once to the last leaf and walks backwards, so the cost is O(height + k).
+     */
+    TRACE_SCOPE_DEBUG("tree.topK", (int64_t) k);
+    vector<Record *> result;
+    for (ReverseCursor cursor = reverseCursor(INT_MAX); cursor.isValid() && result.size() < k; cursor.prev()) {
+        vector<Record *> &records = cursor.getRecords();
+        size_t count = min(records.size(), k - result.size());
+        result.insert(result.end(), records.begin(), records.begin() + count);
+    }
+    return result;
+}
@@ -0,0 +1,178 @@
+#include <algorithm>
+#include <climits>
+#include "tree.h"
+#include "trace.h"
+
+using namespace std;
+
+/*
+ * Deferred deletes.
+ *
+ * With deferred deletes enabled, removeKey() does not take the key out of its leaf. It descends once (binary
+ * search on every level), accounts for the records in the histogram and the aggregates, and leaves the key in
+ * place with an empty posting list: a tombstone. The list keeps its memory until the tombstone is purged, so a
+ * delete does not free anything either. Searches and scans treat a key without records as absent, and
+ * an insert under a tombstoned key simply fills the list again. No leaf ever changes size, so a delete never
+ * borrows, merges or touches the internal nodes.
+ *
+ * The tombstones are purged in rounds by compactTombstones(), meant to run from a background maintenance task
+ * between other operations. A round walks a bounded number of leaves from where the previous round stopped and
+ * erases their tombstones in place wherever the leaf stays at least half full. A leaf that would become
+ * underfull is purged in one batch after the walk: all of its tombstones go at once, and the leaf then borrows
+ * as many keys as it is short of from a sibling, or merges with it, so the internal nodes change about once
+ * per leaf rather than once per tombstone. The batch runs from right to left, so a leaf only borrows from a
+ * right sibling that has already been purged; tombstones it borrows from its left sibling are purged with it.
+ */
+
+void Tree::setDeferredDeletes(bool enabled) {
+    /*
+     * Enables deferred deletes, or disables them after purging every tombstone
+     */
+    deferredDeletes = enabled;
+    if (!enabled) {
+        // full passes from the start of the key space, until none are left or a pass finds none to purge
+        while (tombstones > 0) {
+            compactCursor = INT_MIN;
+            if (compactTombstones(SIZE_MAX) == 0) {
+                TRACE_ERROR("tree.tombstone.left", (int64_t) tombstones);
+                break;
+            }
+        }
+    }
+}
+
+bool Tree::isDeferredDeletes() {
+    return deferredDeletes;
+}
+
+size_t Tree::getTombstones() {
+    return tombstones;
+}
+
+void Tree::markTombstone(int key) {
+    /*
+     * Turns a key into a tombstone, with one descent and no change to the structure of the tree
+     */
+    if (rootNode == nullptr) {
+        TRACE_INFO("tree.remove.empty", key);
+        return;
+    }
+    long long lowerKey, upperKey;
+    Node *leaf = findLeaf(key, &lowerKey, &upperKey);
+    int pos = lower_bound(leaf->keys.begin(), leaf->keys.end(), key) - leaf->keys.begin();
+    if (pos == leaf->keys.size() || leaf->keys[pos] != key || leaf->pointer.pData[pos].empty()) {
+        TRACE_INFO("tree.remove.miss", key);
+        return;
+    }
+
+    noteRemove(key, leaf->pointer.pData[pos], true);
+    leaf->pointer.pData[pos].clear();
+    tombstones++;
+    TRACE_INFO("tree.remove.tombstone", key);
+}
+
+size_t Tree::compactTombstones(size_t maxLeaves) {
+    /*
+     * Runs one compaction round over up to maxLeaves leaves, and returns the number of tombstones purged.
+     * The next round continues with the following leaf, and starts over at the first leaf after the last one.
+     */
+    if (rootNode == nullptr || tombstones == 0) {
+        return 0;
+    }
+
+    long long lowerKey, upperKey;
+    Node *leaf = findLeaf(compactCursor, &lowerKey, &upperKey);
+    size_t purged = 0;
+    vector<int> underfull;
+
+    for (size_t visited = 0; leaf != nullptr && visited < maxLeaves; visited++, leaf = leaf->pNextLeaf) {
+        size_t size = leaf->keys.size();
+        size_t dead = 0;
+        for (auto &records: leaf->pointer.pData) {
+            dead += records.empty() ? 1 : 0;
+        }
+        if (dead == 0) {
+            continue;
+        }
+
+        // a leaf that would become underfull is left for the batch below, remembered by its first key
+        size_t minKeys = leaf == rootNode ? 1 : (n + 1) / 2;
+        if (size < minKeys + dead) {
+            underfull.push_back(leaf->keys[0]);
+            continue;
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < size; i++) {
+            if (leaf->pointer.pData[i].empty()) {
+                continue;
+            }
+            if (kept != i) {
+                leaf->keys[kept] = leaf->keys[i];
+                leaf->pointer.pData[kept] = std::move(leaf->pointer.pData[i]);
+            }
+            kept++;
+        }
+        leaf->keys.resize(kept);
+        leaf->pointer.pData.resize(kept);
+        purged += dead;
+    }
+    tombstones -= purged;
+
+    // where the next round starts, taken before the merges below restructure the leaves
+    compactCursor = leaf != nullptr && !leaf->keys.empty() ? leaf->keys[0] : INT_MIN;
+
+    // right to left, purgeLeaf accounts for these itself
+    for (auto itr = underfull.rbegin(); itr != underfull.rend(); itr++) {
+        purged += purgeLeaf(*itr);
+    }
+
+    TRACE_DEBUG("tree.tombstone.compact", (int64_t) purged);
+    return purged;
+}
+
+size_t Tree::purgeLeaf(int key) {
+    /*
+     * Erases every tombstone of the leaf the key belongs to, then rebalances the leaf, and returns the number of
+     * tombstones purged. An earlier merge may have moved the key, the descent finds it wherever it is. Keys
+     * borrowed from a sibling can bring tombstones along, so this repeats until the leaf has none left.
+     */
+    size_t purged = 0;
+    while (rootNode != nullptr) {
+        Node *leaf = rootNode;
+        Node *parentNode = nullptr;
+        int parentLeft = -1, parentRight = 1;
+
+        // traverse until the leaf node, remembering the positions of its siblings in the parent
+        while (!leaf->isLeafNode) {
+            int idx = upper_bound(leaf->keys.begin(), leaf->keys.end(), key) - leaf->keys.begin();
+            parentNode = leaf;
+            parentLeft = idx - 1;
+            parentRight = idx + 1;
+            leaf = leaf->pointer.pNode[idx];
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < leaf->keys.size(); i++) {
+            if (leaf->pointer.pData[i].empty()) {
+                continue;
+            }
+            if (kept != i) {
+                leaf->keys[kept] = leaf->keys[i];
+                leaf->pointer.pData[kept] = std::move(leaf->pointer.pData[i]);
+            }
+            kept++;
+        }
+        size_t dead = leaf->keys.size() - kept;
+        if (dead == 0) {
+            break;
+        }
+        leaf->keys.resize(kept);
+        leaf->pointer.pData.resize(kept);
+        tombstones -= dead;
+        purged += dead;
+
+        rebalanceLeaf(leaf, parentNode, parentLeft, parentRight);
+    }
+    return purged;
+}
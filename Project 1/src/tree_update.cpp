@@ -0,0 +1,221 @@
+#include <algorithm>
+#include <climits>
+#include "tree.h"
+#include "bloom_filter.h"
+#include "histogram.h"
+#include "trace.h"
+
+using namespace std;
+
+/*
+ * In-place record updates.
+ *
+ * The key of a record is its numVotes. An update changes numVotes in the record itself (in its disk block, the
+ * record does not move), and moves only that record's pointer from the posting list of the old key to the one
+ * of the new key. The other records under the old key stay where they are.
+ *
+ * When the new key falls in the same leaf as the old one and the leaf stays within its size limits, the whole
+ * update happens in that leaf after a single descent. The aggregates on the path are unchanged in that case,
+ * since the record's rating does not change and the path is the same. Otherwise the pointer is taken out
+ * through the regular removal path (when it was the last one under its key) and put back in with insertIntoLeaf.
+ */
+
+Node *Tree::findLeaf(int key, long long *lowerKey, long long *upperKey) {
+    /*
+     * Descends to the leaf a key belongs to, and returns the range [lowerKey, upperKey) of keys that belong to
+     * the same leaf
+     */
+    *lowerKey = LLONG_MIN;
+    *upperKey = LLONG_MAX;
+    Node *currentNode = rootNode;
+    while (!currentNode->isLeafNode) {
+        int idx = upper_bound(currentNode->keys.begin(), currentNode->keys.end(), key) - currentNode->keys.begin();
+        if (idx > 0) {
+            *lowerKey = currentNode->keys[idx - 1];
+        }
+        if (idx < currentNode->keys.size()) {
+            *upperKey = currentNode->keys[idx];
+        }
+        countNodeAccess();
+        currentNode = currentNode->pointer.pNode[idx];
+    }
+    countNodeAccess();
+    return currentNode;
+}
+
+bool Tree::updateInLeaf(Node *leaf, long long lowerKey, long long upperKey, Record *pRecord, int newKey) {
+    /*
+     * Moves a record from its old key to newKey within one leaf. Returns false without changing anything if
+     * newKey belongs to another leaf, the record is not in this leaf, or the leaf would have to split or merge.
+     */
+    int oldKey = pRecord->numVotes;
+    if (newKey < lowerKey || newKey >= upperKey) {
+        return false;
+    }
+
+    int oldPos = lower_bound(leaf->keys.begin(), leaf->keys.end(), oldKey) - leaf->keys.begin();
+    if (oldPos == leaf->keys.size() || leaf->keys[oldPos] != oldKey) {
+        return false;
+    }
+    vector<Record *> &oldRecords = leaf->pointer.pData[oldPos];
+    auto recordItr = find(oldRecords.begin(), oldRecords.end(), pRecord);
+    if (recordItr == oldRecords.end()) {
+        return false;
+    }
+    if (newKey == oldKey) {
+        return true;
+    }
+
+    // the number of keys left in the leaf afterwards
+    bool oldKeyEmptied = oldRecords.size() == 1;
+    auto newKeyItr = lower_bound(leaf->keys.begin(), leaf->keys.end(), newKey);
+    bool newKeyExists = newKeyItr != leaf->keys.end() && *newKeyItr == newKey;
+    size_t newSize = leaf->keys.size() - oldKeyEmptied + !newKeyExists;
+    size_t minKeys = leaf == rootNode ? 1 : (n + 1) / 2;
+    if (newSize > n || newSize < minKeys) {
+        return false;
+    }
+
+    if (histogram != nullptr) {
+        bool newKeyLive = newKeyExists && !leaf->pointer.pData[newKeyItr - leaf->keys.begin()].empty();
+        histogram->remove(oldKey, 1, oldKeyEmptied);
+        histogram->add(newKey, 1, !newKeyLive);
+    }
+
+    oldRecords.erase(recordItr);
+    if (oldKeyEmptied) {
+        leaf->keys.erase(leaf->keys.begin() + oldPos);
+        leaf->pointer.pData.erase(leaf->pointer.pData.begin() + oldPos);
+    }
+    pRecord->numVotes = newKey;
+
+    int newPos = lower_bound(leaf->keys.begin(), leaf->keys.end(), newKey) - leaf->keys.begin();
+    if (newKeyExists) {
+        if (leaf->pointer.pData[newPos].empty()) {
+            tombstones--;
+        }
+        leaf->pointer.pData[newPos].push_back(pRecord);
+    } else {
+        leaf->keys.insert(leaf->keys.begin() + newPos, newKey);
+        leaf->pointer.pData.insert(leaf->pointer.pData.begin() + newPos, vector<Record *>{pRecord});
+    }
+
+    if (bloomFilter != nullptr) {
+        if (oldKeyEmptied) {
+            bloomFilter->remove(oldKey);
+        }
+        if (bloomFilter->needsRebuild()) {
+            bloomFilter->build(this);
+        }
+        bloomFilter->add(newKey);
+    }
+    return true;
+}
+
+bool Tree::moveRecord(Node *leaf, Record *pRecord, int newKey) {
+    /*
+     * Moves a record from its old key in leaf to newKey anywhere in the tree. Returns false if the record is not
+     * indexed under its key.
+     */
+    int oldKey = pRecord->numVotes;
+    int oldPos = lower_bound(leaf->keys.begin(), leaf->keys.end(), oldKey) - leaf->keys.begin();
+    if (oldPos == leaf->keys.size() || leaf->keys[oldPos] != oldKey) {
+        TRACE_INFO("tree.update.miss", oldKey);
+        return false;
+    }
+    vector<Record *> &oldRecords = leaf->pointer.pData[oldPos];
+    auto recordItr = find(oldRecords.begin(), oldRecords.end(), pRecord);
+    if (recordItr == oldRecords.end()) {
+        TRACE_INFO("tree.update.miss", oldKey);
+        return false;
+    }
+
+    // take out only this record, or the whole key if it was the last record under it
+    bool oldKeyEmptied = oldRecords.size() == 1;
+    if (oldKeyEmptied) {
+        removeFromLeaf(oldKey);
+    } else {
+        vector<Record *> moved{pRecord};
+        noteRemove(oldKey, moved, false);
+        oldRecords.erase(recordItr);
+    }
+    pRecord->numVotes = newKey;
+
+    if (bloomFilter != nullptr) {
+        if (oldKeyEmptied) {
+            bloomFilter->remove(oldKey);
+        }
+        if (bloomFilter->needsRebuild()) {
+            bloomFilter->build(this);
+        }
+        bloomFilter->add(newKey);
+    }
+    insertIntoLeaf(newKey, pRecord);
+    return true;
+}
+
+bool Tree::update(Record *pRecord, int newKey) {
+    /*
+     * Changes the numVotes of an indexed record to newKey, in place, and moves its index entry along.
+     * Returns false (and leaves the record unchanged) if the record is not indexed under its numVotes.
+     * In buffered mode the pending messages are applied first, as they may involve the record.
+     */
+    TRACE_SCOPE_DEBUG("tree.update", newKey);
+
+    if (pendingMessages > 0) {
+        flushAllBuffers();
+    }
+    if (rootNode == nullptr) {
+        return false;
+    }
+
+    long long lowerKey, upperKey;
+    Node *leaf = findLeaf(pRecord->numVotes, &lowerKey, &upperKey);
+    if (updateInLeaf(leaf, lowerKey, upperKey, pRecord, newKey)) {
+        return true;
+    }
+    return moveRecord(leaf, pRecord, newKey);
+}
+
+size_t Tree::updateBatch(vector<pair<Record *, int>> &updates) {
+    /*
+     * Applies a batch of (record, new numVotes) updates and returns how many succeeded. The batch is sorted by
+     * the old keys (keeping the order of updates to the same record), and one descent is shared by all
+     * consecutive updates that stay within the same leaf.
+     */
+    TRACE_SCOPE_INFO("tree.updateBatch", (int64_t) updates.size());
+
+    if (pendingMessages > 0) {
+        flushAllBuffers();
+    }
+    stable_sort(updates.begin(), updates.end(), [](const pair<Record *, int> &a, const pair<Record *, int> &b) {
+        return a.first->numVotes < b.first->numVotes;
+    });
+
+    size_t updated = 0;
+    size_t i = 0;
+    while (i < updates.size() && rootNode != nullptr) {
+        long long lowerKey, upperKey;
+        Node *leaf = findLeaf(updates[i].first->numVotes, &lowerKey, &upperKey);
+
+        // apply the updates whose old and new keys are both in this leaf
+        size_t applied = 0;
+        for (size_t j = i; j < updates.size(); j++) {
+            Record *pRecord = updates[j].first;
+            if (pRecord->numVotes < lowerKey || pRecord->numVotes >= upperKey ||
+                !updateInLeaf(leaf, lowerKey, upperKey, pRecord, updates[j].second)) {
+                break;
+            }
+            applied++;
+        }
+        updated += applied;
+
+        // the update needs another leaf or a split or merge
+        if (applied == 0) {
+            updated += moveRecord(leaf, updates[i].first, updates[i].second);
+            applied = 1;
+        }
+        i += applied;
+    }
+    return updated;
+}
@@ -0,0 +1,388 @@
+#include "versioned_tree.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+using namespace std;
+
+Snapshot::Snapshot(VersionedTree *aTree, int aSlotIdx, VersionNode *aRoot) {
+    tree = aTree;
+    slotIdx = aSlotIdx;
+    root = aRoot;
+}
+
+Snapshot::Snapshot(Snapshot &&other) noexcept {
+    tree = other.tree;
+    slotIdx = other.slotIdx;
+    root = other.root;
+    other.slotIdx = -1;
+}
+
+Snapshot::~Snapshot() {
+    if (slotIdx >= 0) {
+        tree->unpin(slotIdx);
+    }
+}
+
+const vector<Record *> *Snapshot::search(int key) const {
+    /*
+     * Returns the records of a key in this version, or nullptr if the key is not in it
+     */
+    VersionNode *currentNode = root;
+    if (currentNode == nullptr) {
+        return nullptr;
+    }
+    while (!currentNode->isLeafNode) {
+        int idx = upper_bound(currentNode->keys.begin(), currentNode->keys.end(), key) - currentNode->keys.begin();
+        currentNode = currentNode->children[idx];
+    }
+
+    auto itr = lower_bound(currentNode->keys.begin(), currentNode->keys.end(), key);
+    if (itr == currentNode->keys.end() || *itr != key) {
+        return nullptr;
+    }
+    return currentNode->postings[itr - currentNode->keys.begin()];
+}
+
+static void collectRange(VersionNode *node, int lowerKey, int upperKey, vector<Record *> &result) {
+    /*
+     * Appends the records with lowerKey <= key <= upperKey in a subtree, in key order
+     */
+    if (node->isLeafNode) {
+        for (size_t i = lower_bound(node->keys.begin(), node->keys.end(), lowerKey) - node->keys.begin();
+             i < node->keys.size() && node->keys[i] <= upperKey; i++) {
+            result.insert(result.end(), node->postings[i]->begin(), node->postings[i]->end());
+        }
+        return;
+    }
+
+    size_t first = upper_bound(node->keys.begin(), node->keys.end(), lowerKey) - node->keys.begin();
+    size_t last = upper_bound(node->keys.begin(), node->keys.end(), upperKey) - node->keys.begin();
+    for (size_t i = first; i <= last; i++) {
+        collectRange(node->children[i], lowerKey, upperKey, result);
+    }
+}
+
+vector<Record *> Snapshot::searchRange(int lowerKey, int upperKey) const {
+    /*
+     * Returns the records with lowerKey <= key <= upperKey in this version, in key order
+     */
+    vector<Record *> result;
+    if (root != nullptr && lowerKey <= upperKey) {
+        collectRange(root, lowerKey, upperKey, result);
+    }
+    return result;
+}
+
+size_t Snapshot::countKeys() const {
+    /*
+     * Counts the keys in this version
+     */
+    size_t count = 0;
+    function<void(VersionNode *)> visit = [&](VersionNode *node) {
+        if (node->isLeafNode) {
+            count += node->keys.size();
+        } else {
+            for (VersionNode *child: node->children) {
+                visit(child);
+            }
+        }
+    };
+    if (root != nullptr) {
+        visit(root);
+    }
+    return count;
+}
+
+VersionedTree::VersionedTree(int blockSize) {
+    /*
+     * Constructor for an empty versioned tree, nodes hold as many keys as a Tree node of the same block size
+     */
+    n = (blockSize - 8) / (8 + 4);
+    root.store(nullptr);
+    globalEpoch.store(0);
+    for (ReaderSlot &slot: slots) {
+        slot.epoch.store(INACTIVE);
+    }
+    freedNodes = 0;
+    reclaimThreshold = 1024;
+}
+
+VersionedTree::~VersionedTree() {
+    // no snapshots may outlive the tree, so everything can go
+    for (RetiredNode &retiredNode: retired) {
+        delete retiredNode.node;
+        delete retiredNode.posting;
+    }
+    freeSubtree(root.load());
+}
+
+void VersionedTree::freeSubtree(VersionNode *node) {
+    if (node == nullptr) {
+        return;
+    }
+    for (VersionNode *child: node->children) {
+        freeSubtree(child);
+    }
+    for (const vector<Record *> *posting: node->postings) {
+        delete posting;
+    }
+    delete node;
+}
+
+Snapshot VersionedTree::pin() {
+    /*
+     * Pins the current version: claims a free reader slot, publishes the global epoch in it, and only then loads
+     * the root, so no node reachable from that root is freed until the snapshot is destroyed
+     */
+    size_t start = hash<thread::id>()(this_thread::get_id());
+    while (true) {
+        for (int i = 0; i < MAX_READERS; i++) {
+            int slotIdx = (int) ((start + i) % MAX_READERS);
+            uint64_t expected = INACTIVE;
+            if (slots[slotIdx].epoch.load(memory_order_relaxed) == INACTIVE &&
+                slots[slotIdx].epoch.compare_exchange_strong(expected, globalEpoch.load())) {
+                return {this, slotIdx, root.load()};
+            }
+        }
+        // every slot is taken, wait for a reader to finish
+        this_thread::yield();
+    }
+}
+
+void VersionedTree::unpin(int slotIdx) {
+    slots[slotIdx].epoch.store(INACTIVE, memory_order_release);
+}
+
+VersionNode *VersionedTree::copyNode(VersionNode *node) {
+    /*
+     * Returns a private copy of a published node, and marks the original as replaced
+     */
+    auto *copy = new VersionNode(*node);
+    replaced.push_back({0, node, nullptr});
+    return copy;
+}
+
+void VersionedTree::insertCopy(VersionNode *node, int key, Record *pRecord, VersionNode **copy,
+                               VersionNode **splitNode, int *splitKey) {
+    /*
+     * Inserts into a copy of the subtree of node. Returns the copy, and if it had to be split, the new right
+     * sibling together with the first key under it.
+     */
+    VersionNode *currentNode = copyNode(node);
+    *splitNode = nullptr;
+
+    if (currentNode->isLeafNode) {
+        int pos = lower_bound(currentNode->keys.begin(), currentNode->keys.end(), key) - currentNode->keys.begin();
+        if (pos < currentNode->keys.size() && currentNode->keys[pos] == key) {
+            // the key exists, its records are copied with the new one appended
+            auto *posting = new vector<Record *>(*currentNode->postings[pos]);
+            posting->push_back(pRecord);
+            replaced.push_back({0, nullptr, currentNode->postings[pos]});
+            currentNode->postings[pos] = posting;
+        } else {
+            currentNode->keys.insert(currentNode->keys.begin() + pos, key);
+            currentNode->postings.insert(currentNode->postings.begin() + pos, new vector<Record *>{pRecord});
+        }
+
+        // split a full leaf, the left half keeps n / 2 + 1 keys like Tree does
+        if (currentNode->keys.size() > n) {
+            auto *rightNode = new VersionNode;
+            rightNode->isLeafNode = true;
+            size_t middle = n / 2 + 1;
+            rightNode->keys.assign(currentNode->keys.begin() + middle, currentNode->keys.end());
+            rightNode->postings.assign(currentNode->postings.begin() + middle, currentNode->postings.end());
+            currentNode->keys.resize(middle);
+            currentNode->postings.resize(middle);
+            *splitNode = rightNode;
+            *splitKey = rightNode->keys[0];
+        }
+        *copy = currentNode;
+        return;
+    }
+
+    int idx = upper_bound(currentNode->keys.begin(), currentNode->keys.end(), key) - currentNode->keys.begin();
+    VersionNode *childCopy, *childSplit;
+    int childSplitKey;
+    insertCopy(currentNode->children[idx], key, pRecord, &childCopy, &childSplit, &childSplitKey);
+    currentNode->children[idx] = childCopy;
+    if (childSplit != nullptr) {
+        currentNode->keys.insert(currentNode->keys.begin() + idx, childSplitKey);
+        currentNode->children.insert(currentNode->children.begin() + idx + 1, childSplit);
+    }
+
+    // split a full internal node, the middle key moves up
+    if (currentNode->keys.size() > n) {
+        auto *rightNode = new VersionNode;
+        size_t middle = currentNode->keys.size() / 2;
+        *splitKey = currentNode->keys[middle];
+        rightNode->keys.assign(currentNode->keys.begin() + middle + 1, currentNode->keys.end());
+        rightNode->children.assign(currentNode->children.begin() + middle + 1, currentNode->children.end());
+        currentNode->keys.resize(middle);
+        currentNode->children.resize(middle + 1);
+        *splitNode = rightNode;
+    }
+    *copy = currentNode;
+}
+
+VersionNode *VersionedTree::removeCopy(VersionNode *node, int key, bool *removed) {
+    /*
+     * Removes a key from a copy of the subtree of node and returns the copy, or nullptr if the subtree became
+     * empty. If the key is not there, node itself is returned and nothing is copied.
+     */
+    if (node->isLeafNode) {
+        auto itr = lower_bound(node->keys.begin(), node->keys.end(), key);
+        *removed = itr != node->keys.end() && *itr == key;
+        if (!*removed) {
+            return node;
+        }
+
+        int pos = itr - node->keys.begin();
+        replaced.push_back({0, nullptr, node->postings[pos]});
+        if (node->keys.size() == 1) {
+            replaced.push_back({0, node, nullptr});
+            return nullptr;
+        }
+        VersionNode *currentNode = copyNode(node);
+        currentNode->keys.erase(currentNode->keys.begin() + pos);
+        currentNode->postings.erase(currentNode->postings.begin() + pos);
+        return currentNode;
+    }
+
+    int idx = upper_bound(node->keys.begin(), node->keys.end(), key) - node->keys.begin();
+    VersionNode *childCopy = removeCopy(node->children[idx], key, removed);
+    if (!*removed) {
+        return node;
+    }
+
+    if (childCopy != nullptr) {
+        VersionNode *currentNode = copyNode(node);
+        currentNode->children[idx] = childCopy;
+        return currentNode;
+    }
+
+    // the child became empty, drop it together with one of the keys next to it
+    if (node->children.size() == 1) {
+        replaced.push_back({0, node, nullptr});
+        return nullptr;
+    }
+    VersionNode *currentNode = copyNode(node);
+    currentNode->children.erase(currentNode->children.begin() + idx);
+    currentNode->keys.erase(currentNode->keys.begin() + (idx > 0 ? idx - 1 : 0));
+    return currentNode;
+}
+
+void VersionedTree::publish(VersionNode *newRoot) {
+    /*
+     * Makes the new root visible to readers, retires the nodes it replaced under the current epoch, and moves
+     * on to the next epoch
+     */
+    root.store(newRoot);
+    uint64_t epoch = globalEpoch.load();
+    for (RetiredNode &replacedNode: replaced) {
+        replacedNode.epoch = epoch;
+        retired.push_back(replacedNode);
+    }
+    replaced.clear();
+    globalEpoch.store(epoch + 1);
+
+    // a long-lived snapshot can hold back many nodes, so the threshold grows with what could not be freed
+    if (retired.size() >= reclaimThreshold) {
+        reclaim();
+        reclaimThreshold = max((size_t) 1024, 2 * retired.size());
+    }
+}
+
+void VersionedTree::reclaim() {
+    /*
+     * Frees the retired nodes that no pinned snapshot can reach anymore
+     */
+    uint64_t minEpoch = INACTIVE;
+    for (ReaderSlot &slot: slots) {
+        minEpoch = min(minEpoch, slot.epoch.load());
+    }
+
+    size_t kept = 0;
+    for (RetiredNode &retiredNode: retired) {
+        if (retiredNode.epoch < minEpoch) {
+            delete retiredNode.node;
+            delete retiredNode.posting;
+            freedNodes++;
+        } else {
+            retired[kept++] = retiredNode;
+        }
+    }
+    retired.resize(kept);
+    TRACE_DEBUG("versioned.reclaim", (int64_t) kept);
+}
+
+void VersionedTree::insert(int key, Record *pRecord) {
+    /*
+     * Inserts a key-pointer pair and publishes the new version
+     */
+    lock_guard<mutex> lock(writerLatch);
+    VersionNode *currentRoot = root.load();
+
+    VersionNode *newRoot;
+    if (currentRoot == nullptr) {
+        newRoot = new VersionNode;
+        newRoot->isLeafNode = true;
+        newRoot->keys.push_back(key);
+        newRoot->postings.push_back(new vector<Record *>{pRecord});
+    } else {
+        VersionNode *splitNode;
+        int splitKey;
+        insertCopy(currentRoot, key, pRecord, &newRoot, &splitNode, &splitKey);
+        if (splitNode != nullptr) {
+            auto *newRootNode = new VersionNode;
+            newRootNode->keys.push_back(splitKey);
+            newRootNode->children = {newRoot, splitNode};
+            newRoot = newRootNode;
+        }
+    }
+    publish(newRoot);
+}
+
+void VersionedTree::removeKey(int key) {
+    /*
+     * Removes a key and all the Record pointers stored under it, and publishes the new version
+     */
+    lock_guard<mutex> lock(writerLatch);
+    VersionNode *currentRoot = root.load();
+    if (currentRoot == nullptr) {
+        return;
+    }
+
+    bool removed;
+    VersionNode *newRoot = removeCopy(currentRoot, key, &removed);
+    if (!removed) {
+        return;
+    }
+
+    // a root with a single child is replaced by that child. Only the new root is known to be a private copy, the
+    // nodes below it can be published ones that older snapshots still reach, so those are retired instead.
+    bool privateCopy = true;
+    while (newRoot != nullptr && !newRoot->isLeafNode && newRoot->children.size() == 1) {
+        VersionNode *child = newRoot->children[0];
+        if (privateCopy) {
+            delete newRoot;
+            privateCopy = false;
+        } else {
+            replaced.push_back({0, newRoot, nullptr});
+        }
+        newRoot = child;
+    }
+    publish(newRoot);
+}
+
+size_t VersionedTree::getRetiredNodes() {
+    lock_guard<mutex> lock(writerLatch);
+    return retired.size();
+}
+
+size_t VersionedTree::getFreedNodes() {
+    lock_guard<mutex> lock(writerLatch);
+    return freedNodes;
+}
@@ -0,0 +1,132 @@
+#ifndef VERSIONED_TREE_H
+#define VERSIONED_TREE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "dtypes.h"
+
+struct VersionNode {
+    /*
+     * Node of a VersionedTree. Nodes are never changed once they are reachable from a published root.
+     */
+    bool isLeafNode = false;
+    std::vector<int> keys;
+    std::vector<VersionNode *> children;                   // internal nodes
+    std::vector<const std::vector<Record *> *> postings;   // leaf nodes, the records of keys[i]
+};
+
+class VersionedTree;
+
+class Snapshot {
+    /*
+     * A consistent, read-only version of a VersionedTree. The version stays intact (and its memory allocated)
+     * while the snapshot exists, no matter what the writer does in the meantime.
+     */
+private:
+    VersionedTree *tree;
+    int slotIdx;
+    VersionNode *root;
+
+    friend class VersionedTree;
+
+    Snapshot(VersionedTree *aTree, int aSlotIdx, VersionNode *aRoot);
+
+public:
+    Snapshot(Snapshot &&other) noexcept;
+
+    Snapshot(const Snapshot &) = delete;
+
+    Snapshot &operator=(const Snapshot &) = delete;
+
+    ~Snapshot();
+
+    const std::vector<Record *> *search(int key) const;
+
+    std::vector<Record *> searchRange(int lowerKey, int upperKey) const;
+
+    size_t countKeys() const;
+};
+
+class VersionedTree {
+    /*
+     * Copy-on-write B+ tree with snapshot isolation.
+     *
+     * A write copies the nodes on the path from the root to the leaf it changes (splitting copies as needed) and
+     * publishes the new root with a single atomic store, so readers that pinned the old root keep a consistent
+     * version. Leaves are not chained (a chain would force copying every leaf); range scans descend from the root
+     * of their snapshot instead. Removals drop empty nodes but do not rebalance, so nodes can be underfull.
+     *
+     * Replaced nodes are reclaimed with epochs. A reader publishes the global epoch in a reader slot before it
+     * loads the root. A writer retires the nodes it replaced under the current epoch and then advances it; the
+     * nodes are freed once no reader slot holds an epoch at or below their retire epoch.
+     *
+     * Any number of readers can run alongside writers; writers are serialized among themselves.
+     */
+public:
+    static const int MAX_READERS = 64;
+
+private:
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch;
+    };
+
+    struct RetiredNode {
+        uint64_t epoch;
+        VersionNode *node;
+        const std::vector<Record *> *posting;
+    };
+
+    static const uint64_t INACTIVE = UINT64_MAX;
+
+    int n;
+    std::atomic<VersionNode *> root;
+    std::atomic<uint64_t> globalEpoch;
+    ReaderSlot slots[MAX_READERS];
+
+    std::mutex writerLatch;
+    std::vector<RetiredNode> replaced;  // replaced by the write in progress
+    std::vector<RetiredNode> retired;   // replaced by published writes, waiting for the readers
+    size_t freedNodes;
+    size_t reclaimThreshold;
+
+    friend class Snapshot;
+
+    VersionNode *copyNode(VersionNode *node);
+
+    void insertCopy(VersionNode *node, int key, Record *pRecord, VersionNode **copy, VersionNode **splitNode,
+                    int *splitKey);
+
+    VersionNode *removeCopy(VersionNode *node, int key, bool *removed);
+
+    void publish(VersionNode *newRoot);
+
+    void reclaim();
+
+    void unpin(int slotIdx);
+
+    static void freeSubtree(VersionNode *node);
+
+public:
+    explicit VersionedTree(int blockSize);
+
+    ~VersionedTree();
+
+    VersionedTree(const VersionedTree &) = delete;
+
+    VersionedTree &operator=(const VersionedTree &) = delete;
+
+    Snapshot pin();
+
+    void insert(int key, Record *pRecord);
+
+    void removeKey(int key);
+
+    size_t getRetiredNodes();
+
+    size_t getFreedNodes();
+};
+
+#endif